@@ -29,7 +29,8 @@ struct ReelMagic_PlayerConfiguration;
 struct ReelMagic_PlayerAttributes;
 struct ReelMagic_VideoMixerMPEGProvider {
   virtual ~ReelMagic_VideoMixerMPEGProvider() {}
-  virtual void OnVerticalRefresh(void * const outputBuffer, const float fps) = 0;
+  virtual bool OnVerticalRefresh(const float fps) = 0; //returns true if the picture on display changed
+  virtual bool GetPictureRow(void * const out, const Bitu row, const Bitu begin, const Bitu end) = 0; //converts columns begin..end-1 of the picture on display to 32bpp BGRA (alpha untouched) at out[begin..]; false if no picture
   virtual const ReelMagic_PlayerConfiguration& GetConfig() const = 0;
   virtual const ReelMagic_PlayerAttributes& GetAttrs() const = 0;
 };
@@ -87,6 +88,9 @@ struct ReelMagic_MediaPlayerFile {
   virtual Bit32u GetFileSize() const = 0;
   virtual Bit32u Read(Bit8u *data, Bit32u amount) = 0;
   virtual void Seek(Bit32u pos, Bit32u type) = 0; // type can be either DOS_SEEK_SET || DOS_SEEK_CUR...
+  virtual const Bit8u *GetHostMapping() const { return 0; } // whole file mapped into host memory or NULL if it can only be Read()
+  virtual bool IsStream() const { return false; } // fed by the application while playing; no size, no seeking, and Read() returns 0 while waiting on it
+  virtual bool HasStreamEnded() const { return true; }
 };
 struct ReelMagic_MediaPlayer {
   virtual ~ReelMagic_MediaPlayer() {}
@@ -98,6 +102,11 @@ struct ReelMagic_MediaPlayer {
   virtual bool HasAudio() const = 0;
   virtual bool IsPlaying() const = 0;
   virtual Bitu GetBytesDecoded() const = 0;
+  virtual bool IsReadingHostMapping() const = 0; // decoding straight out of the host file mapping
+  virtual Bitu GetBytesReadThroughDOS() const = 0; // file data read through the DOS file callbacks so far
+  virtual Bitu GetCatchUpRefreshes() const = 0; // VGA refreshes that had to advance more than one picture
+  virtual Bitu GetPicturesSkipped() const = 0; // B pictures passed over without decoding while catching up
+  virtual Bitu GetPicturesDropped() const = 0; // B pictures not shown while showing I and P pictures only
 
   enum PlayMode {
     MPPM_PAUSEONCOMPLETE,
@@ -109,6 +118,7 @@ struct ReelMagic_MediaPlayer {
   virtual void Stop() = 0;
   virtual void SeekToByteOffset(const Bit32u offset) = 0;
   virtual void NotifyConfigChange() = 0;
+  virtual void NotifyStreamData() = 0; // the application handed a stream player more data
 };
 
 //note: once a player file object is handed to new/delete player, regardless of success, it will be cleaned up
@@ -121,6 +131,14 @@ void ReelMagic_InitPlayer(Section* /*sec*/);
 void ReelMagic_ResetPlayers();
 ReelMagic_PlayerConfiguration& ReelMagic_GlobalDefaultPlayerConfig();
 
+enum ReelMagic_SIMDLevel { //same order as the "simd" option values after "auto"
+  REELMAGIC_SIMD_SCALAR,
+  REELMAGIC_SIMD_SSE2,
+  REELMAGIC_SIMD_AVX2,
+  REELMAGIC_SIMD_NEON,
+};
+ReelMagic_SIMDLevel ReelMagic_GetSIMDLevel(); //picked by ReelMagic_InitPlayer(); also used by the video mixer
+
 
 
 
@@ -29,7 +29,8 @@
 
 #define RENDER_SKIP_CACHE	16
 //Enable this for scalers to support 0 input for empty lines
-//#define RENDER_NULL_INPUT
+//(the ReelMagic video mixer hands over unchanged lines as 0)
+#define RENDER_NULL_INPUT
 
 typedef struct {
 	struct { 
@@ -19,6 +19,7 @@
 /* $Id: drive_iso.cpp,v 1.27 2009-09-22 21:48:08 c2woody Exp $ */
 
 #include <cctype>
+#include <cstdio>
 #include <cstring>
 #include "cdrom.h"
 #include "dosbox.h"
@@ -379,6 +380,27 @@ bool isoDrive::isRemovable(void) {
 	return true;
 }
 
+bool isoDrive::GetHostFileExtent(char *name, char *imagePath, Bit32u &offset, Bit32u &size) {
+	isoDirEntry de;
+	if (!lookup(&de, name) || IS_DIR(de.fileFlags)) return false;
+
+	// only plain images of 2048-byte sectors keep the file contiguous on the host;
+	// raw and cue/bin images have the primary volume descriptor somewhere else
+	FILE *image = fopen(fileName, "rb");
+	if (image == NULL) return false;
+	Bit8u pvd[6] = { 0 };
+	bool cooked = (fseek(image, ISO_FIRST_VD * ISO_FRAMESIZE, SEEK_SET) == 0)
+	           && (fread(pvd, 1, sizeof(pvd), image) == sizeof(pvd))
+	           && (memcmp(pvd, "\1CD001", sizeof(pvd)) == 0);
+	fclose(image);
+	if (!cooked) return false;
+
+	safe_strncpy(imagePath, fileName, CROSS_LEN);
+	offset = EXTENT_LOCATION(de) * ISO_FRAMESIZE;
+	size = DATA_LENGTH(de);
+	return true;
+}
+
 Bits isoDrive::UnMount(void) {
 	if(MSCDEX_RemoveDrive(driveLetter)) {
 		delete this;
@@ -330,6 +330,7 @@ public:
 	virtual bool isRemovable(void);
 	virtual Bits UnMount(void);
 	bool readSector(Bit8u *buffer, Bit32u sector);
+	bool GetHostFileExtent(char *name, char *imagePath, Bit32u &offset, Bit32u &size);
 	virtual char const* GetLabel(void) {return discLabel;};
 	virtual void Activate(void);
 private:
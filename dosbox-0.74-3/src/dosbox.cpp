@@ -661,14 +661,35 @@ void DOSBOX_Init(void) {
 	Pbool->Set_help("Force the FMPDRV.EXE to always be resident and not unloadable.");
 	Pbool = secprop->Add_bool("vgadup5hack",Property::Changeable::OnlyAtStart,false);
 	Pbool->Set_help("Enable the VGA DUP5 Hack. Duplicate's every VGA 5th line.");
+	Pstring = secprop->Add_string("colorkey",Property::Changeable::OnlyAtStart,"000000");
+	Pstring->Set_help("RGB colour in hex that shows the MPEG video through hi-colour (15/16bpp) and true-colour (32bpp) VGA modes. Defaults to 000000 (black).");
 	Pint = secprop->Add_int("audiolevel", Property::Changeable::OnlyAtStart,150);
 	Pint->Set_help("Sets the MPEG audio sample level in percents. Defaults to 150%");
 	Pint = secprop->Add_int("audiofifosize", Property::Changeable::OnlyAtStart,30);
-	Pint->Set_help("Sets the MPEG audio frame FIFO size. Defaults to 30 MPEG audio frames.");
+	Pint->SetMinMax(2,100);
+	Pint->Set_help("Sets the MPEG audio frame FIFO size in frames at 44.1kHz, between 2 and 100. Streams at other sample rates get the same length of audio. Defaults to 30 MPEG audio frames.");
 	Pint = secprop->Add_int("audiofifodispose", Property::Changeable::OnlyAtStart,2);
 	Pint->Set_help("Sets the count of MPEG audio frames to dispose of when the MPEG is going faster than audio-side of things and the FIFO hits max. Defaults to 2.");
 	Pstring = secprop->Add_string("initialmagickey",Property::Changeable::OnlyAtStart,"40044041");
 	Pstring->Set_help("Provides and alternate value for the initial global \"magic key\" value in hex. Defaults to 40044041.");
+	Pbool = secprop->Add_bool("decodethreads",Property::Changeable::OnlyAtStart,false);
+	Pbool->Set_help("Decode MPEG assets on a separate thread per player instead of the emulation thread. Defaults to false.");
+	Pint = secprop->Add_int("filereadsize",Property::Changeable::OnlyAtStart,32768);
+	Pint->SetMinMax(4096,65536);
+	Pint->Set_help("Number of bytes read from an MPEG asset file at a time. Defaults to 32768.");
+	Pstring = secprop->Add_path("indexcachedir",Property::Changeable::OnlyAtStart,"");
+	Pstring->Set_help("Directory to keep MPEG asset index files in. Assets without one are scanned once when first seeked into.\n"
+		"Use tools/build_asset_index to prebuild them for a CD image. Empty disables index files.");
+	Pint = secprop->Add_int("slicethreads",Property::Changeable::OnlyAtStart,0);
+	Pint->SetMinMax(0,16);
+	Pint->Set_help("Number of additional threads that decode the slices of an MPEG picture in parallel. 0 decodes on the calling thread. Defaults to 0.");
+	Pint = secprop->Add_int("loopcachemb",Property::Changeable::OnlyAtStart,0);
+	Pint->SetMinMax(0,1024);
+	Pint->Set_help("Megabytes of decoded frames kept per player for a looping clip. Clips that fit are played back from memory after their first pass. 0 disables it. Defaults to 0.");
+	const char* rmsimd_values[] = { "auto", "scalar", "sse2", "avx2", "neon", 0 };
+	Pstring = secprop->Add_string("simd",Property::Changeable::OnlyAtStart,"auto");
+	Pstring->Set_values(rmsimd_values);
+	Pstring->Set_help("SIMD kernels used by the MPEG decoder and the video mixer. auto picks the best one the CPU supports; scalar forces the plain C code for A/B comparison.");
 	Pint = secprop->Add_int("magicfhack",Property::Changeable::OnlyAtStart,0);
 	Pint->Set_help("MPEG debugging only! Consult the reelmagic_player.cpp source code and NOTES_MPEG.md");
 	Pbool = secprop->Add_bool("a204debug",Property::Changeable::OnlyAtStart,true);
@@ -30,10 +30,13 @@
 #include "dos_system.h"
 #include "dos_inc.h"
 #include "regs.h"
+#include "paging.h"
 #include "programs.h"
 #include "callback.h"
 #include "mixer.h"
 #include "setup.h"
+#include "cross.h"
+#include "../dos/drives.h"
 
 #include <stdio.h>
 #include <stdarg.h>
@@ -43,6 +46,16 @@
 #include <exception>
 #include <string>
 #include <stack>
+#include <vector>
+
+#if defined (WIN32)
+#include <windows.h>
+#elif (C_HAVE_MPROTECT)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 
 
@@ -53,6 +66,7 @@ static const Bit8u  REELMAGIC_DRIVER_VERSION_MINOR  = 21;
 static const Bit16u REELMAGIC_BASE_IO_PORT          = 0x9800; //note: the real deal usually sits at 260h... practically unused for now; XXX should this be configurable!?
 static const Bit8u  REELMAGIC_IRQ                   = 11;     //practically unused for now; XXX should this be configurable!?
 static const char   REELMAGIC_FMPDRV_EXE_LOCATION[] = "Z:\\"; //the trailing \ is super important!
+static const Bit32u REELMAGIC_STREAM_WATERMARK      = 96 * 1024; //ask for more stream data once the player has less than this left
 
 static Bitu   _dosboxCallbackNumber      = 0;
 static Bit8u  _installedInterruptNumber  = 0; //0 means not currently installed
@@ -132,12 +146,21 @@ namespace {
     //as far as I can tell, "FMPDRV.EXE" also opens requested files into the current PSP...
     const std::string _fileName;
     const Bit16u _pspEntry;
-    static Bit16u OpenDosFileEntry(const std::string& filename) {
-      Bit16u rv;
+    const Bit8u *_hostMapping; //see MapHostFile()
+    Bit32u _hostMappingOffset; //where the file starts inside the mapped view
+    Bit32u _hostMappingSize;   //size of the whole mapped view
+#if defined (WIN32)
+    HANDLE _hostMappingObject;
+#endif
+    static std::string GetDosFilePath(const std::string& filename) {
       std::string dosfilepath = &filename[4]; //skip over the "DOS:" prefixed by the constructor
       const size_t last_slash = dosfilepath.find_last_of('/');
       if (last_slash != std::string::npos) dosfilepath = dosfilepath.substr(0, last_slash);
-      if (!DOS_OpenFile(dosfilepath.c_str(), OPEN_READ, &rv))
+      return dosfilepath;
+    }
+    static Bit16u OpenDosFileEntry(const std::string& filename) {
+      Bit16u rv;
+      if (!DOS_OpenFile(GetDosFilePath(filename).c_str(), OPEN_READ, &rv))
         throw RMException("DOS File: Open for read failed: %s", filename.c_str());
       return rv;
     }
@@ -179,14 +202,108 @@ namespace {
     void Seek(Bit32u pos, Bit32u type) {
       if (!DOS_SeekFile(_pspEntry, &pos, type)) throw RMException("DOS File: Seek failed.");
     }
+    const Bit8u *GetHostMapping() const {return _hostMapping;}
+
+    void MapHostFile() {
+      //when the file lives on a local drive or in a plain ISO image, map the host file
+      //read-only so the player can decode straight out of it instead of going through
+      //DOS_ReadFile()... the DOS handle stays open so DOS still sees the file opened by
+      //the current PSP. files in raw or cue/bin images keep using DOS_ReadFile() as their
+      //sectors carry headers and are not contiguous on the host
+      char fullname[DOS_PATHLENGTH];
+      Bit8u drive;
+      if (!DOS_MakeName(GetDosFilePath(_fileName).c_str(), fullname, &drive)) return;
+      Bit32u size = 0;
+      try { size = GetFileSize(); } catch (...) {}
+      if (size == 0) return;
+      char hostname[CROSS_LEN];
+      Bit32u offset = 0;
+      bool wholeFile = true;
+      localDrive * const ldp = dynamic_cast<localDrive*>(Drives[drive]);
+      isoDrive * const idp = dynamic_cast<isoDrive*>(Drives[drive]);
+      if (ldp != NULL) {
+        if (!ldp->GetSystemFilename(hostname, fullname)) return;
+      }
+      else if (idp != NULL) {
+        Bit32u extentSize = 0;
+        if (!idp->GetHostFileExtent(fullname, hostname, offset, extentSize)) return;
+        if (extentSize != size) return;
+        wholeFile = false;
+      }
+      else {
+        return;
+      }
+      const Bit8u *view = NULL;
+      Bit32u viewOffset = offset;
+#if defined (WIN32)
+      SYSTEM_INFO si;
+      GetSystemInfo(&si);
+      viewOffset -= offset % si.dwAllocationGranularity;
+      HANDLE file = CreateFileA(hostname, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+      if (file == INVALID_HANDLE_VALUE) return;
+      DWORD sizeHigh = 0;
+      const DWORD sizeLow = ::GetFileSize(file, &sizeHigh);
+      if (wholeFile ? ((sizeLow == size) && (sizeHigh == 0)) : ((sizeHigh != 0) || ((Bit64u)sizeLow >= (Bit64u)offset + size)))
+        _hostMappingObject = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+      CloseHandle(file); //the mapping object keeps its own reference to the file
+      if (_hostMappingObject == NULL) return;
+      view = (const Bit8u*)MapViewOfFile(_hostMappingObject, FILE_MAP_READ, 0, viewOffset, (offset - viewOffset) + size);
+      if (view == NULL) {
+        CloseHandle(_hostMappingObject);
+        _hostMappingObject = NULL;
+        return;
+      }
+#elif (C_HAVE_MPROTECT)
+      viewOffset -= offset % (Bit32u)sysconf(_SC_PAGESIZE);
+      const int fd = open(hostname, O_RDONLY);
+      if (fd == -1) return;
+      struct stat st;
+      if ((fstat(fd, &st) == 0) && (wholeFile ? (st.st_size == (off_t)size) : (st.st_size >= (off_t)offset + (off_t)size))) {
+        void * const mapping = mmap(NULL, (offset - viewOffset) + size, PROT_READ, MAP_PRIVATE, fd, (off_t)viewOffset);
+        if (mapping != MAP_FAILED) view = (const Bit8u*)mapping;
+      }
+      close(fd); //the mapping keeps its own reference to the file
+#endif
+      if (view == NULL) return;
+      _hostMappingOffset = offset - viewOffset;
+      _hostMappingSize = _hostMappingOffset + size;
+      _hostMapping = view + _hostMappingOffset;
+    }
+    void UnmapHostFile() {
+      if (_hostMapping == NULL) return;
+#if defined (WIN32)
+      UnmapViewOfFile(_hostMapping - _hostMappingOffset);
+      CloseHandle(_hostMappingObject);
+#elif (C_HAVE_MPROTECT)
+      munmap((void*)(_hostMapping - _hostMappingOffset), _hostMappingSize);
+#endif
+      _hostMapping = NULL;
+    }
   public:
     ReelMagic_MediaPlayerDOSFile(const char * const dosFilepath) :
       _fileName(std::string("DOS:")+dosFilepath),
-      _pspEntry(OpenDosFileEntry(dosFilepath)) {}
+      _pspEntry(OpenDosFileEntry(_fileName)),
+      _hostMapping(NULL),
+      _hostMappingOffset(0),
+      _hostMappingSize(0)
+#if defined (WIN32)
+      ,_hostMappingObject(NULL)
+#endif
+      { MapHostFile(); }
     ReelMagic_MediaPlayerDOSFile(const Bit16u filenameStrSeg, const Bit16u filenameStrPtr, const bool firstByteIsLen = false) :
       _fileName(std::string("DOS:") + strcpyFromDos(filenameStrSeg, filenameStrPtr, firstByteIsLen)),
-      _pspEntry(OpenDosFileEntry(_fileName)) {}
-    virtual ~ReelMagic_MediaPlayerDOSFile() { DOS_CloseFile(_pspEntry); }
+      _pspEntry(OpenDosFileEntry(_fileName)),
+      _hostMapping(NULL),
+      _hostMappingOffset(0),
+      _hostMappingSize(0)
+#if defined (WIN32)
+      ,_hostMappingObject(NULL)
+#endif
+      { MapHostFile(); }
+    virtual ~ReelMagic_MediaPlayerDOSFile() {
+      UnmapHostFile();
+      DOS_CloseFile(_pspEntry);
+    }
   };
 
   class ReelMagic_MediaPlayerHostFile : public ReelMagic_MediaPlayerFile {
@@ -223,6 +340,115 @@ namespace {
     }
     virtual ~ReelMagic_MediaPlayerHostFile() { fclose(_fp); }
   };
+
+  class ReelMagic_MediaPlayerStream;
+  std::vector<ReelMagic_MediaPlayerStream*> _streams;
+
+  class ReelMagic_MediaPlayerStream : public ReelMagic_MediaPlayerFile {
+    //this class is for "stream mode" (open subfunc 2)... there is no file; the application
+    //is asked for the data with driver_callback() 02h and answers with a buffer in its own
+    //memory. see ServiceStreamCallbacks() below for when that happens
+    const std::string _fileName;
+    ReelMagic_MediaPlayer_Handle _handle;
+    Bit16u _bufferSegment; //as set by the application before handing the buffer over
+    Bit16u _bufferOffset;
+    PhysPt _buffer;        //what is left of the buffer handed over...
+    Bit32u _bufferSize;
+    Bit32u _position;      //stream bytes handed to the player so far
+    bool   _ended;
+    static std::string MakeName(const Bit16u param1, const Bit16u param2) {
+      char name[32];
+      sprintf(name, "STREAM:%04X%04X", (unsigned)param2, (unsigned)param1);
+      return name;
+    }
+    static void CopyFromGuest(Bit8u *dest, PhysPt src, Bit32u amount) {
+      //page by page straight out of the application's memory... pages that are not plain
+      //host memory go through the page handlers
+      while (amount > 0) {
+        Bit32u chunk = MEM_PAGESIZE - (src & (MEM_PAGESIZE - 1));
+        if (chunk > amount) chunk = amount;
+        const HostPt page = get_tlb_read(src);
+        if (page != NULL) memcpy(dest, page + src, chunk);
+        else MEM_BlockRead(src, dest, chunk);
+        dest += chunk;
+        src += chunk;
+        amount -= chunk;
+      }
+    }
+  protected:
+    const char *GetFileName() const {return _fileName.c_str();}
+    Bit32u GetFileSize() const {return 0;}
+    Bit32u Read(Bit8u *data, Bit32u amount) {
+      if (amount > _bufferSize) amount = _bufferSize;
+      CopyFromGuest(data, _buffer, amount);
+      _buffer += amount;
+      _bufferSize -= amount;
+      _position += amount;
+      return amount;
+    }
+    void Seek(Bit32u /*pos*/, Bit32u /*type*/) {
+      throw RMException("DOS Stream: Seek not supported");
+    }
+    bool IsStream() const {return true;}
+    bool HasStreamEnded() const {return _ended && (_bufferSize == 0);}
+  public:
+    const Bit16u OpenParam1; //passed on to driver_callback() 04h
+    const Bit16u OpenParam2;
+    bool         OpenPending;
+    bool         RequestPending; //driver_callback() 02h has been invoked, but no buffer came back yet
+
+    ReelMagic_MediaPlayerStream(const Bit16u param1, const Bit16u param2) :
+      _fileName(MakeName(param1, param2)),
+      _handle(0),
+      _bufferSegment(0),
+      _bufferOffset(0),
+      _buffer(0),
+      _bufferSize(0),
+      _position(0),
+      _ended(false),
+      OpenParam1(param1),
+      OpenParam2(param2),
+      OpenPending(true),
+      RequestPending(false) {
+      _streams.push_back(this);
+    }
+    virtual ~ReelMagic_MediaPlayerStream() {
+      for (size_t i = 0; i < _streams.size(); ++i) {
+        if (_streams[i] != this) continue;
+        _streams.erase(_streams.begin() + i);
+        break;
+      }
+    }
+
+    ReelMagic_MediaPlayer_Handle GetHandle() const {return _handle;}
+    void SetHandle(const ReelMagic_MediaPlayer_Handle handle) {_handle = handle;}
+    Bit32u GetPosition() const {return _position;}
+    bool IsBufferEmpty() const {return _bufferSize == 0;}
+    bool IsEnded() const {return _ended;}
+    void SetBufferSegment(const Bit16u seg) {_bufferSegment = seg;}
+    void SetBufferOffset(const Bit16u off) {_bufferOffset = off;}
+    void HandOverBuffer(const Bit16u size) {
+      //an empty buffer is taken as the end of the stream...
+      if (_bufferSize != 0) LOG(LOG_REELMAGIC, LOG_WARN)("Stream handle #%u handed over a buffer with %u bytes of the last one left", (unsigned)_handle, (unsigned)_bufferSize);
+      _buffer = PhysMake(_bufferSegment, _bufferOffset);
+      _bufferSize = size;
+      if (size == 0) _ended = true;
+      RequestPending = false;
+    }
+    void End() {
+      _ended = true;
+      RequestPending = false;
+    }
+
+    static ReelMagic_MediaPlayerStream *Find(const ReelMagic_MediaPlayer_Handle handle) {
+      //any of the player's handles will do...
+      const ReelMagic_MediaPlayer_Handle master = ReelMagic_HandleToMediaPlayer(handle).GetAttrs().Handles.Master;
+      for (size_t i = 0; i < _streams.size(); ++i) {
+        if (_streams[i]->_handle == master) return _streams[i];
+      }
+      return NULL;
+    }
+  };
 };
 
 
@@ -408,6 +634,31 @@ static void InvokePlayerStateChangeCallbackOnCPUResumeIfRegistered(const bool is
     EnqueueTopUserCallbackOnCPUResume();
 }
 
+static void ServiceStreamCallbacks() {
+  //the application is told about stream players and asked for their data through
+  //driver_callback()... this can only be invoked when the application enters the driver
+  //so it happens on the way out of it. the next buffer is asked for once the last one
+  //has been taken in, and the player has less than REELMAGIC_STREAM_WATERMARK left
+  if ((_userCallbackFarPtr == 0) || (!_userCallbackStack.empty())) return;
+  for (size_t i = 0; i < _streams.size(); ++i) {
+    ReelMagic_MediaPlayerStream& stream = *_streams[i];
+    if (stream.GetHandle() == 0) continue; //still being opened
+    if (stream.OpenPending) {
+      stream.OpenPending = false;
+      _userCallbackStack.push(UserCallbackCall(4, stream.GetHandle(), stream.OpenParam1, stream.OpenParam2));
+      EnqueueTopUserCallbackOnCPUResume();
+      return;
+    }
+    if (stream.IsEnded() || stream.RequestPending || (!stream.IsBufferEmpty())) continue;
+    const Bitu decoded = ReelMagic_HandleToMediaPlayer(stream.GetHandle()).GetBytesDecoded(); //rounded up to 4k
+    if ((stream.GetPosition() > decoded) && ((stream.GetPosition() - decoded) >= REELMAGIC_STREAM_WATERMARK)) continue;
+    stream.RequestPending = true;
+    _userCallbackStack.push(UserCallbackCall(2, stream.GetHandle(), (Bit16u)stream.GetPosition(), (Bit16u)(stream.GetPosition() >> 16)));
+    EnqueueTopUserCallbackOnCPUResume();
+    return;
+  }
+}
+
 static void CleanupFromUserCallback(void) {
   if (_preservedUserCallbackStates.empty()) E_Exit("FMPDRV.EXE Asking to cleanup with nothing on preservation stack");
   if (_userCallbackStack.empty()) E_Exit("FMPDRV.EXE Asking to cleanup with nothing on user callback stack");
@@ -416,6 +667,19 @@ static void CleanupFromUserCallback(void) {
   //restore the previous state of things...
   const UserCallbackCall& ucc = _userCallbackStack.top();
   const bool invokeNext = ucc.invokeNext;
+  if (ucc.command == 2) {
+    //returning from a stream data request without handing a buffer over means there
+    //is no more...
+    try {
+      ReelMagic_MediaPlayerStream * const stream = ReelMagic_MediaPlayerStream::Find((ReelMagic_MediaPlayer_Handle)ucc.handle);
+      if ((stream != NULL) && stream->RequestPending) {
+        LOG(LOG_REELMAGIC, LOG_NORMAL)("Stream handle #%u ended at %u bytes", (unsigned)ucc.handle, (unsigned)stream->GetPosition());
+        stream->End();
+        ReelMagic_HandleToMediaPlayer((ReelMagic_MediaPlayer_Handle)ucc.handle).NotifyStreamData();
+      }
+    }
+    catch (...) {} //closed from within the callback
+  }
   _userCallbackStack.pop();
 
   const UserCallbackPreservedState& s = _preservedUserCallbackStates.top();
@@ -427,6 +691,9 @@ static void CleanupFromUserCallback(void) {
     APILOG(LOG_REELMAGIC, LOG_NORMAL)("Invoking Next Chained Callback...");
     EnqueueTopUserCallbackOnCPUResume();
   }
+  else {
+    ServiceStreamCallbacks();
+  }
 }
 
 
@@ -441,6 +708,14 @@ static Bit32u FMPDRV_EXE_driver_call(const Bit8u command, const Bit8u media_hand
   case 0x01:
     if (media_handle != 0) LOG(LOG_REELMAGIC, LOG_WARN)("Non-zero media handle on open command");
     if (((subfunc & 0xEFFF) != 1) && (subfunc != 2)) LOG(LOG_REELMAGIC, LOG_WARN)("subfunc not 1 or 2 on open command");
+    if (subfunc == 2) {
+      //stream mode... param1 and param2 are only passed on to driver_callback() 04h
+      ReelMagic_MediaPlayerStream * const stream = new ReelMagic_MediaPlayerStream(param1, param2);
+      rv = ReelMagic_NewPlayer(stream);
+      stream->SetHandle((ReelMagic_MediaPlayer_Handle)rv);
+      if (_userCallbackFarPtr == 0) LOG(LOG_REELMAGIC, LOG_WARN)("Opened stream handle #%u with no driver_callback() registered to ask for its data", (unsigned)rv);
+      return rv;
+    }
     //if subfunc (or rather flags) has the 0x1000 bit set, then the first byte of the caller's
     //pointer is the file path string length
     rv = ReelMagic_NewPlayer(new ReelMagic_MediaPlayerDOSFile(param2, param1, (subfunc & 0x1000) != 0));
@@ -538,6 +813,23 @@ static Bit32u FMPDRV_EXE_driver_call(const Bit8u command, const Bit8u media_hand
       cfg = &player->Config();
     }
     switch (subfunc) {
+    case 0x0303: //stream buffer offset
+    case 0x0304: //stream buffer size
+    case 0x0307: //stream buffer segment
+      {
+        ReelMagic_MediaPlayerStream * const stream = (media_handle != 0) ? ReelMagic_MediaPlayerStream::Find(media_handle) : NULL;
+        if (stream == NULL) {
+          LOG(LOG_REELMAGIC, LOG_WARN)("Ignoring stream buffer subfunc %04Xh for non-stream handle #%u", (unsigned)subfunc, (unsigned)media_handle);
+          return 0;
+        }
+        if (subfunc == 0x0307) stream->SetBufferSegment(param1);
+        if (subfunc == 0x0303) stream->SetBufferOffset(param1);
+        if (subfunc == 0x0304) {
+          stream->HandOverBuffer(param1);
+          ReelMagic_HandleToMediaPlayer(media_handle).NotifyStreamData();
+        }
+      }
+      return 0;
     case 0x0208: //user data
       rv = cfg->UserData;
       cfg->UserData = (param2 << 16) | param1;
@@ -679,6 +971,7 @@ static Bitu FMPDRV_EXE_INTHandler(void) {
    reg_ax = (Bit16u)(driver_call_rv & 0xFFFF); //low
    reg_dx = (Bit16u)(driver_call_rv >> 16);    //high
    APILOG_DCFILT(command, subfunc, "driver_call(%02Xh,%02Xh,%Xh,%Xh,%Xh)=%Xh", (unsigned)command, (unsigned)media_handle, (unsigned)subfunc, (unsigned)param1, (unsigned)param2, (unsigned)driver_call_rv);
+   ServiceStreamCallbacks(); //after the return values are in place as they are preserved across the callback
   }
   catch (std::exception& ex) {
     LOG(LOG_REELMAGIC, LOG_WARN)("Zeroing out INT return registers due to exception in driver_call(%02Xh,%02Xh,%Xh,%Xh,%Xh)", (unsigned)command, (unsigned)media_handle, (unsigned)subfunc, (unsigned)param1, (unsigned)param2);
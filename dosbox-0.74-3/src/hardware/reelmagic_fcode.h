@@ -0,0 +1,130 @@
+/*
+ *  Copyright (C) 2022 Jon Dennis
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+RMFC - "magical" f_code recovery
+
+The f_codes in the picture headers of "magical" assets (picture_rate code > 8)
+are scrambled; see the "Delta/Delta Approach" in NOTES_MPEG.md. The magic key
+selects a "delta/delta even pattern": every odd TSN steps the delta f_code by
+6 and every even one by the next entry of this pattern. The resulting delta
+sequence repeats every 56 TSNs, so it is precomputed once per asset.
+
+This is shared by the player (reelmagic_player.cpp) and the decoder benchmark
+(tools/benchmark_mpeg_decode.c). Include it after reelmagic_pl_mpeg.h. Like
+reelmagic_index.h, define `REELMAGIC_FCODE_IMPLEMENTATION` in *one* C/C++ file
+before including this header to create the implementation.
+*/
+
+#ifndef REELMAGIC_FCODE_H
+#define REELMAGIC_FCODE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RMFC_KEY_DEFAULT 0x40044041 // most ReelMagic games seem to use this key
+#define RMFC_KEY_HORDE   0xC39D7088 // The Horde uses this key
+
+typedef struct {
+	uint8_t delta_f_codes[56]; // indexed by TSN % 56
+	uint8_t r_size_override;   // see rmfc_init_static()
+} rmfc_t;
+
+
+// Compute the delta f_codes for the magic key. Returns 0 if the key is not
+// known, in which case the pattern of RMFC_KEY_DEFAULT is used.
+
+int rmfc_init(rmfc_t *self, uint32_t magic_key);
+
+
+// Use one f_code (1-7) for every picture instead, like the "magicfhack" option.
+
+void rmfc_init_static(rmfc_t *self, int f_code);
+
+
+// Picture header callbacks for plm_video_set_decode_picture_header_callback()
+// with user pointing to the rmfc_t; one for rmfc_init() and one for
+// rmfc_init_static().
+
+void rmfc_decode_picture_header(plm_video_t *self, void *user);
+void rmfc_decode_static_picture_header(plm_video_t *self, void *user);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // REELMAGIC_FCODE_H
+
+
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION
+
+#ifdef REELMAGIC_FCODE_IMPLEMENTATION
+
+int rmfc_init(rmfc_t *self, uint32_t magic_key) {
+	// The relationship between key and pattern is not known, so this is a
+	// lookup for now
+	static const uint8_t pattern_default[4] = {4, 3, 2, 3};
+	static const uint8_t pattern_horde[4] = {1, 3, 3, 3};
+
+	const uint8_t *even_pattern = (magic_key == RMFC_KEY_HORDE) ? pattern_horde : pattern_default;
+	unsigned delta = 2;
+	for (unsigned tsn = 0; tsn < sizeof(self->delta_f_codes); tsn++) {
+		delta += (tsn & 1) ? 6 : even_pattern[(tsn >> 1) & 3];
+		delta %= 7;
+		self->delta_f_codes[tsn] = (uint8_t)delta;
+	}
+	self->r_size_override = 0;
+	return (magic_key == RMFC_KEY_DEFAULT) || (magic_key == RMFC_KEY_HORDE);
+}
+
+void rmfc_init_static(rmfc_t *self, int f_code) {
+	self->r_size_override = (uint8_t)(f_code - 1);
+}
+
+void rmfc_decode_picture_header(plm_video_t *self, void *user) {
+	// r_size is f_code - 1 so the wrap-around addition in the 1-7 f_code range
+	// becomes a plain modulo 7 here
+	const unsigned delta = ((const rmfc_t *)user)->delta_f_codes[self->picture_temporal_reference % 56];
+	switch (self->picture_type) {
+	case PLM_VIDEO_PICTURE_TYPE_B:
+		self->motion_backward.r_size = (self->motion_backward.r_size + delta) % 7;
+		// fallthrough
+	case PLM_VIDEO_PICTURE_TYPE_PREDICTIVE:
+		self->motion_forward.r_size = (self->motion_forward.r_size + delta) % 7;
+	}
+}
+
+void rmfc_decode_static_picture_header(plm_video_t *self, void *user) {
+	const int r_size = ((const rmfc_t *)user)->r_size_override;
+	switch (self->picture_type) {
+	case PLM_VIDEO_PICTURE_TYPE_B:
+		self->motion_backward.r_size = r_size;
+		// fallthrough
+	case PLM_VIDEO_PICTURE_TYPE_PREDICTIVE:
+		self->motion_forward.r_size = r_size;
+	}
+}
+
+#endif // REELMAGIC_FCODE_IMPLEMENTATION
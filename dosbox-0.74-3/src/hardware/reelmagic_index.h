@@ -0,0 +1,572 @@
+/*
+ *  Copyright (C) 2022 Jon Dennis
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+RMIDX - MPEG asset index files
+
+This scans an MPEG-1 program stream (PS) or video elementary stream (ES) once
+and records where every picture starts, so that opening and seeking into an
+asset later on is a lookup instead of a scan. Index files are keyed by the
+asset's size and a hash of its first and last 64KiB, so the same asset found
+on a CD image and in a copied game directory shares one index file.
+
+This is shared by the player (reelmagic_player.cpp) and the index prebuild
+tool (tools/build_asset_index.c). Like reelmagic_pl_mpeg.h, define
+`REELMAGIC_INDEX_IMPLEMENTATION` in *one* C/C++ file before including this
+header to create the implementation.
+
+All data is read through a rmidx_read_callback, which reads len bytes at the
+given absolute offset of the asset and returns the number of bytes read.
+
+
+-- Index file layout (all values little-endian)
+
+	offset  size  field
+	0       4     "RMIX"
+	4       4     version (RMIDX_VERSION)
+	8       4     asset file size
+	12      8     asset hash (see rmidx_hash())
+	20      1     layout (RMIDX_LAYOUT_PS or RMIDX_LAYOUT_ES)
+	21      3     reserved
+	24      4     picture count
+	28      16*n  pictures:
+	              0  4  offset to start reading at to decode this picture
+	              4  8  33 bit 90kHz PTS or RMIDX_NO_PTS
+	              12 1  RMIDX_FLAG_* flags
+	              13 3  reserved
+
+Everything else about the asset (picture size, rate, f_codes) comes from its
+own headers, which the decoder has to read anyway.
+
+For PS assets the offset of a picture is the start of the pack its start code
+begins in; for ES assets it is the start code itself. Pictures that begin a
+GOP carry the offset of the GOP header, or of the sequence header right in
+front of it, so decoding can start there without any prior state.
+*/
+
+#ifndef REELMAGIC_INDEX_H
+#define REELMAGIC_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RMIDX_VERSION 2
+
+#define RMIDX_LAYOUT_PS 1
+#define RMIDX_LAYOUT_ES 2
+
+#define RMIDX_FLAG_SEQUENCE 0x01 // a sequence header precedes this picture
+#define RMIDX_FLAG_GOP      0x02 // a GOP header precedes this picture
+
+#define RMIDX_NO_PTS 0xFFFFFFFFFFFFFFFFULL
+
+typedef size_t (*rmidx_read_callback)(void *user, uint8_t *dest, uint32_t offset, size_t len);
+
+typedef struct {
+	uint32_t offset;
+	uint64_t pts;
+	uint8_t flags;
+} rmidx_picture_t;
+
+typedef struct {
+	uint32_t file_size;
+	uint64_t hash;
+	uint8_t layout;
+	uint32_t picture_count;
+	uint32_t picture_capacity;
+	rmidx_picture_t *pictures;
+} rmidx_t;
+
+
+// Hash the first and last 64KiB of an asset together with its size.
+
+uint64_t rmidx_hash(rmidx_read_callback read, void *user, uint32_t file_size);
+
+
+// Scan a whole asset and fill in the index. Returns 0 if no MPEG-1 PS or video
+// ES was found. The index must be freed with rmidx_free() either way.
+
+int rmidx_build(rmidx_t *self, rmidx_read_callback read, void *user, uint32_t file_size, uint64_t hash);
+
+
+// Scan only the pictures beginning between the start and end offsets of an
+// asset whose layout is already known, e.g. to find a GOP near a seek target
+// of an asset without an index file. start doesn't need to be aligned to a
+// pack or start code. Returns 0 if no picture was found. The index must be
+// freed with rmidx_free() either way and is not meant to be saved.
+
+int rmidx_build_range(rmidx_t *self, rmidx_read_callback read, void *user, uint32_t file_size, int layout, uint32_t start, uint32_t end);
+
+
+// Load the index file at path. Returns 0 if it doesn't exist or doesn't match
+// the given asset size and hash.
+
+int rmidx_load(rmidx_t *self, const char *path, uint32_t file_size, uint64_t hash);
+
+
+// Write the index to path. Returns 0 on failure.
+
+int rmidx_save(const rmidx_t *self, const char *path);
+
+
+// Free the pictures of an index.
+
+void rmidx_free(rmidx_t *self);
+
+
+// The name of the index file for an asset in the given directory.
+
+void rmidx_make_path(char *dest, size_t dest_len, const char *dir, uint32_t file_size, uint64_t hash);
+
+
+// Find the last picture that begins a GOP at or before the given file offset,
+// i.e. where decoding has to start to reach that offset. Returns NULL if there
+// is none.
+
+const rmidx_picture_t *rmidx_find_gop(const rmidx_t *self, uint32_t offset);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // REELMAGIC_INDEX_H
+
+
+
+// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+// IMPLEMENTATION
+
+#ifdef REELMAGIC_INDEX_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RMIDX_HASH_SPAN 65536
+#define RMIDX_READ_CHUNK 65536
+#define RMIDX_HEADER_SIZE 28
+#define RMIDX_PICTURE_SIZE 16
+
+uint64_t rmidx_hash(rmidx_read_callback read, void *user, uint32_t file_size) {
+	// FNV-1a over the head and tail of the file and the file size
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	uint8_t *chunk = (uint8_t *)malloc(RMIDX_HASH_SPAN);
+	uint32_t spans[2];
+	spans[0] = 0;
+	spans[1] = (file_size > RMIDX_HASH_SPAN) ? file_size - RMIDX_HASH_SPAN : 0;
+	for (int s = 0; s < 2; s++) {
+		size_t len = read(user, chunk, spans[s], RMIDX_HASH_SPAN);
+		for (size_t i = 0; i < len; i++) {
+			hash = (hash ^ chunk[i]) * 0x100000001B3ULL;
+		}
+	}
+	for (int i = 0; i < 4; i++) {
+		hash = (hash ^ ((file_size >> (i * 8)) & 0xFF)) * 0x100000001B3ULL;
+	}
+	free(chunk);
+	return hash;
+}
+
+
+// Buffered sequential reads on top of the read callback
+
+typedef struct {
+	rmidx_read_callback read;
+	void *user;
+	uint32_t file_size;
+	uint32_t chunk_pos;
+	size_t chunk_len;
+	size_t index;
+	uint8_t *chunk;
+} rmidx_reader_t;
+
+static uint32_t rmidx_reader_tell(rmidx_reader_t *r) {
+	return r->chunk_pos + (uint32_t)r->index;
+}
+
+static int rmidx_reader_byte(rmidx_reader_t *r) {
+	if (r->index >= r->chunk_len) {
+		r->chunk_pos += (uint32_t)r->chunk_len;
+		r->index = 0;
+		r->chunk_len = 0;
+		if (r->chunk_pos < r->file_size) {
+			r->chunk_len = r->read(r->user, r->chunk, r->chunk_pos, RMIDX_READ_CHUNK);
+		}
+		if (r->chunk_len == 0) {
+			return -1;
+		}
+	}
+	return r->chunk[r->index++];
+}
+
+static void rmidx_reader_seek(rmidx_reader_t *r, uint32_t pos) {
+	r->chunk_pos = pos;
+	r->chunk_len = 0;
+	r->index = 0;
+}
+
+static void rmidx_reader_skip(rmidx_reader_t *r, uint32_t count) {
+	while (count--) {
+		if (rmidx_reader_byte(r) == -1) {
+			return;
+		}
+	}
+}
+
+// Finds the next start code and returns its code byte, or -1 at the end
+
+static int rmidx_reader_next_start_code(rmidx_reader_t *r) {
+	uint32_t window = 0xFFFFFFFF;
+	int b;
+	while ((b = rmidx_reader_byte(r)) != -1) {
+		window = (window << 8) | (uint32_t)b;
+		if ((window & 0xFFFFFF00) == 0x00000100) {
+			return b;
+		}
+	}
+	return -1;
+}
+
+
+// Start code scanner for the video elementary stream. This is fed byte by byte
+// with the offset to seek to for decoding to see that byte.
+
+#define RMIDX_START_PICTURE 0x00
+#define RMIDX_START_SEQUENCE 0xB3
+#define RMIDX_START_GOP 0xB8
+
+typedef struct {
+	rmidx_t *index;
+	uint32_t window;
+	uint32_t offsets[4];      // seek offsets of the bytes in window
+	uint32_t pending_flags;   // RMIDX_FLAG_* seen since the last picture
+	uint32_t access_offset;   // where the pending sequence/GOP header begins
+	uint64_t pts;             // PTS of the current packet until a picture uses it
+} rmidx_scanner_t;
+
+static void rmidx_scanner_start_code(rmidx_scanner_t *s, int code, uint32_t offset) {
+	rmidx_t *index = s->index;
+
+	if (code == RMIDX_START_SEQUENCE) {
+		s->pending_flags |= RMIDX_FLAG_SEQUENCE;
+		s->access_offset = offset;
+	}
+	else if (code == RMIDX_START_GOP) {
+		if (!(s->pending_flags & RMIDX_FLAG_SEQUENCE)) {
+			s->access_offset = offset;
+		}
+		s->pending_flags |= RMIDX_FLAG_GOP;
+	}
+	else if (code == RMIDX_START_PICTURE) {
+		if (index->picture_count == index->picture_capacity) {
+			index->picture_capacity = index->picture_capacity ? index->picture_capacity * 2 : 256;
+			index->pictures = (rmidx_picture_t *)realloc(
+				index->pictures, index->picture_capacity * sizeof(rmidx_picture_t)
+			);
+		}
+		rmidx_picture_t *p = &index->pictures[index->picture_count++];
+		memset(p, 0, sizeof(rmidx_picture_t));
+		p->offset = (s->pending_flags & RMIDX_FLAG_GOP) ? s->access_offset : offset;
+		p->flags = (uint8_t)s->pending_flags;
+		p->pts = s->pts;
+		s->pts = RMIDX_NO_PTS;
+		s->pending_flags = 0;
+	}
+}
+
+static void rmidx_scanner_feed(rmidx_scanner_t *s, uint8_t b, uint32_t offset) {
+	s->window = (s->window << 8) | b;
+	s->offsets[0] = s->offsets[1];
+	s->offsets[1] = s->offsets[2];
+	s->offsets[2] = s->offsets[3];
+	s->offsets[3] = offset;
+
+	if ((s->window & 0xFFFFFF00) == 0x00000100) {
+		rmidx_scanner_start_code(s, b, s->offsets[0]);
+	}
+}
+
+static void rmidx_scan_es(rmidx_scanner_t *s, rmidx_reader_t *r, uint32_t end) {
+	int b;
+	uint32_t offset = rmidx_reader_tell(r);
+	while (offset < end && (b = rmidx_reader_byte(r)) != -1) {
+		rmidx_scanner_feed(s, (uint8_t)b, offset++);
+	}
+}
+
+static void rmidx_scan_ps(rmidx_scanner_t *s, rmidx_reader_t *r, uint32_t end) {
+	// Walks the packs; only the payload of the first video stream (0xE0) is
+	// fed to the scanner, the same stream the player decodes. Anything before
+	// the first pack header is skipped, in case we start in the middle of one.
+	uint32_t pack_offset = 0;
+	int in_pack = 0;
+	int code;
+	while (rmidx_reader_tell(r) < end && (code = rmidx_reader_next_start_code(r)) != -1) {
+		if (code == 0xBA) {
+			pack_offset = rmidx_reader_tell(r) - 4;
+			in_pack = 1;
+			rmidx_reader_skip(r, 8);
+			continue;
+		}
+		if (code < 0xBB || !in_pack) {
+			continue;
+		}
+
+		int hi = rmidx_reader_byte(r);
+		int lo = rmidx_reader_byte(r);
+		if (lo == -1) {
+			break;
+		}
+		uint32_t length = ((uint32_t)hi << 8) | (uint32_t)lo;
+		if (code != 0xE0) {
+			rmidx_reader_skip(r, length);
+			continue;
+		}
+
+		// MPEG-1 packet header: stuffing, STD buffer size, PTS/DTS
+		s->pts = RMIDX_NO_PTS;
+		int b = rmidx_reader_byte(r);
+		length--;
+		while (b == 0xFF && length > 0) {
+			b = rmidx_reader_byte(r);
+			length--;
+		}
+		if ((b & 0xC0) == 0x40 && length >= 2) {
+			rmidx_reader_skip(r, 1);
+			b = rmidx_reader_byte(r);
+			length -= 2;
+		}
+		if ((b & 0xE0) == 0x20 && length >= 4) {
+			uint64_t pts = (uint64_t)((b >> 1) & 0x07) << 30;
+			int p1 = rmidx_reader_byte(r), p2 = rmidx_reader_byte(r);
+			int p3 = rmidx_reader_byte(r), p4 = rmidx_reader_byte(r);
+			length -= 4;
+			pts |= (uint64_t)((p1 << 7) | (p2 >> 1)) << 15;
+			pts |= (uint64_t)((p3 << 7) | (p4 >> 1));
+			s->pts = pts;
+			if ((b & 0xF0) == 0x30 && length >= 5) {
+				rmidx_reader_skip(r, 5); // DTS
+				length -= 5;
+			}
+		}
+
+		while (length-- > 0) {
+			b = rmidx_reader_byte(r);
+			if (b == -1) {
+				return;
+			}
+			rmidx_scanner_feed(s, (uint8_t)b, pack_offset);
+		}
+	}
+}
+
+static void rmidx_scan(rmidx_t *self, rmidx_read_callback read, void *user, uint32_t start, uint32_t end) {
+	rmidx_reader_t r;
+	memset(&r, 0, sizeof(r));
+	r.read = read;
+	r.user = user;
+	r.file_size = self->file_size;
+	r.chunk = (uint8_t *)malloc(RMIDX_READ_CHUNK);
+	rmidx_reader_seek(&r, start);
+
+	rmidx_scanner_t s;
+	memset(&s, 0, sizeof(s));
+	s.index = self;
+	s.window = 0xFFFFFFFF;
+	s.pts = RMIDX_NO_PTS;
+
+	if (self->layout == 0) {
+		// The first start code tells the layout, like the player's detection
+		int code = rmidx_reader_next_start_code(&r);
+		rmidx_reader_seek(&r, rmidx_reader_tell(&r) - 4);
+		if (code == 0xBA) {
+			self->layout = RMIDX_LAYOUT_PS;
+		}
+		else if (code == RMIDX_START_SEQUENCE) {
+			self->layout = RMIDX_LAYOUT_ES;
+		}
+	}
+	if (self->layout == RMIDX_LAYOUT_PS) {
+		rmidx_scan_ps(&s, &r, end);
+	}
+	else if (self->layout == RMIDX_LAYOUT_ES) {
+		rmidx_scan_es(&s, &r, end);
+	}
+	free(r.chunk);
+}
+
+int rmidx_build(rmidx_t *self, rmidx_read_callback read, void *user, uint32_t file_size, uint64_t hash) {
+	memset(self, 0, sizeof(rmidx_t));
+	self->file_size = file_size;
+	self->hash = hash;
+	rmidx_scan(self, read, user, 0, file_size);
+	return self->layout != 0 && self->picture_count > 0;
+}
+
+int rmidx_build_range(rmidx_t *self, rmidx_read_callback read, void *user, uint32_t file_size, int layout, uint32_t start, uint32_t end) {
+	memset(self, 0, sizeof(rmidx_t));
+	self->file_size = file_size;
+	self->layout = (uint8_t)layout;
+	rmidx_scan(self, read, user, start, (end < file_size) ? end : file_size);
+	return self->picture_count > 0;
+}
+
+static void rmidx_put32(uint8_t *p, uint32_t v) {
+	p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t rmidx_get32(const uint8_t *p) {
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+int rmidx_load(rmidx_t *self, const char *path, uint32_t file_size, uint64_t hash) {
+	memset(self, 0, sizeof(rmidx_t));
+	FILE *fh = fopen(path, "rb");
+	if (!fh) {
+		return 0;
+	}
+
+	uint8_t h[RMIDX_HEADER_SIZE];
+	uint32_t count = 0;
+	if (
+		fread(h, 1, sizeof(h), fh) == sizeof(h) &&
+		memcmp(h, "RMIX", 4) == 0 &&
+		rmidx_get32(h + 4) == RMIDX_VERSION &&
+		rmidx_get32(h + 8) == file_size &&
+		rmidx_get32(h + 12) == (uint32_t)hash &&
+		rmidx_get32(h + 16) == (uint32_t)(hash >> 32)
+	) {
+		count = rmidx_get32(h + 24);
+	}
+	if (count == 0 || count > file_size / 4) {
+		fclose(fh);
+		return 0;
+	}
+
+	self->file_size = file_size;
+	self->hash = hash;
+	self->layout = h[20];
+	self->pictures = (rmidx_picture_t *)malloc(count * sizeof(rmidx_picture_t));
+	self->picture_capacity = count;
+
+	uint8_t e[RMIDX_PICTURE_SIZE];
+	for (uint32_t i = 0; i < count; i++) {
+		if (fread(e, 1, sizeof(e), fh) != sizeof(e)) {
+			fclose(fh);
+			rmidx_free(self);
+			return 0;
+		}
+		rmidx_picture_t *p = &self->pictures[i];
+		p->offset = rmidx_get32(e);
+		p->pts = rmidx_get32(e + 4) | ((uint64_t)rmidx_get32(e + 8) << 32);
+		p->flags = e[12];
+	}
+	self->picture_count = count;
+	fclose(fh);
+	return 1;
+}
+
+int rmidx_save(const rmidx_t *self, const char *path) {
+	FILE *fh = fopen(path, "wb");
+	if (!fh) {
+		return 0;
+	}
+
+	uint8_t h[RMIDX_HEADER_SIZE];
+	memset(h, 0, sizeof(h));
+	memcpy(h, "RMIX", 4);
+	rmidx_put32(h + 4, RMIDX_VERSION);
+	rmidx_put32(h + 8, self->file_size);
+	rmidx_put32(h + 12, (uint32_t)self->hash);
+	rmidx_put32(h + 16, (uint32_t)(self->hash >> 32));
+	h[20] = self->layout;
+	rmidx_put32(h + 24, self->picture_count);
+	int ok = fwrite(h, 1, sizeof(h), fh) == sizeof(h);
+
+	uint8_t e[RMIDX_PICTURE_SIZE];
+	for (uint32_t i = 0; ok && i < self->picture_count; i++) {
+		const rmidx_picture_t *p = &self->pictures[i];
+		memset(e, 0, sizeof(e));
+		rmidx_put32(e, p->offset);
+		rmidx_put32(e + 4, (uint32_t)p->pts);
+		rmidx_put32(e + 8, (uint32_t)(p->pts >> 32));
+		e[12] = p->flags;
+		ok = fwrite(e, 1, sizeof(e), fh) == sizeof(e);
+	}
+
+	if (fclose(fh) != 0) {
+		ok = 0;
+	}
+	if (!ok) {
+		remove(path);
+	}
+	return ok;
+}
+
+void rmidx_free(rmidx_t *self) {
+	free(self->pictures);
+	self->pictures = NULL;
+	self->picture_count = 0;
+	self->picture_capacity = 0;
+}
+
+void rmidx_make_path(char *dest, size_t dest_len, const char *dir, uint32_t file_size, uint64_t hash) {
+	size_t dir_len = strlen(dir);
+	const char *separator = "";
+	if (dir_len > 0 && dir[dir_len - 1] != '/' && dir[dir_len - 1] != '\\') {
+#ifdef _WIN32
+		separator = "\\";
+#else
+		separator = "/";
+#endif
+	}
+	snprintf(
+		dest, dest_len, "%s%s%08x-%08x%08x.rmidx", dir, separator, (unsigned)file_size,
+		(unsigned)(hash >> 32), (unsigned)hash
+	);
+}
+
+const rmidx_picture_t *rmidx_find_gop(const rmidx_t *self, uint32_t offset) {
+	// Offsets only ever grow, so binary search for the last picture starting
+	// at or before offset and walk back to its GOP
+	uint32_t lo = 0, hi = self->picture_count;
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (self->pictures[mid].offset <= offset) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+	while (lo > 0) {
+		const rmidx_picture_t *p = &self->pictures[--lo];
+		if (p->flags & RMIDX_FLAG_GOP) {
+			return p;
+		}
+	}
+	return NULL;
+}
+
+#endif // REELMAGIC_INDEX_IMPLEMENTATION
@@ -238,22 +238,37 @@ typedef void(*plm_video_decode_callback)
 typedef void(*plm_video_decode_picture_header_callback)
 	(plm_video_t *self, void *user);
 
+// Callback function for the video decoder to run count independent jobs,
+// possibly in parallel. It must call job(arg, index) once for each index in
+// 0..count-1 and only return once all of them have completed.
+
+typedef void(*plm_video_parallel_callback)
+	(void (*job)(void *arg, int index), void *arg, int count, void *user);
+
 // Decoded Audio Samples
 // Samples are stored as normalized (-1, 1) float either interleaved, or if
-// PLM_AUDIO_SEPARATE_CHANNELS is defined, in two separate arrays.
+// PLM_AUDIO_SEPARATE_CHANNELS is defined, in two separate arrays. If
+// PLM_AUDIO_S16_OUTPUT is defined, samples are stored as signed 16 bit
+// integers instead, saturated to the full range.
 // The `count` is always PLM_AUDIO_SAMPLES_PER_FRAME and just there for
 // convenience.
 
 #define PLM_AUDIO_SAMPLES_PER_FRAME 1152
 
+#ifdef PLM_AUDIO_S16_OUTPUT
+	typedef int16_t plm_audio_sample_t;
+#else
+	typedef float plm_audio_sample_t;
+#endif
+
 typedef struct {
 	double time;
 	unsigned int count;
 	#ifdef PLM_AUDIO_SEPARATE_CHANNELS
-		float left[PLM_AUDIO_SAMPLES_PER_FRAME];
-		float right[PLM_AUDIO_SAMPLES_PER_FRAME];
+		plm_audio_sample_t left[PLM_AUDIO_SAMPLES_PER_FRAME];
+		plm_audio_sample_t right[PLM_AUDIO_SAMPLES_PER_FRAME];
 	#else
-		float interleaved[PLM_AUDIO_SAMPLES_PER_FRAME * 2];
+		plm_audio_sample_t interleaved[PLM_AUDIO_SAMPLES_PER_FRAME * 2];
 	#endif
 } plm_samples_t;
 
@@ -306,6 +321,14 @@ plm_t *plm_create_with_memory(uint8_t *bytes, size_t length, int free_when_done)
 plm_t *plm_create_with_buffer(plm_buffer_t *buffer, int destroy_when_done);
 
 
+// Create a plmpeg instance for an MPEG-1 video elementary stream. Unlike
+// plm_create_with_buffer(), the buffer is not searched for MPEG-PS headers
+// first, which takes a pass over the whole file for an elementary stream.
+// Audio is disabled.
+
+plm_t *plm_create_with_video_buffer(plm_buffer_t *buffer, int destroy_when_done);
+
+
 // Destroy a plmpeg instance and free all data.
 
 void plm_destroy(plm_t *self);
@@ -731,12 +754,35 @@ plm_frame_t *plm_video_decode(plm_video_t *self);
 void plm_video_set_decode_picture_header_callback(plm_video_t *self, plm_video_decode_picture_header_callback fp, void *user);
 
 
+// Set a callback used to decode the slices of each picture in parallel. The
+// decoded frames are identical to those of sequential decoding; pictures for
+// which this can't be guaranteed are decoded sequentially. Pass NULL to
+// decode all slices sequentially (the default).
+
+void plm_video_set_parallel_callback(plm_video_t *self, plm_video_parallel_callback fp, void *user);
+
+
+// Set whether the slices of B pictures are skipped instead of decoded. No
+// other picture depends on a B picture, so this can be used to quickly decode
+// up to a given picture when its content isn't displayed, e.g. after seeking.
+// The frames returned for skipped B pictures hold stale image data.
+
+void plm_video_set_skip_b_pictures(plm_video_t *self, int skip);
+
+
+// Get whether the frame last returned by plm_video_decode() is a B picture
+// whose slices were skipped, i.e. one that holds stale image data.
+
+int plm_video_get_frame_skipped(plm_video_t *self);
+
+
 // Convert the YCrCb data of a frame into interleaved R G B data. The stride
 // specifies the width in bytes of the destination buffer. I.e. the number of
 // bytes from one line to the next. The stride must be at least 
 // (frame->width * bytes_per_pixel). The buffer pointed to by *dest must have a
 // size of at least (stride * frame->height).
 // Note that the alpha component of the dest buffer is always left untouched.
+// plm_frame_to_bgra() uses a SIMD kernel when available (see plm_simd_*).
 
 void plm_frame_to_rgb(plm_frame_t *frame, uint8_t *dest, int stride);
 void plm_frame_to_bgr(plm_frame_t *frame, uint8_t *dest, int stride);
@@ -746,6 +792,80 @@ void plm_frame_to_argb(plm_frame_t *frame, uint8_t *dest, int stride);
 void plm_frame_to_abgr(plm_frame_t *frame, uint8_t *dest, int stride);
 
 
+// Convert the pixels col_begin to col_end - 1 of one row of a frame to BGRA,
+// writing each pixel x to dest + x * 4. The columns are widened to whole
+// chroma samples, so the pixel before col_begin or at col_end may be written
+// as well. As with plm_frame_to_bgra(), the alpha bytes are left untouched.
+// This allows converting just the part of a picture that is actually shown.
+
+void plm_frame_row_to_bgra(plm_frame_t *frame, uint8_t *dest, int row, int col_begin, int col_end);
+
+
+// -----------------------------------------------------------------------------
+// plm_simd public API
+// Select the vectorized kernels used by the decoders. Unless set explicitly,
+// the best level supported by the host CPU is picked the first time a video
+// or audio decoder is created.
+
+#define PLM_SIMD_SCALAR 0
+#define PLM_SIMD_SSE2 1
+#define PLM_SIMD_AVX2 2
+#define PLM_SIMD_NEON 3
+
+
+// Get the best SIMD level supported by the host CPU.
+
+int plm_simd_get_supported(void);
+
+
+// Set the SIMD level to use. The level is clamped to what the host CPU
+// supports; PLM_SIMD_SCALAR forces the plain C kernels. On ARM any level
+// other than PLM_SIMD_SCALAR selects NEON. Kernels that fail their self
+// test against the C version are not used. Returns the level that is
+// actually in use.
+
+int plm_simd_set_level(int level);
+
+
+// Get the SIMD level currently in use.
+
+int plm_simd_get_level(void);
+
+
+
+// -----------------------------------------------------------------------------
+// plm_profile public API
+// Per-stage decode time accounting. This is only compiled in if PLM_PROFILE
+// is defined *before* including this library, in which case
+// PLM_PROFILE_CLOCK() must be defined as well and return a monotonic uint64_t
+// tick count. Time spent in a nested stage (e.g. demuxing while the video
+// decoder fetches more data) is only counted for the innermost stage. The
+// counters are global and not thread safe; only profile single threaded
+// decoding (no parallel callback).
+
+#define PLM_PROFILE_DEMUX 0    // plm_demux_decode()
+#define PLM_PROFILE_VLC 1      // video headers, macroblock and coefficient parsing
+#define PLM_PROFILE_IDCT 2     // inverse DCT and adding the result to the picture
+#define PLM_PROFILE_MC 3       // motion compensation
+#define PLM_PROFILE_CONVERT 4  // plm_frame_to_bgra() and plm_frame_row_to_bgra()
+#define PLM_PROFILE_MP2 5      // plm_audio_decode()
+#define PLM_PROFILE_STAGES 6
+
+#ifdef PLM_PROFILE
+
+// Get the ticks accumulated for each stage since the last reset.
+
+void plm_profile_get_ticks(uint64_t ticks[PLM_PROFILE_STAGES]);
+
+
+// Reset all stage counters to zero.
+
+void plm_profile_reset(void);
+
+#endif
+
+
+
 // -----------------------------------------------------------------------------
 // plm_audio public API
 // Decode MPEG-1 Audio Layer II ("mp2") data into raw samples
@@ -784,6 +904,11 @@ double plm_audio_get_time(plm_audio_t *self);
 void plm_audio_set_time(plm_audio_t *self, double time);
 
 
+// Set the gain applied to the decoded samples. Defaults to 1.0.
+
+void plm_audio_set_gain(plm_audio_t *self, float gain);
+
+
 // Rewind the internal buffer. See plm_buffer_rewind().
 
 void plm_audio_rewind(plm_audio_t *self);
@@ -829,6 +954,42 @@ plm_samples_t *plm_audio_decode(plm_audio_t *self);
 
 #define PLM_UNUSED(expr) (void)(expr)
 
+// Vectorized kernels are only built for x86. They are compiled with function
+// level target attributes, so no special compiler flags are required and the
+// kernel to use is picked at runtime (see plm_simd_set_level()).
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#if defined(_MSC_VER) && !defined(__clang__)
+		#define PLM_SIMD_X86
+		#define PLM_TARGET_SSE2
+		#define PLM_TARGET_AVX2
+		#include <intrin.h>
+		#include <immintrin.h>
+	#elif defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+		#define PLM_SIMD_X86
+		#define PLM_TARGET_SSE2 __attribute__((target("sse2")))
+		#define PLM_TARGET_AVX2 __attribute__((target("avx2")))
+		#include <immintrin.h>
+	#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	#define PLM_SIMD_ARM_NEON
+	#include <arm_neon.h>
+#endif
+
+static int plm_simd_level = -1;
+
+#ifdef PLM_PROFILE
+	#define PLM_PROFILE_ENTER(stage) plm_profile_enter(stage)
+	#define PLM_PROFILE_LEAVE() plm_profile_leave()
+	static void plm_profile_enter(int stage);
+	static void plm_profile_leave(void);
+#else
+	#define PLM_PROFILE_ENTER(stage)
+	#define PLM_PROFILE_LEAVE()
+#endif
+
 
 // -----------------------------------------------------------------------------
 // plm (high-level interface) implementation
@@ -864,6 +1025,7 @@ void plm_handle_end(plm_t *self);
 void plm_read_video_packet(plm_buffer_t *buffer, void *user);
 void plm_read_audio_packet(plm_buffer_t *buffer, void *user);
 void plm_read_packets(plm_t *self, int requested_type);
+plm_demux_t *plm_demux_create_without_headers(plm_buffer_t *buffer, int destroy_when_done);
 
 plm_t *plm_create_with_filename(const char *filename) {
 	plm_buffer_t *buffer = plm_buffer_create_with_filename(filename);
@@ -895,6 +1057,20 @@ plm_t *plm_create_with_buffer(plm_buffer_t *buffer, int destroy_when_done) {
 	return self;
 }
 
+plm_t *plm_create_with_video_buffer(plm_buffer_t *buffer, int destroy_when_done) {
+	plm_t *self = (plm_t *)malloc(sizeof(plm_t));
+	memset(self, 0, sizeof(plm_t));
+
+	self->demux = plm_demux_create_without_headers(buffer, destroy_when_done);
+	self->video_enabled = TRUE;
+	self->audio_enabled = FALSE;
+	self->has_decoders = TRUE;
+	self->video_packet_type = PLM_DEMUX_PACKET_VIDEO_1;
+	self->video_decoder = plm_video_create_with_buffer(buffer, FALSE);
+
+	return self;
+}
+
 int plm_init_decoders(plm_t *self) {
 	if (self->has_decoders) {
 		return TRUE;
@@ -1334,6 +1510,12 @@ enum plm_buffer_mode {
 	PLM_BUFFER_MODE_APPEND
 };
 
+// Buffers that allocate their own memory keep this many bytes past their
+// capacity, so the bit reader can always load a whole 64-bit word at any byte
+// index below length. The padding never holds stream data.
+
+#define PLM_BUFFER_PADDING 8
+
 typedef struct plm_buffer_t {
 	size_t bit_index;
 	size_t capacity;
@@ -1362,10 +1544,26 @@ typedef struct {
 	uint16_t value;
 } plm_vlc_uint_t;
 
+// A flat lookup table indexed by the next `bits` bits of the stream. Codes of
+// up to `bits` length resolve in one lookup; longer codes continue walking the
+// tree at the node stored in the entry.
+
+typedef struct {
+	int16_t value;  // decoded value, or the tree node to continue at
+	int16_t length; // code length, or 0 if the code is longer than bits
+} plm_vlc_lut_entry_t;
+
+typedef struct {
+	const plm_vlc_t *tree;
+	int bits;
+	plm_vlc_lut_entry_t *entries;
+} plm_vlc_lut_t;
+
 
 void plm_buffer_seek(plm_buffer_t *self, size_t pos);
 size_t plm_buffer_tell(plm_buffer_t *self);
 void plm_buffer_discard_read_bytes(plm_buffer_t *self);
+void plm_buffer_make_room(plm_buffer_t *self, size_t length);
 void plm_buffer_load_file_callback(plm_buffer_t *self, void *user);
 
 int plm_buffer_has(plm_buffer_t *self, size_t count);
@@ -1378,6 +1576,9 @@ int plm_buffer_find_start_code(plm_buffer_t *self, int code);
 int plm_buffer_no_start_code(plm_buffer_t *self);
 int16_t plm_buffer_read_vlc(plm_buffer_t *self, const plm_vlc_t *table);
 uint16_t plm_buffer_read_vlc_uint(plm_buffer_t *self, const plm_vlc_uint_t *table);
+void plm_vlc_lut_init(plm_vlc_lut_t *lut);
+int16_t plm_buffer_read_vlc_lut(plm_buffer_t *self, const plm_vlc_lut_t *lut);
+uint16_t plm_buffer_read_vlc_lut_uint(plm_buffer_t *self, const plm_vlc_lut_t *lut);
 
 plm_buffer_t *plm_buffer_create_with_filename(const char *filename) {
 	FILE *fh = fopen(filename, "rb");
@@ -1430,7 +1631,7 @@ plm_buffer_t *plm_buffer_create_with_capacity(size_t capacity) {
 	memset(self, 0, sizeof(plm_buffer_t));
 	self->capacity = capacity;
 	self->free_when_done = TRUE;
-	self->bytes = (uint8_t *)malloc(capacity);
+	self->bytes = (uint8_t *)malloc(capacity + PLM_BUFFER_PADDING);
 	self->mode = PLM_BUFFER_MODE_RING;
 	self->discard_read_bytes = TRUE;
 	return self;
@@ -1469,11 +1670,11 @@ size_t plm_buffer_write(plm_buffer_t *self, uint8_t *bytes, size_t length) {
 	}
 
 	if (self->discard_read_bytes) {
-		// This should be a ring buffer, but instead it just shifts all unread 
-		// data to the beginning of the buffer and appends new data at the end. 
-		// Seems to be good enough.
+		// This should be a ring buffer, but instead it shifts all unread data
+		// to the beginning of the buffer once the new data no longer fits
+		// behind it. Seems to be good enough.
 
-		plm_buffer_discard_read_bytes(self);
+		plm_buffer_make_room(self, length);
 		if (self->mode == PLM_BUFFER_MODE_RING) {
 			self->total_size = 0;
 		}
@@ -1486,7 +1687,7 @@ size_t plm_buffer_write(plm_buffer_t *self, uint8_t *bytes, size_t length) {
 		do {
 			new_size *= 2;
 		} while (new_size - self->length < length);
-		self->bytes = (uint8_t *)realloc(self->bytes, new_size);
+		self->bytes = (uint8_t *)realloc(self->bytes, new_size + PLM_BUFFER_PADDING);
 		self->capacity = new_size;
 	}
 
@@ -1555,6 +1756,16 @@ void plm_buffer_discard_read_bytes(plm_buffer_t *self) {
 	self->file_pos += byte_pos;
 }
 
+// Discard the bytes already read, but only when that is needed to fit length
+// more bytes. Compacting lazily moves the unread data once per buffer's worth
+// of input instead of on every load.
+
+void plm_buffer_make_room(plm_buffer_t *self, size_t length) {
+	if (self->discard_read_bytes && self->capacity - self->length < length) {
+		plm_buffer_discard_read_bytes(self);
+	}
+}
+
 void plm_buffer_load_file_callback(plm_buffer_t *self, void *user) {
 	PLM_UNUSED(user);
 	
@@ -1594,7 +1805,45 @@ int plm_buffer_has(plm_buffer_t *self, size_t count) {
 	return FALSE;
 }
 
+// Whether a 64-bit word can be loaded at the current byte. Memory handed to
+// plm_buffer_create_with_memory() has no padding, so its last 7 bytes are read
+// through the byte-wise path.
+
+static inline int plm_buffer_can_load_word(plm_buffer_t *self) {
+	return
+		self->mode != PLM_BUFFER_MODE_FIXED_MEM ||
+		(self->bit_index >> 3) + 8 <= self->length;
+}
+
+// The next 64 bits starting at bit_index, MSB first. Only the first
+// 64 - (bit_index & 7) bits are valid.
+
+static inline uint64_t plm_buffer_peek_word(plm_buffer_t *self) {
+	const uint8_t *p = self->bytes + (self->bit_index >> 3);
+	uint64_t word =
+		((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) |
+		((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32) |
+		((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) |
+		((uint64_t)p[6] <<  8) | ((uint64_t)p[7]);
+	return word << (self->bit_index & 7);
+}
+
 int plm_buffer_read(plm_buffer_t *self, int count) {
+	if (count == 0) {
+		return 0;
+	}
+
+	// Fast path: the bits are already buffered, so neither the load callback
+	// nor the end of stream handling in plm_buffer_has() come into play
+	if (
+		((self->length << 3) - self->bit_index) >= (size_t)count &&
+		plm_buffer_can_load_word(self)
+	) {
+		int value = (int)(plm_buffer_peek_word(self) >> (64 - count));
+		self->bit_index += count;
+		return value;
+	}
+
 	if (!plm_buffer_has(self, count)) {
 		return 0;
 	}
@@ -1667,6 +1916,12 @@ int plm_buffer_find_start_code(plm_buffer_t *self, int code) {
 }
 
 int plm_buffer_has_start_code(plm_buffer_t *self, int code) {
+	// The scan can't discard anything as it rewinds afterwards, so free up
+	// all the room there is first
+	if (self->discard_read_bytes) {
+		plm_buffer_discard_read_bytes(self);
+	}
+
 	size_t previous_bit_index = self->bit_index;
 	int previous_discard_read_bytes = self->discard_read_bytes;
 	
@@ -1690,6 +1945,24 @@ int plm_buffer_peek_non_zero(plm_buffer_t *self, int bit_count) {
 
 int16_t plm_buffer_read_vlc(plm_buffer_t *self, const plm_vlc_t *table) {
 	plm_vlc_t state = {0, 0};
+
+	// No code in the VLC tables is longer than 17 bits, so with 32 bits
+	// buffered the whole code can be walked from one word
+	if (
+		((self->length << 3) - self->bit_index) >= 32 &&
+		plm_buffer_can_load_word(self)
+	) {
+		uint64_t word = plm_buffer_peek_word(self);
+		size_t bit_index = self->bit_index;
+		do {
+			state = table[state.index + (int)(word >> 63)];
+			word <<= 1;
+			bit_index++;
+		} while (state.index > 0);
+		self->bit_index = bit_index;
+		return state.value;
+	}
+
 	do {
 		state = table[state.index + plm_buffer_read(self, 1)];
 	} while (state.index > 0);
@@ -1700,6 +1973,62 @@ uint16_t plm_buffer_read_vlc_uint(plm_buffer_t *self, const plm_vlc_uint_t *tabl
 	return (uint16_t)plm_buffer_read_vlc(self, (const plm_vlc_t *)table);
 }
 
+void plm_vlc_lut_init(plm_vlc_lut_t *lut) {
+	for (int code = 0; code < (1 << lut->bits); code++) {
+		plm_vlc_t state = {0, 0};
+		int length = 0;
+		do {
+			int bit = (code >> (lut->bits - 1 - length)) & 1;
+			state = lut->tree[state.index + bit];
+			length++;
+		} while (state.index > 0 && length < lut->bits);
+
+		plm_vlc_lut_entry_t *entry = &lut->entries[code];
+		if (state.index > 0) {
+			entry->value = state.index;
+			entry->length = 0;
+		}
+		else {
+			entry->value = state.value;
+			entry->length = length;
+		}
+	}
+}
+
+int16_t plm_buffer_read_vlc_lut(plm_buffer_t *self, const plm_vlc_lut_t *lut) {
+	// Same condition as in plm_buffer_read_vlc(); near the end of the data
+	// the tree is walked bit by bit
+	if (
+		((self->length << 3) - self->bit_index) < 32 ||
+		!plm_buffer_can_load_word(self)
+	) {
+		return plm_buffer_read_vlc(self, lut->tree);
+	}
+
+	uint64_t word = plm_buffer_peek_word(self);
+	plm_vlc_lut_entry_t entry = lut->entries[word >> (64 - lut->bits)];
+	if (entry.length) {
+		self->bit_index += entry.length;
+		return entry.value;
+	}
+
+	// Long code; walk the rest of the tree
+	plm_vlc_t state = {entry.value, 0};
+	size_t bit_index = self->bit_index + lut->bits;
+	word <<= lut->bits;
+	do {
+		state = lut->tree[state.index + (int)(word >> 63)];
+		word <<= 1;
+		bit_index++;
+	} while (state.index > 0);
+	self->bit_index = bit_index;
+	return state.value;
+}
+
+uint16_t plm_buffer_read_vlc_lut_uint(plm_buffer_t *self, const plm_vlc_lut_t *lut) {
+	return (uint16_t)plm_buffer_read_vlc_lut(self, lut);
+}
+
 
 
 // ----------------------------------------------------------------------------
@@ -1736,8 +2065,15 @@ void plm_demux_buffer_seek(plm_demux_t *self, size_t pos);
 double plm_demux_decode_time(plm_demux_t *self);
 plm_packet_t *plm_demux_decode_packet(plm_demux_t *self, int type);
 plm_packet_t *plm_demux_get_packet(plm_demux_t *self);
+static plm_packet_t *plm_demux_decode_next(plm_demux_t *self);
 
 plm_demux_t *plm_demux_create(plm_buffer_t *buffer, int destroy_when_done) {
+	plm_demux_t *self = plm_demux_create_without_headers(buffer, destroy_when_done);
+	plm_demux_has_headers(self);
+	return self;
+}
+
+plm_demux_t *plm_demux_create_without_headers(plm_buffer_t *buffer, int destroy_when_done) {
 	plm_demux_t *self = (plm_demux_t *)malloc(sizeof(plm_demux_t));
 	memset(self, 0, sizeof(plm_demux_t));
 
@@ -1747,8 +2083,6 @@ plm_demux_t *plm_demux_create(plm_buffer_t *buffer, int destroy_when_done) {
 	self->start_time = PLM_PACKET_INVALID_TS;
 	self->duration = PLM_PACKET_INVALID_TS;
 	self->start_code = -1;
-
-	plm_demux_has_headers(self);
 	return self;
 }
 
@@ -2063,6 +2397,13 @@ plm_packet_t *plm_demux_seek(plm_demux_t *self, double seek_time, int type, int
 }
 
 plm_packet_t *plm_demux_decode(plm_demux_t *self) {
+	PLM_PROFILE_ENTER(PLM_PROFILE_DEMUX);
+	plm_packet_t *packet = plm_demux_decode_next(self);
+	PLM_PROFILE_LEAVE();
+	return packet;
+}
+
+static plm_packet_t *plm_demux_decode_next(plm_demux_t *self) {
 	if (!plm_demux_has_headers(self)) {
 		return NULL;
 	}
@@ -2321,13 +2662,6 @@ static const plm_vlc_t PLM_VIDEO_MACROBLOCK_TYPE_B[] = {
 	{       0, 0x16}, {       0, 0x1a},  //  10: 0000 1x
 };
 
-static const plm_vlc_t *PLM_VIDEO_MACROBLOCK_TYPE[] = {
-	NULL,
-	PLM_VIDEO_MACROBLOCK_TYPE_INTRA,
-	PLM_VIDEO_MACROBLOCK_TYPE_PREDICTIVE,
-	PLM_VIDEO_MACROBLOCK_TYPE_B
-};
-
 static const plm_vlc_t PLM_VIDEO_CODE_BLOCK_PATTERN[] = {
 	{  1 << 1,    0}, {  2 << 1,    0},  //   0: x
 	{  3 << 1,    0}, {  4 << 1,    0},  //   1: 0x
@@ -2455,12 +2789,6 @@ static const plm_vlc_t PLM_VIDEO_DCT_SIZE_CHROMINANCE[] = {
 	{       0,    8}, {      -1,    0},  //   8: 1111 111x
 };
 
-static const plm_vlc_t *PLM_VIDEO_DCT_SIZE[] = {
-	PLM_VIDEO_DCT_SIZE_LUMINANCE,
-	PLM_VIDEO_DCT_SIZE_CHROMINANCE,
-	PLM_VIDEO_DCT_SIZE_CHROMINANCE
-};
-
 
 //  dct_coeff bitmap:
 //    0xff00  run
@@ -2583,6 +2911,58 @@ static const plm_vlc_uint_t PLM_VIDEO_DCT_COEFF[] = {
 	{       0,   0x1c01}, {       0,   0x1b01},  // 111: 0000 0000 0001 111x
 };
 
+// Lookup tables for the VLC trees above, filled in once by
+// plm_video_init_vlc_luts(). The bit counts cover all codes of the short trees
+// and the common codes of the long ones.
+
+#define PLM_VIDEO_VLC_LUT(NAME, TREE, BITS) \
+	static plm_vlc_lut_entry_t NAME##_ENTRIES[1 << (BITS)]; \
+	static plm_vlc_lut_t NAME = {(const plm_vlc_t *)(TREE), (BITS), NAME##_ENTRIES}
+
+PLM_VIDEO_VLC_LUT(PLM_VIDEO_MACROBLOCK_ADDRESS_INCREMENT_LUT, PLM_VIDEO_MACROBLOCK_ADDRESS_INCREMENT, 8);
+PLM_VIDEO_VLC_LUT(PLM_VIDEO_MACROBLOCK_TYPE_INTRA_LUT, PLM_VIDEO_MACROBLOCK_TYPE_INTRA, 2);
+PLM_VIDEO_VLC_LUT(PLM_VIDEO_MACROBLOCK_TYPE_PREDICTIVE_LUT, PLM_VIDEO_MACROBLOCK_TYPE_PREDICTIVE, 6);
+PLM_VIDEO_VLC_LUT(PLM_VIDEO_MACROBLOCK_TYPE_B_LUT, PLM_VIDEO_MACROBLOCK_TYPE_B, 6);
+PLM_VIDEO_VLC_LUT(PLM_VIDEO_CODE_BLOCK_PATTERN_LUT, PLM_VIDEO_CODE_BLOCK_PATTERN, 9);
+PLM_VIDEO_VLC_LUT(PLM_VIDEO_MOTION_LUT, PLM_VIDEO_MOTION, 8);
+PLM_VIDEO_VLC_LUT(PLM_VIDEO_DCT_SIZE_LUMINANCE_LUT, PLM_VIDEO_DCT_SIZE_LUMINANCE, 7);
+PLM_VIDEO_VLC_LUT(PLM_VIDEO_DCT_SIZE_CHROMINANCE_LUT, PLM_VIDEO_DCT_SIZE_CHROMINANCE, 8);
+PLM_VIDEO_VLC_LUT(PLM_VIDEO_DCT_COEFF_LUT, PLM_VIDEO_DCT_COEFF, 10);
+
+static plm_vlc_lut_t *PLM_VIDEO_MACROBLOCK_TYPE[] = {
+	NULL,
+	&PLM_VIDEO_MACROBLOCK_TYPE_INTRA_LUT,
+	&PLM_VIDEO_MACROBLOCK_TYPE_PREDICTIVE_LUT,
+	&PLM_VIDEO_MACROBLOCK_TYPE_B_LUT
+};
+
+static plm_vlc_lut_t *PLM_VIDEO_DCT_SIZE[] = {
+	&PLM_VIDEO_DCT_SIZE_LUMINANCE_LUT,
+	&PLM_VIDEO_DCT_SIZE_CHROMINANCE_LUT,
+	&PLM_VIDEO_DCT_SIZE_CHROMINANCE_LUT
+};
+
+static plm_vlc_lut_t *PLM_VIDEO_VLC_LUTS[] = {
+	&PLM_VIDEO_MACROBLOCK_ADDRESS_INCREMENT_LUT,
+	&PLM_VIDEO_MACROBLOCK_TYPE_INTRA_LUT,
+	&PLM_VIDEO_MACROBLOCK_TYPE_PREDICTIVE_LUT,
+	&PLM_VIDEO_MACROBLOCK_TYPE_B_LUT,
+	&PLM_VIDEO_CODE_BLOCK_PATTERN_LUT,
+	&PLM_VIDEO_MOTION_LUT,
+	&PLM_VIDEO_DCT_SIZE_LUMINANCE_LUT,
+	&PLM_VIDEO_DCT_SIZE_CHROMINANCE_LUT,
+	&PLM_VIDEO_DCT_COEFF_LUT
+};
+
+static int plm_video_vlc_luts_ready = FALSE;
+
+static void plm_video_init_vlc_luts(void) {
+	for (size_t i = 0; i < sizeof(PLM_VIDEO_VLC_LUTS) / sizeof(PLM_VIDEO_VLC_LUTS[0]); i++) {
+		plm_vlc_lut_init(PLM_VIDEO_VLC_LUTS[i]);
+	}
+	plm_video_vlc_luts_ready = TRUE;
+}
+
 typedef struct {
 	int full_px;
 	int is_set;
@@ -2591,6 +2971,13 @@ typedef struct {
 	int v;
 } plm_video_motion_t;
 
+typedef struct plm_video_slice_job_t plm_video_slice_job_t;
+
+typedef struct {
+	int vertical_position;
+	size_t data_index; // byte index of the slice data, past the start code
+} plm_video_slice_t;
+
 typedef struct plm_video_t {
 	double framerate;
 	double time;
@@ -2621,6 +3008,7 @@ typedef struct plm_video_t {
 
 	int quantizer_scale;
 	int slice_begin;
+	int slice_first_address;
 	int macroblock_address;
 
 	int mb_row;
@@ -2646,11 +3034,37 @@ typedef struct plm_video_t {
 
 	int has_reference_frame;
 	int assume_no_b_frames;
+	int skip_b_pictures;
+	int picture_skipped;
+	int frame_skipped;
 
 	plm_video_decode_picture_header_callback decode_picture_header_callback;
 	void *decode_picture_header_callback_user_data;
+
+	plm_video_parallel_callback parallel_callback;
+	void *parallel_callback_user_data;
+	plm_video_slice_t *slices;
+	int slice_count;
+	int slices_capacity;
+	plm_video_slice_job_t *slice_jobs;
+	int slice_jobs_capacity;
+	uint8_t *slice_backup;
+	size_t slice_backup_size;
 } plm_video_t;
 
+// The slices decoded by one parallel job all share a vertical position and
+// are decoded in order into a private copy of the decoder and buffer state.
+
+struct plm_video_slice_job_t {
+	plm_video_t video;
+	plm_buffer_t buffer;
+	int first_slice;
+	int end_slice;
+	int first_address;
+	int last_address;
+	int conflict;
+};
+
 static inline uint8_t plm_clamp(int n) {
 	if (n > 255) {
 		n = 255;
@@ -2661,10 +3075,12 @@ static inline uint8_t plm_clamp(int n) {
 	return n;
 }
 
+static plm_frame_t *plm_video_decode_next(plm_video_t *self);
 int plm_video_decode_sequence_header(plm_video_t *self);
 void plm_video_init_frame(plm_video_t *self, plm_frame_t *frame, uint8_t *base);
 void plm_video_decode_picture(plm_video_t *self);
 void plm_video_decode_slice(plm_video_t *self, int slice);
+int plm_video_decode_slices_parallel(plm_video_t *self);
 void plm_video_decode_macroblock(plm_video_t *self);
 void plm_video_decode_motion_vectors(plm_video_t *self);
 int plm_video_decode_motion_vector(plm_video_t *self, int r_size, int motion);
@@ -2672,8 +3088,22 @@ void plm_video_predict_macroblock(plm_video_t *self);
 void plm_video_copy_macroblock(plm_video_t *self, plm_frame_t *s, int motion_h, int motion_v);
 void plm_video_interpolate_macroblock(plm_video_t *self, plm_frame_t *s, int motion_h, int motion_v);
 void plm_video_process_macroblock(plm_video_t *self, uint8_t *s, uint8_t *d, int mh, int mb, int bs, int interp);
+void plm_video_mc_scalar(uint8_t *d, const uint8_t *s, int dw, int block_size, int mode);
+#if defined(PLM_SIMD_X86)
+void plm_video_mc_sse2(uint8_t *d, const uint8_t *s, int dw, int block_size, int mode);
+#endif
+#if defined(PLM_SIMD_ARM_NEON)
+void plm_video_mc_neon(uint8_t *d, const uint8_t *s, int dw, int block_size, int mode);
+#endif
 void plm_video_decode_block(plm_video_t *self, int block);
 void plm_video_idct(int *block);
+#if defined(PLM_SIMD_X86)
+void plm_video_idct_sse2(int *block);
+void plm_video_idct_avx2(int *block);
+#endif
+
+static void (*plm_video_idct_kernel)(int *block) = plm_video_idct;
+static void (*plm_video_mc_kernel)(uint8_t *d, const uint8_t *s, int dw, int block_size, int mode) = plm_video_mc_scalar;
 
 plm_video_t * plm_video_create_with_buffer(plm_buffer_t *buffer, int destroy_when_done) {
 	plm_video_t *self = (plm_video_t *)malloc(sizeof(plm_video_t));
@@ -2682,6 +3112,13 @@ plm_video_t * plm_video_create_with_buffer(plm_buffer_t *buffer, int destroy_whe
 	self->buffer = buffer;
 	self->destroy_buffer_when_done = destroy_when_done;
 
+	if (plm_simd_level < 0) {
+		plm_simd_set_level(plm_simd_get_supported());
+	}
+	if (!plm_video_vlc_luts_ready) {
+		plm_video_init_vlc_luts();
+	}
+
 	// Attempt to decode the sequence header
 	self->start_code = plm_buffer_find_start_code(self->buffer, PLM_START_SEQUENCE);
 	if (self->start_code != -1) {
@@ -2699,6 +3136,9 @@ void plm_video_destroy(plm_video_t *self) {
 		free(self->frames_data);
 	}
 
+	free(self->slices);
+	free(self->slice_jobs);
+	free(self->slice_backup);
 	free(self);
 }
 
@@ -2746,6 +3186,13 @@ int plm_video_has_ended(plm_video_t *self) {
 }
 
 plm_frame_t *plm_video_decode(plm_video_t *self) {
+	PLM_PROFILE_ENTER(PLM_PROFILE_VLC);
+	plm_frame_t *frame = plm_video_decode_next(self);
+	PLM_PROFILE_LEAVE();
+	return frame;
+}
+
+static plm_frame_t *plm_video_decode_next(plm_video_t *self) {
 	if (!plm_video_has_header(self)) {
 		return NULL;
 	}
@@ -2786,7 +3233,11 @@ plm_frame_t *plm_video_decode(plm_video_t *self) {
 		) {
 			return NULL;
 		}
-		plm_buffer_discard_read_bytes(self->buffer);
+		if (self->buffer->discard_read_bytes) {
+			// Never shift memory handed to plm_buffer_create_with_memory();
+			// it may be a read-only mapping of the whole file
+			plm_buffer_discard_read_bytes(self->buffer);
+		}
 		
 		plm_video_decode_picture(self);
 
@@ -2805,6 +3256,7 @@ plm_frame_t *plm_video_decode(plm_video_t *self) {
 		}
 	} while (!frame);
 	
+	self->frame_skipped = (frame == &self->frame_current) && self->picture_skipped;
 	frame->time = self->time;
 	self->frames_decoded++;
 	self->time = (double)self->frames_decoded / self->framerate;
@@ -2817,6 +3269,19 @@ void plm_video_set_decode_picture_header_callback(plm_video_t *self, plm_video_d
 	self->decode_picture_header_callback_user_data = user;
 }
 
+void plm_video_set_parallel_callback(plm_video_t *self, plm_video_parallel_callback fp, void *user) {
+	self->parallel_callback = fp;
+	self->parallel_callback_user_data = user;
+}
+
+void plm_video_set_skip_b_pictures(plm_video_t *self, int skip) {
+	self->skip_b_pictures = skip;
+}
+
+int plm_video_get_frame_skipped(plm_video_t *self) {
+	return self->frame_skipped;
+}
+
 int plm_video_has_header(plm_video_t *self) {
 	if (self->has_sequence_header) {
 		return TRUE;
@@ -2930,6 +3395,7 @@ void plm_video_decode_picture(plm_video_t *self) {
 	plm_buffer_skip(self->buffer, 16); // skip vbv_delay
 	self->picture_extension_count = 0;
 	self->picture_user_data_count = 0;
+	self->picture_skipped = FALSE;
 
 	// D frames or unknown coding type
 	if (self->picture_type <= 0 || self->picture_type > PLM_VIDEO_PICTURE_TYPE_B) {
@@ -2988,9 +3454,25 @@ void plm_video_decode_picture(plm_video_t *self) {
 		(*self->decode_picture_header_callback)(self, self->decode_picture_header_callback_user_data);
 	}
 
-	// Decode all slices
+	// Nothing refers to a B picture, so its slices can be skipped altogether
+	self->picture_skipped = self->skip_b_pictures && self->picture_type == PLM_VIDEO_PICTURE_TYPE_B;
+	if (self->picture_skipped) {
+		while (PLM_START_IS_SLICE(self->start_code)) {
+			self->start_code = plm_buffer_next_start_code(self->buffer);
+		}
+		return;
+	}
+
+	// Decode all slices. If they were decoded in parallel, the state is that
+	// of having just decoded the last slice that was found.
+	int decoded_parallel = self->parallel_callback && plm_video_decode_slices_parallel(self);
 	while (PLM_START_IS_SLICE(self->start_code)) {
-		plm_video_decode_slice(self, self->start_code & 0x000000FF);
+		if (decoded_parallel) {
+			decoded_parallel = FALSE;
+		}
+		else {
+			plm_video_decode_slice(self, self->start_code & 0x000000FF);
+		}
 		if (self->macroblock_address >= self->mb_size - 2) {
 			break;
 		}
@@ -3033,19 +3515,170 @@ void plm_video_decode_slice(plm_video_t *self, int slice) {
 	);
 }
 
+static void plm_video_decode_slice_job(void *arg, int index) {
+	plm_video_t *self = (plm_video_t *)arg;
+	plm_video_slice_job_t *job = &self->slice_jobs[index];
+	plm_video_t *video = &job->video;
+
+	for (int i = job->first_slice; i < job->end_slice; i++) {
+		job->buffer.bit_index = self->slices[i].data_index << 3;
+		plm_video_decode_slice(video, self->slices[i].vertical_position);
+
+		// All macroblocks written by the slice are within this range
+		if (video->slice_first_address < job->first_address) {
+			job->first_address = video->slice_first_address;
+		}
+		if (video->macroblock_address > job->last_address) {
+			job->last_address = video->macroblock_address;
+		}
+
+		// Sequential decoding would stop the picture after this slice or
+		// search for the next start code past the one we found
+		if (
+			i + 1 < self->slice_count && (
+				video->macroblock_address >= self->mb_size - 2 ||
+				((job->buffer.bit_index + 7) >> 3) > self->slices[i + 1].data_index - 4
+			)
+		) {
+			job->conflict = TRUE;
+			return;
+		}
+	}
+}
+
+// Decode all slices of the current picture through the parallel callback.
+// MPEG-1 slices reset all prediction state, so once the slice start codes are
+// known they can be decoded independently. Returns FALSE if the slices still
+// have to be decoded sequentially: when there is nothing to gain, or when the
+// result could differ from sequential decoding (jobs writing overlapping
+// macroblocks, slices reading past the next start code or past the buffered
+// data, the picture ending early). In the latter case the current frame is
+// restored first.
+
+int plm_video_decode_slices_parallel(plm_video_t *self) {
+	plm_buffer_t *buffer = self->buffer;
+	if ((buffer->bit_index & 7) != 0) {
+		return FALSE;
+	}
+
+	// Find the slices; this scans the same way plm_buffer_next_start_code()
+	// does, without invoking the load callback
+	size_t index = buffer->bit_index >> 3;
+	int code = self->start_code;
+	self->slice_count = 0;
+	while (PLM_START_IS_SLICE(code)) {
+		if (self->slice_count == self->slices_capacity) {
+			self->slices_capacity = self->slices_capacity ? self->slices_capacity * 2 : 64;
+			self->slices = (plm_video_slice_t *)realloc(self->slices, self->slices_capacity * sizeof(plm_video_slice_t));
+		}
+		self->slices[self->slice_count].vertical_position = code & 0x000000FF;
+		self->slices[self->slice_count].data_index = index;
+		self->slice_count++;
+
+		code = -1;
+		while (buffer->length - index >= 5) {
+			if (
+				buffer->bytes[index] == 0x00 &&
+				buffer->bytes[index + 1] == 0x00 &&
+				buffer->bytes[index + 2] == 0x01
+			) {
+				code = buffer->bytes[index + 3];
+				index += 4;
+				break;
+			}
+			index++;
+		}
+	}
+
+	// One job per run of slices with the same vertical position
+	int job_count = 0;
+	for (int i = 0; i < self->slice_count; i++) {
+		if (i == 0 || self->slices[i].vertical_position != self->slices[i - 1].vertical_position) {
+			job_count++;
+		}
+	}
+	if (job_count < 2) {
+		return FALSE;
+	}
+	if (job_count > self->slice_jobs_capacity) {
+		free(self->slice_jobs);
+		self->slice_jobs_capacity = job_count;
+		self->slice_jobs = (plm_video_slice_job_t *)malloc(job_count * sizeof(plm_video_slice_job_t));
+	}
+
+	// Keep a copy of the current frame to undo a conflicting decode
+	size_t frame_size = self->luma_width * self->luma_height + 2 * self->chroma_width * self->chroma_height;
+	if (self->slice_backup_size < frame_size) {
+		free(self->slice_backup);
+		self->slice_backup = (uint8_t *)malloc(frame_size);
+		self->slice_backup_size = frame_size;
+	}
+	memcpy(self->slice_backup, self->frame_current.y.data, frame_size);
+
+	for (int i = 0, j = -1; i < self->slice_count; i++) {
+		if (j < 0 || self->slices[i].vertical_position != self->slices[i - 1].vertical_position) {
+			plm_video_slice_job_t *job = &self->slice_jobs[++j];
+			job->video = *self;
+			job->video.buffer = &job->buffer;
+			job->video.parallel_callback = NULL;
+			job->buffer = *buffer;
+			job->buffer.load_callback = NULL;
+			job->buffer.seek_callback = NULL;
+			if (!buffer->has_ended) {
+				// Running out of data marks the job's buffer as ended
+				job->buffer.total_size = buffer->length;
+			}
+			job->first_slice = i;
+			job->first_address = self->mb_size;
+			job->last_address = -1;
+			job->conflict = FALSE;
+		}
+		self->slice_jobs[j].end_slice = i + 1;
+	}
+
+	self->parallel_callback(plm_video_decode_slice_job, self, job_count, self->parallel_callback_user_data);
+
+	int conflict = FALSE;
+	for (int j = 0; j < job_count; j++) {
+		plm_video_slice_job_t *job = &self->slice_jobs[j];
+		if (job->conflict || (job->buffer.has_ended && !buffer->has_ended)) {
+			conflict = TRUE;
+		}
+		if (j + 1 < job_count && job->last_address >= self->slice_jobs[j + 1].first_address) {
+			conflict = TRUE;
+		}
+	}
+	if (conflict) {
+		memcpy(self->frame_current.y.data, self->slice_backup, frame_size);
+		return FALSE;
+	}
+
+	// Take over the state of the last job, as if we decoded sequentially
+	plm_video_slice_job_t *last = &self->slice_jobs[job_count - 1];
+	plm_video_parallel_callback parallel_callback = self->parallel_callback;
+	int slice_count = self->slice_count;
+	*self = last->video;
+	self->buffer = buffer;
+	self->parallel_callback = parallel_callback;
+	self->slice_count = slice_count;
+	self->start_code = self->slices[slice_count - 1].vertical_position;
+	buffer->bit_index = last->buffer.bit_index;
+	return TRUE;
+}
+
 void plm_video_decode_macroblock(plm_video_t *self) {
 	// Decode increment
 	int increment = 0;
-	int t = plm_buffer_read_vlc(self->buffer, PLM_VIDEO_MACROBLOCK_ADDRESS_INCREMENT);
+	int t = plm_buffer_read_vlc_lut(self->buffer, &PLM_VIDEO_MACROBLOCK_ADDRESS_INCREMENT_LUT);
 
 	while (t == 34) {
 		// macroblock_stuffing
-		t = plm_buffer_read_vlc(self->buffer, PLM_VIDEO_MACROBLOCK_ADDRESS_INCREMENT);
+		t = plm_buffer_read_vlc_lut(self->buffer, &PLM_VIDEO_MACROBLOCK_ADDRESS_INCREMENT_LUT);
 	}
 	while (t == 35) {
 		// macroblock_escape
 		increment += 33;
-		t = plm_buffer_read_vlc(self->buffer, PLM_VIDEO_MACROBLOCK_ADDRESS_INCREMENT);
+		t = plm_buffer_read_vlc_lut(self->buffer, &PLM_VIDEO_MACROBLOCK_ADDRESS_INCREMENT_LUT);
 	}
 	increment += t;
 
@@ -3055,6 +3688,7 @@ void plm_video_decode_macroblock(plm_video_t *self) {
 		// previous row, not the previous macroblock
 		self->slice_begin = FALSE;
 		self->macroblock_address += increment;
+		self->slice_first_address = self->macroblock_address;
 	}
 	else {
 		if (self->macroblock_address + increment >= self->mb_size) {
@@ -3088,13 +3722,13 @@ void plm_video_decode_macroblock(plm_video_t *self) {
 	self->mb_row = self->macroblock_address / self->mb_width;
 	self->mb_col = self->macroblock_address % self->mb_width;
 
-	if (self->mb_col >= self->mb_width || self->mb_row >= self->mb_height) {
+	if (self->macroblock_address < 0 || self->mb_col >= self->mb_width || self->mb_row >= self->mb_height) {
 		return; // corrupt stream;
 	}
 
 	// Process the current macroblock
-	const plm_vlc_t *table = PLM_VIDEO_MACROBLOCK_TYPE[self->picture_type];
-	self->macroblock_type = plm_buffer_read_vlc(self->buffer, table);
+	const plm_vlc_lut_t *table = PLM_VIDEO_MACROBLOCK_TYPE[self->picture_type];
+	self->macroblock_type = plm_buffer_read_vlc_lut(self->buffer, table);
 
 	self->macroblock_intra = (self->macroblock_type & 0x01);
 	self->motion_forward.is_set = (self->macroblock_type & 0x08);
@@ -3122,7 +3756,7 @@ void plm_video_decode_macroblock(plm_video_t *self) {
 
 	// Decode blocks
 	int cbp = ((self->macroblock_type & 0x02) != 0)
-		? plm_buffer_read_vlc(self->buffer, PLM_VIDEO_CODE_BLOCK_PATTERN)
+		? plm_buffer_read_vlc_lut(self->buffer, &PLM_VIDEO_CODE_BLOCK_PATTERN_LUT)
 		: (self->macroblock_intra ? 0x3f : 0);
 
 	for (int block = 0, mask = 0x20; block < 6; block++) {
@@ -3156,7 +3790,7 @@ void plm_video_decode_motion_vectors(plm_video_t *self) {
 
 int plm_video_decode_motion_vector(plm_video_t *self, int r_size, int motion) {
 	int fscale = 1 << r_size;
-	int m_code = plm_buffer_read_vlc(self->buffer, PLM_VIDEO_MOTION);
+	int m_code = plm_buffer_read_vlc_lut(self->buffer, &PLM_VIDEO_MOTION_LUT);
 	int r = 0;
 	int d;
 
@@ -3183,6 +3817,7 @@ int plm_video_decode_motion_vector(plm_video_t *self, int r_size, int motion) {
 }
 
 void plm_video_predict_macroblock(plm_video_t *self) {
+	PLM_PROFILE_ENTER(PLM_PROFILE_MC);
 	int fw_h = self->motion_forward.h;
 	int fw_v = self->motion_forward.v;
 
@@ -3213,6 +3848,7 @@ void plm_video_predict_macroblock(plm_video_t *self) {
 	else {
 		plm_video_copy_macroblock(self, &self->frame_forward, fw_h, fw_v);
 	}
+	PLM_PROFILE_LEAVE();
 }
 
 void plm_video_copy_macroblock(plm_video_t *self, plm_frame_t *s, int motion_h, int motion_v) {
@@ -3255,17 +3891,30 @@ void plm_video_process_macroblock(
 	unsigned int si = ((self->mb_row * block_size) + vp) * dw + (self->mb_col * block_size) + hp;
 	unsigned int di = (self->mb_row * dw + self->mb_col) * block_size;
 	
+	// The source block may extend one row and column further when the
+	// motion vector points to a half pixel
 	unsigned int max_address = (dw * (self->mb_height * block_size - block_size + 1) - block_size);
-	if (si > max_address || di > max_address) {
+	if (si > max_address || si + odd_v * dw + odd_h > max_address || di > max_address) {
 		return; // corrupt video
 	}
 
+	plm_video_mc_kernel(d + di, s + si, dw, block_size, (interpolate << 2) | (odd_h << 1) | (odd_v));
+}
+
+// Motion compensation of a single 16x16 (luma) or 8x8 (chroma) block. The mode
+// is (interpolate << 2) | (odd_h << 1) | odd_v, see
+// plm_video_process_macroblock().
+
+void plm_video_mc_scalar(uint8_t *d, const uint8_t *s, int dw, int block_size, int mode) {
+	unsigned int si = 0;
+	unsigned int di = 0;
+
 	#define PLM_MB_CASE(INTERPOLATE, ODD_H, ODD_V, OP) \
 		case ((INTERPOLATE << 2) | (ODD_H << 1) | (ODD_V)): \
 			PLM_BLOCK_SET(d, di, dw, si, dw, block_size, OP); \
 			break
 
-	switch ((interpolate << 2) | (odd_h << 1) | (odd_v)) {
+	switch (mode) {
 		PLM_MB_CASE(0, 0, 0, (s[si]));
 		PLM_MB_CASE(0, 0, 1, (s[si] + s[si + dw] + 1) >> 1);
 		PLM_MB_CASE(0, 1, 0, (s[si] + s[si + 1] + 1) >> 1);
@@ -3280,6 +3929,179 @@ void plm_video_process_macroblock(
 	#undef PLM_MB_CASE
 }
 
+// The SIMD versions of plm_video_mc_scalar(). A rounded average of two values
+// maps directly to pavgb/vrhadd; the 4 value half-pel average is computed on
+// 16 bit lanes so all modes stay bit identical to the C version.
+
+#define PLM_MC_PREDICT_FULL(LOAD, UNUSED)  LOAD(s)
+#define PLM_MC_PREDICT_V(LOAD, AVG2)  AVG2(LOAD(s), LOAD(s + dw))
+#define PLM_MC_PREDICT_H(LOAD, AVG2)  AVG2(LOAD(s), LOAD(s + 1))
+#define PLM_MC_PREDICT_HV(LOAD, AVG4)  AVG4(LOAD(s), LOAD(s + 1), LOAD(s + dw), LOAD(s + dw + 1))
+
+#if defined(PLM_SIMD_X86)
+
+PLM_TARGET_SSE2 static inline __m128i plm_video_mc_avg4_sse2(__m128i a, __m128i b, __m128i c, __m128i d) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i two = _mm_set1_epi16(2);
+	__m128i lo = _mm_add_epi16(
+		_mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)),
+		_mm_add_epi16(_mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(d, zero))
+	);
+	__m128i hi = _mm_add_epi16(
+		_mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)),
+		_mm_add_epi16(_mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(d, zero))
+	);
+	lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+	hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+	return _mm_packus_epi16(lo, hi);
+}
+
+#define PLM_MC_SSE2_LOAD16(P) _mm_loadu_si128((const __m128i *)(P))
+#define PLM_MC_SSE2_LOAD8(P) _mm_loadl_epi64((const __m128i *)(P))
+#define PLM_MC_SSE2_STORE16(P, V) _mm_storeu_si128((__m128i *)(P), V)
+#define PLM_MC_SSE2_STORE8(P, V) _mm_storel_epi64((__m128i *)(P), V)
+
+#define PLM_MC_SSE2_LOOP(SIZE, INTERPOLATE, PREDICT) \
+	for (int y = 0; y < SIZE; y++) { \
+		__m128i p = PREDICT; \
+		if (INTERPOLATE) { \
+			p = _mm_avg_epu8(PLM_MC_SSE2_LOAD##SIZE(d), p); \
+		} \
+		PLM_MC_SSE2_STORE##SIZE(d, p); \
+		s += dw; \
+		d += dw; \
+	}
+
+#define PLM_MC_SSE2_CASE(INTERPOLATE, ODD_H, ODD_V, PREDICT, AVG) \
+	case ((INTERPOLATE << 2) | (ODD_H << 1) | (ODD_V)): \
+		if (block_size == 16) { \
+			PLM_MC_SSE2_LOOP(16, INTERPOLATE, PREDICT(PLM_MC_SSE2_LOAD16, AVG)); \
+		} \
+		else { \
+			PLM_MC_SSE2_LOOP(8, INTERPOLATE, PREDICT(PLM_MC_SSE2_LOAD8, AVG)); \
+		} \
+		break
+
+PLM_TARGET_SSE2 void plm_video_mc_sse2(uint8_t *d, const uint8_t *s, int dw, int block_size, int mode) {
+	switch (mode) {
+		PLM_MC_SSE2_CASE(0, 0, 0, PLM_MC_PREDICT_FULL, 0);
+		PLM_MC_SSE2_CASE(0, 0, 1, PLM_MC_PREDICT_V, _mm_avg_epu8);
+		PLM_MC_SSE2_CASE(0, 1, 0, PLM_MC_PREDICT_H, _mm_avg_epu8);
+		PLM_MC_SSE2_CASE(0, 1, 1, PLM_MC_PREDICT_HV, plm_video_mc_avg4_sse2);
+
+		PLM_MC_SSE2_CASE(1, 0, 0, PLM_MC_PREDICT_FULL, 0);
+		PLM_MC_SSE2_CASE(1, 0, 1, PLM_MC_PREDICT_V, _mm_avg_epu8);
+		PLM_MC_SSE2_CASE(1, 1, 0, PLM_MC_PREDICT_H, _mm_avg_epu8);
+		PLM_MC_SSE2_CASE(1, 1, 1, PLM_MC_PREDICT_HV, plm_video_mc_avg4_sse2);
+	}
+}
+
+#undef PLM_MC_SSE2_LOAD16
+#undef PLM_MC_SSE2_LOAD8
+#undef PLM_MC_SSE2_STORE16
+#undef PLM_MC_SSE2_STORE8
+#undef PLM_MC_SSE2_LOOP
+#undef PLM_MC_SSE2_CASE
+
+#endif // PLM_SIMD_X86
+
+#if defined(PLM_SIMD_ARM_NEON)
+
+static inline uint8x16_t plm_video_mc_avg4_neon16(uint8x16_t a, uint8x16_t b, uint8x16_t c, uint8x16_t d) {
+	uint16x8_t lo = vaddq_u16(vaddl_u8(vget_low_u8(a), vget_low_u8(b)), vaddl_u8(vget_low_u8(c), vget_low_u8(d)));
+	uint16x8_t hi = vaddq_u16(vaddl_u8(vget_high_u8(a), vget_high_u8(b)), vaddl_u8(vget_high_u8(c), vget_high_u8(d)));
+	return vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2));
+}
+
+static inline uint8x8_t plm_video_mc_avg4_neon8(uint8x8_t a, uint8x8_t b, uint8x8_t c, uint8x8_t d) {
+	return vrshrn_n_u16(vaddq_u16(vaddl_u8(a, b), vaddl_u8(c, d)), 2);
+}
+
+#define PLM_MC_NEON_LOOP(TYPE, LOAD, STORE, AVG2, INTERPOLATE, PREDICT) \
+	for (int y = 0; y < block_size; y++) { \
+		TYPE p = PREDICT; \
+		if (INTERPOLATE) { \
+			p = AVG2(LOAD(d), p); \
+		} \
+		STORE(d, p); \
+		s += dw; \
+		d += dw; \
+	}
+
+#define PLM_MC_NEON_CASE(INTERPOLATE, ODD_H, ODD_V, PREDICT, AVG_16, AVG_8) \
+	case ((INTERPOLATE << 2) | (ODD_H << 1) | (ODD_V)): \
+		if (block_size == 16) { \
+			PLM_MC_NEON_LOOP(uint8x16_t, vld1q_u8, vst1q_u8, vrhaddq_u8, INTERPOLATE, PREDICT(vld1q_u8, AVG_16)); \
+		} \
+		else { \
+			PLM_MC_NEON_LOOP(uint8x8_t, vld1_u8, vst1_u8, vrhadd_u8, INTERPOLATE, PREDICT(vld1_u8, AVG_8)); \
+		} \
+		break
+
+void plm_video_mc_neon(uint8_t *d, const uint8_t *s, int dw, int block_size, int mode) {
+	switch (mode) {
+		PLM_MC_NEON_CASE(0, 0, 0, PLM_MC_PREDICT_FULL, 0, 0);
+		PLM_MC_NEON_CASE(0, 0, 1, PLM_MC_PREDICT_V, vrhaddq_u8, vrhadd_u8);
+		PLM_MC_NEON_CASE(0, 1, 0, PLM_MC_PREDICT_H, vrhaddq_u8, vrhadd_u8);
+		PLM_MC_NEON_CASE(0, 1, 1, PLM_MC_PREDICT_HV, plm_video_mc_avg4_neon16, plm_video_mc_avg4_neon8);
+
+		PLM_MC_NEON_CASE(1, 0, 0, PLM_MC_PREDICT_FULL, 0, 0);
+		PLM_MC_NEON_CASE(1, 0, 1, PLM_MC_PREDICT_V, vrhaddq_u8, vrhadd_u8);
+		PLM_MC_NEON_CASE(1, 1, 0, PLM_MC_PREDICT_H, vrhaddq_u8, vrhadd_u8);
+		PLM_MC_NEON_CASE(1, 1, 1, PLM_MC_PREDICT_HV, plm_video_mc_avg4_neon16, plm_video_mc_avg4_neon8);
+	}
+}
+
+#undef PLM_MC_NEON_LOOP
+#undef PLM_MC_NEON_CASE
+
+#endif // PLM_SIMD_ARM_NEON
+
+#undef PLM_MC_PREDICT_FULL
+#undef PLM_MC_PREDICT_V
+#undef PLM_MC_PREDICT_H
+#undef PLM_MC_PREDICT_HV
+
+#if defined(PLM_SIMD_X86) || defined(PLM_SIMD_ARM_NEON)
+
+// Run a motion compensation kernel over all modes and block sizes on a
+// pseudo random picture and compare a checksum of the results with those of
+// plm_video_mc_scalar(). Returns TRUE if they match.
+
+static int plm_video_mc_self_test(void (*kernel)(uint8_t *d, const uint8_t *s, int dw, int block_size, int mode)) {
+	enum { W = 48, H = 48 };
+	uint8_t src[W * H], ref[W * H], out[W * H];
+
+	uint32_t seed = 0x2545F491;
+	for (int i = 0; i < W * H; i++) {
+		seed = seed * 1664525 + 1013904223;
+		src[i] = (uint8_t)(seed >> 24);
+	}
+
+	uint32_t ref_sum = 2166136261u;
+	uint32_t out_sum = 2166136261u;
+	for (int mode = 0; mode < 8; mode++) {
+		for (int block_size = 8; block_size <= 16; block_size += 8) {
+			for (int offset = 0; offset < 3; offset++) {
+				for (int i = 0; i < W * H; i++) {
+					ref[i] = out[i] = src[(i * 7 + offset) % (W * H)];
+				}
+				int si = (offset * 5 + 3) * W + offset * 3 + 1;
+				int di = (offset * 3 + 2) * W + offset * 7 + 2;
+				plm_video_mc_scalar(ref + di, src + si, W, block_size, mode);
+				kernel(out + di, src + si, W, block_size, mode);
+				for (int i = 0; i < W * H; i++) {
+					ref_sum = (ref_sum ^ ref[i]) * 16777619u;
+					out_sum = (out_sum ^ out[i]) * 16777619u;
+				}
+			}
+		}
+	}
+	return ref_sum == out_sum;
+}
+
+#endif
+
 void plm_video_decode_block(plm_video_t *self, int block) {
 
 	int n = 0;
@@ -3293,7 +4115,7 @@ void plm_video_decode_block(plm_video_t *self, int block) {
 		// DC prediction
 		int plane_index = block > 3 ? block - 3 : 0;
 		predictor = self->dc_predictor[plane_index];
-		dct_size = plm_buffer_read_vlc(self->buffer, PLM_VIDEO_DCT_SIZE[plane_index]);
+		dct_size = plm_buffer_read_vlc_lut(self->buffer, PLM_VIDEO_DCT_SIZE[plane_index]);
 
 		// Read DC coeff
 		if (dct_size > 0) {
@@ -3326,7 +4148,7 @@ void plm_video_decode_block(plm_video_t *self, int block) {
 	int level = 0;
 	while (TRUE) {
 		int run = 0;
-		uint16_t coeff = plm_buffer_read_vlc_uint(self->buffer, PLM_VIDEO_DCT_COEFF);
+		uint16_t coeff = plm_buffer_read_vlc_lut_uint(self->buffer, &PLM_VIDEO_DCT_COEFF_LUT);
 
 		if ((coeff == 0x0001) && (n > 0) && (plm_buffer_read(self->buffer, 1) == 0)) {
 			// end_of_block
@@ -3356,7 +4178,9 @@ void plm_video_decode_block(plm_video_t *self, int block) {
 
 		n += run;
 		if (n < 0 || n >= 64) {
-			return; // invalid
+			// invalid; don't leave coefficients behind for the next block
+			memset(self->block_data, 0, sizeof(self->block_data));
+			return;
 		}
 
 		int de_zig_zagged = PLM_VIDEO_ZIG_ZAG[n];
@@ -3404,6 +4228,7 @@ void plm_video_decode_block(plm_video_t *self, int block) {
 		di = ((self->mb_row * self->luma_width) << 2) + (self->mb_col << 3);
 	}
 
+	PLM_PROFILE_ENTER(PLM_PROFILE_IDCT);
 	int *s = self->block_data;
 	int si = 0;
 	if (self->macroblock_intra) {
@@ -3414,7 +4239,7 @@ void plm_video_decode_block(plm_video_t *self, int block) {
 			s[0] = 0;
 		}
 		else {
-			plm_video_idct(s);
+			plm_video_idct_kernel(s);
 			PLM_BLOCK_SET(d, di, dw, si, 8, 8, plm_clamp(s[si]));
 			memset(self->block_data, 0, sizeof(self->block_data));
 		}
@@ -3427,11 +4252,12 @@ void plm_video_decode_block(plm_video_t *self, int block) {
 			s[0] = 0;
 		}
 		else {
-			plm_video_idct(s);
+			plm_video_idct_kernel(s);
 			PLM_BLOCK_SET(d, di, dw, si, 8, 8, plm_clamp(d[di] + s[si]));
 			memset(self->block_data, 0, sizeof(self->block_data));
 		}
 	}
+	PLM_PROFILE_LEAVE();
 }
 
 void plm_video_idct(int *block) {
@@ -3500,6 +4326,195 @@ void plm_video_idct(int *block) {
 	}
 }
 
+#if defined(PLM_SIMD_X86)
+
+// Vectorized versions of plm_video_idct(). They run the exact same integer
+// arithmetic on 32 bit lanes, so the output is bit identical to the scalar
+// version: the column pass works on whole rows, the block is transposed, the
+// row pass works on whole columns and the block is transposed back. SSE2 has
+// no 32 bit multiply, so the constants are applied with shifts and adds.
+
+#define PLM_IDCT_SSE2_MUL473(x) \
+	_mm_add_epi32(_mm_sub_epi32(_mm_sub_epi32(_mm_slli_epi32(x, 9), _mm_slli_epi32(x, 5)), _mm_slli_epi32(x, 3)), x)
+#define PLM_IDCT_SSE2_MUL196(x) \
+	_mm_add_epi32(_mm_add_epi32(_mm_slli_epi32(x, 7), _mm_slli_epi32(x, 6)), _mm_slli_epi32(x, 2))
+#define PLM_IDCT_SSE2_MUL362(x) \
+	_mm_sub_epi32(_mm_sub_epi32(_mm_sub_epi32(_mm_add_epi32(_mm_slli_epi32(x, 8), _mm_slli_epi32(x, 7)), _mm_slli_epi32(x, 4)), _mm_slli_epi32(x, 2)), _mm_slli_epi32(x, 1))
+
+#define PLM_IDCT_SSE2_TRANSPOSE4(a, b, c, d) { \
+	__m128i t0 = _mm_unpacklo_epi32(a, b); \
+	__m128i t1 = _mm_unpacklo_epi32(c, d); \
+	__m128i t2 = _mm_unpackhi_epi32(a, b); \
+	__m128i t3 = _mm_unpackhi_epi32(c, d); \
+	a = _mm_unpacklo_epi64(t0, t1); \
+	b = _mm_unpackhi_epi64(t0, t1); \
+	c = _mm_unpacklo_epi64(t2, t3); \
+	d = _mm_unpackhi_epi64(t2, t3); \
+}
+
+PLM_TARGET_SSE2 static inline void plm_video_idct_pass_sse2(__m128i *v, int descale) {
+	__m128i round = _mm_set1_epi32(128);
+	__m128i b1 = v[4];
+	__m128i b3 = _mm_add_epi32(v[2], v[6]);
+	__m128i b4 = _mm_sub_epi32(v[5], v[3]);
+	__m128i tmp1 = _mm_add_epi32(v[1], v[7]);
+	__m128i tmp2 = _mm_add_epi32(v[3], v[5]);
+	__m128i b6 = _mm_sub_epi32(v[1], v[7]);
+	__m128i b7 = _mm_add_epi32(tmp1, tmp2);
+	__m128i m0 = v[0];
+	__m128i d26 = _mm_sub_epi32(v[2], v[6]);
+	__m128i dt = _mm_sub_epi32(tmp1, tmp2);
+	__m128i x4 = _mm_sub_epi32(_mm_srai_epi32(_mm_add_epi32(_mm_sub_epi32(PLM_IDCT_SSE2_MUL473(b6), PLM_IDCT_SSE2_MUL196(b4)), round), 8), b7);
+	__m128i x0 = _mm_sub_epi32(x4, _mm_srai_epi32(_mm_add_epi32(PLM_IDCT_SSE2_MUL362(dt), round), 8));
+	__m128i x1 = _mm_sub_epi32(m0, b1);
+	__m128i x2 = _mm_sub_epi32(_mm_srai_epi32(_mm_add_epi32(PLM_IDCT_SSE2_MUL362(d26), round), 8), b3);
+	__m128i x3 = _mm_add_epi32(m0, b1);
+	__m128i y3 = _mm_add_epi32(x1, x2);
+	__m128i y4 = _mm_add_epi32(x3, b3);
+	__m128i y5 = _mm_sub_epi32(x1, x2);
+	__m128i y6 = _mm_sub_epi32(x3, b3);
+	__m128i y7 = _mm_sub_epi32(_mm_sub_epi32(_mm_setzero_si128(), x0), _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(PLM_IDCT_SSE2_MUL473(b4), PLM_IDCT_SSE2_MUL196(b6)), round), 8));
+	v[0] = _mm_add_epi32(b7, y4);
+	v[1] = _mm_add_epi32(x4, y3);
+	v[2] = _mm_sub_epi32(y5, x0);
+	v[3] = _mm_sub_epi32(y6, y7);
+	v[4] = _mm_add_epi32(y6, y7);
+	v[5] = _mm_add_epi32(x0, y5);
+	v[6] = _mm_sub_epi32(y3, x4);
+	v[7] = _mm_sub_epi32(y4, b7);
+	if (descale) {
+		for (int i = 0; i < 8; i++) {
+			v[i] = _mm_srai_epi32(_mm_add_epi32(v[i], round), 8);
+		}
+	}
+}
+
+PLM_TARGET_SSE2 static inline void plm_video_idct_transpose_sse2(__m128i *lo, __m128i *hi) {
+	PLM_IDCT_SSE2_TRANSPOSE4(lo[0], lo[1], lo[2], lo[3]);
+	PLM_IDCT_SSE2_TRANSPOSE4(hi[0], hi[1], hi[2], hi[3]);
+	PLM_IDCT_SSE2_TRANSPOSE4(lo[4], lo[5], lo[6], lo[7]);
+	PLM_IDCT_SSE2_TRANSPOSE4(hi[4], hi[5], hi[6], hi[7]);
+	for (int i = 0; i < 4; i++) {
+		__m128i t = hi[i];
+		hi[i] = lo[i + 4];
+		lo[i + 4] = t;
+	}
+}
+
+PLM_TARGET_SSE2 void plm_video_idct_sse2(int *block) {
+	__m128i lo[8], hi[8];
+	for (int i = 0; i < 8; i++) {
+		lo[i] = _mm_loadu_si128((const __m128i *)(block + i * 8));
+		hi[i] = _mm_loadu_si128((const __m128i *)(block + i * 8 + 4));
+	}
+
+	// Transform columns
+	plm_video_idct_pass_sse2(lo, FALSE);
+	plm_video_idct_pass_sse2(hi, FALSE);
+
+	// Transform rows
+	plm_video_idct_transpose_sse2(lo, hi);
+	plm_video_idct_pass_sse2(lo, TRUE);
+	plm_video_idct_pass_sse2(hi, TRUE);
+	plm_video_idct_transpose_sse2(lo, hi);
+
+	for (int i = 0; i < 8; i++) {
+		_mm_storeu_si128((__m128i *)(block + i * 8), lo[i]);
+		_mm_storeu_si128((__m128i *)(block + i * 8 + 4), hi[i]);
+	}
+}
+
+#undef PLM_IDCT_SSE2_MUL473
+#undef PLM_IDCT_SSE2_MUL196
+#undef PLM_IDCT_SSE2_MUL362
+#undef PLM_IDCT_SSE2_TRANSPOSE4
+
+PLM_TARGET_AVX2 static inline void plm_video_idct_pass_avx2(__m256i *v, int descale) {
+	__m256i round = _mm256_set1_epi32(128);
+	__m256i c473 = _mm256_set1_epi32(473);
+	__m256i c196 = _mm256_set1_epi32(196);
+	__m256i c362 = _mm256_set1_epi32(362);
+	__m256i b1 = v[4];
+	__m256i b3 = _mm256_add_epi32(v[2], v[6]);
+	__m256i b4 = _mm256_sub_epi32(v[5], v[3]);
+	__m256i tmp1 = _mm256_add_epi32(v[1], v[7]);
+	__m256i tmp2 = _mm256_add_epi32(v[3], v[5]);
+	__m256i b6 = _mm256_sub_epi32(v[1], v[7]);
+	__m256i b7 = _mm256_add_epi32(tmp1, tmp2);
+	__m256i m0 = v[0];
+	__m256i x4 = _mm256_sub_epi32(_mm256_srai_epi32(_mm256_add_epi32(_mm256_sub_epi32(_mm256_mullo_epi32(b6, c473), _mm256_mullo_epi32(b4, c196)), round), 8), b7);
+	__m256i x0 = _mm256_sub_epi32(x4, _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(tmp1, tmp2), c362), round), 8));
+	__m256i x1 = _mm256_sub_epi32(m0, b1);
+	__m256i x2 = _mm256_sub_epi32(_mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(v[2], v[6]), c362), round), 8), b3);
+	__m256i x3 = _mm256_add_epi32(m0, b1);
+	__m256i y3 = _mm256_add_epi32(x1, x2);
+	__m256i y4 = _mm256_add_epi32(x3, b3);
+	__m256i y5 = _mm256_sub_epi32(x1, x2);
+	__m256i y6 = _mm256_sub_epi32(x3, b3);
+	__m256i y7 = _mm256_sub_epi32(_mm256_sub_epi32(_mm256_setzero_si256(), x0), _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(b4, c473), _mm256_mullo_epi32(b6, c196)), round), 8));
+	v[0] = _mm256_add_epi32(b7, y4);
+	v[1] = _mm256_add_epi32(x4, y3);
+	v[2] = _mm256_sub_epi32(y5, x0);
+	v[3] = _mm256_sub_epi32(y6, y7);
+	v[4] = _mm256_add_epi32(y6, y7);
+	v[5] = _mm256_add_epi32(x0, y5);
+	v[6] = _mm256_sub_epi32(y3, x4);
+	v[7] = _mm256_sub_epi32(y4, b7);
+	if (descale) {
+		for (int i = 0; i < 8; i++) {
+			v[i] = _mm256_srai_epi32(_mm256_add_epi32(v[i], round), 8);
+		}
+	}
+}
+
+PLM_TARGET_AVX2 static inline void plm_video_idct_transpose_avx2(__m256i *v) {
+	__m256i t0 = _mm256_unpacklo_epi32(v[0], v[1]);
+	__m256i t1 = _mm256_unpackhi_epi32(v[0], v[1]);
+	__m256i t2 = _mm256_unpacklo_epi32(v[2], v[3]);
+	__m256i t3 = _mm256_unpackhi_epi32(v[2], v[3]);
+	__m256i t4 = _mm256_unpacklo_epi32(v[4], v[5]);
+	__m256i t5 = _mm256_unpackhi_epi32(v[4], v[5]);
+	__m256i t6 = _mm256_unpacklo_epi32(v[6], v[7]);
+	__m256i t7 = _mm256_unpackhi_epi32(v[6], v[7]);
+	__m256i s0 = _mm256_unpacklo_epi64(t0, t2);
+	__m256i s1 = _mm256_unpackhi_epi64(t0, t2);
+	__m256i s2 = _mm256_unpacklo_epi64(t1, t3);
+	__m256i s3 = _mm256_unpackhi_epi64(t1, t3);
+	__m256i s4 = _mm256_unpacklo_epi64(t4, t6);
+	__m256i s5 = _mm256_unpackhi_epi64(t4, t6);
+	__m256i s6 = _mm256_unpacklo_epi64(t5, t7);
+	__m256i s7 = _mm256_unpackhi_epi64(t5, t7);
+	v[0] = _mm256_permute2x128_si256(s0, s4, 0x20);
+	v[1] = _mm256_permute2x128_si256(s1, s5, 0x20);
+	v[2] = _mm256_permute2x128_si256(s2, s6, 0x20);
+	v[3] = _mm256_permute2x128_si256(s3, s7, 0x20);
+	v[4] = _mm256_permute2x128_si256(s0, s4, 0x31);
+	v[5] = _mm256_permute2x128_si256(s1, s5, 0x31);
+	v[6] = _mm256_permute2x128_si256(s2, s6, 0x31);
+	v[7] = _mm256_permute2x128_si256(s3, s7, 0x31);
+}
+
+PLM_TARGET_AVX2 void plm_video_idct_avx2(int *block) {
+	__m256i v[8];
+	for (int i = 0; i < 8; i++) {
+		v[i] = _mm256_loadu_si256((const __m256i *)(block + i * 8));
+	}
+
+	// Transform columns
+	plm_video_idct_pass_avx2(v, FALSE);
+
+	// Transform rows
+	plm_video_idct_transpose_avx2(v);
+	plm_video_idct_pass_avx2(v, TRUE);
+	plm_video_idct_transpose_avx2(v);
+
+	for (int i = 0; i < 8; i++) {
+		_mm256_storeu_si256((__m256i *)(block + i * 8), v[i]);
+	}
+}
+
+#endif // PLM_SIMD_X86
+
 // YCbCr conversion following the BT.601 standard:
 // https://infogalactic.com/info/YCbCr#ITU-R_BT.601_conversion
 
@@ -3540,7 +4555,7 @@ void plm_video_idct(int *block) {
 PLM_DEFINE_FRAME_CONVERT_FUNCTION(plm_frame_to_rgb,  3, 0, 1, 2)
 PLM_DEFINE_FRAME_CONVERT_FUNCTION(plm_frame_to_bgr,  3, 2, 1, 0)
 PLM_DEFINE_FRAME_CONVERT_FUNCTION(plm_frame_to_rgba, 4, 0, 1, 2)
-PLM_DEFINE_FRAME_CONVERT_FUNCTION(plm_frame_to_bgra, 4, 2, 1, 0)
+PLM_DEFINE_FRAME_CONVERT_FUNCTION(plm_frame_to_bgra_scalar, 4, 2, 1, 0)
 PLM_DEFINE_FRAME_CONVERT_FUNCTION(plm_frame_to_argb, 4, 1, 2, 3)
 PLM_DEFINE_FRAME_CONVERT_FUNCTION(plm_frame_to_abgr, 4, 3, 2, 1)
 
@@ -3548,6 +4563,189 @@ PLM_DEFINE_FRAME_CONVERT_FUNCTION(plm_frame_to_abgr, 4, 3, 2, 1)
 #undef PLM_PUT_PIXEL
 #undef PLM_DEFINE_FRAME_CONVERT_FUNCTION
 
+// Convert the two pixels of a row sharing one chroma sample to BGRA, leaving
+// the alpha bytes untouched.
+
+static inline void plm_frame_pair_to_bgra(uint8_t *dest, const uint8_t *y_src, int cr, int cb) {
+	cr -= 128;
+	cb -= 128;
+	int r = (cr * 104597) >> 16;
+	int g = (cb * 25674 + cr * 53278) >> 16;
+	int b = (cb * 132201) >> 16;
+	for (int i = 0; i < 2; i++) {
+		int y = ((y_src[i] - 16) * 76309) >> 16;
+		dest[i * 4 + 0] = plm_clamp(y + b);
+		dest[i * 4 + 1] = plm_clamp(y - g);
+		dest[i * 4 + 2] = plm_clamp(y + r);
+	}
+}
+
+void plm_frame_row_to_bgra_scalar(plm_frame_t *frame, uint8_t *dest, int row, int first_pair, int end_pair) {
+	const uint8_t *y_row = frame->y.data + row * frame->y.width;
+	const uint8_t *cr_row = frame->cr.data + (row >> 1) * frame->cr.width;
+	const uint8_t *cb_row = frame->cb.data + (row >> 1) * frame->cb.width;
+	for (int col = first_pair; col < end_pair; col++) {
+		plm_frame_pair_to_bgra(dest + col * 8, y_row + col * 2, cr_row[col], cb_row[col]);
+	}
+}
+
+#if defined(PLM_SIMD_X86)
+
+// SSE2 version of plm_frame_to_bgra_scalar(), converting 16x2 pixels at a
+// time. The 16.16 fixed point constants are split into an integer part and a
+// signed 16 bit fraction, e.g. (x * 76309) >> 16 == x + ((x * 10773) >> 16),
+// so the result is bit identical to the scalar version. The alpha byte of the
+// destination is preserved. Columns that don't fill a full block of 16 pixels
+// are converted by the scalar code.
+
+PLM_TARGET_SSE2 static inline void plm_frame_put_bgra_sse2(
+	uint8_t *dest, __m128i b, __m128i g, __m128i r, __m128i alpha_mask
+) {
+	__m128i bg_lo = _mm_unpacklo_epi8(b, g);
+	__m128i bg_hi = _mm_unpackhi_epi8(b, g);
+	__m128i ra_lo = _mm_unpacklo_epi8(r, _mm_setzero_si128());
+	__m128i ra_hi = _mm_unpackhi_epi8(r, _mm_setzero_si128());
+	__m128i px[4];
+	px[0] = _mm_unpacklo_epi16(bg_lo, ra_lo);
+	px[1] = _mm_unpackhi_epi16(bg_lo, ra_lo);
+	px[2] = _mm_unpacklo_epi16(bg_hi, ra_hi);
+	px[3] = _mm_unpackhi_epi16(bg_hi, ra_hi);
+	for (int i = 0; i < 4; i++) {
+		__m128i *d = (__m128i *)(dest + i * 16);
+		__m128i a = _mm_and_si128(_mm_loadu_si128(d), alpha_mask);
+		_mm_storeu_si128(d, _mm_or_si128(px[i], a));
+	}
+}
+
+// Compute the chroma terms of 8 chroma samples (16 pixels) into rgb[]: the
+// blue, green and red offsets for the low and high 8 pixels.
+
+PLM_TARGET_SSE2 static inline void plm_frame_chroma_sse2(
+	const uint8_t *cr_src, const uint8_t *cb_src, __m128i rgb[6]
+) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i c128 = _mm_set1_epi16(128);
+	__m128i r_frac = _mm_set1_epi16(-26475);   // 104597 = 2 << 16 - 26475
+	__m128i b_frac = _mm_set1_epi16(1129);     // 132201 = 2 << 16 + 1129
+	__m128i g_frac = _mm_set_epi16(            // 53278 = 1 << 16 - 12258
+		-12258, 25674, -12258, 25674, -12258, 25674, -12258, 25674
+	);
+
+	__m128i cr = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)cr_src), zero), c128);
+	__m128i cb = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)cb_src), zero), c128);
+
+	__m128i r = _mm_add_epi16(_mm_add_epi16(cr, cr), _mm_mulhi_epi16(cr, r_frac));
+	__m128i b = _mm_add_epi16(_mm_add_epi16(cb, cb), _mm_mulhi_epi16(cb, b_frac));
+	__m128i g_lo = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(cb, cr), g_frac), 16);
+	__m128i g_hi = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(cb, cr), g_frac), 16);
+	__m128i g = _mm_add_epi16(_mm_packs_epi32(g_lo, g_hi), cr);
+
+	// Each chroma sample covers two luma columns
+	rgb[0] = _mm_unpacklo_epi16(b, b);
+	rgb[1] = _mm_unpackhi_epi16(b, b);
+	rgb[2] = _mm_unpacklo_epi16(g, g);
+	rgb[3] = _mm_unpackhi_epi16(g, g);
+	rgb[4] = _mm_unpacklo_epi16(r, r);
+	rgb[5] = _mm_unpackhi_epi16(r, r);
+}
+
+// Convert 16 luma samples using the chroma terms from plm_frame_chroma_sse2().
+
+PLM_TARGET_SSE2 static inline void plm_frame_luma_to_bgra_sse2(
+	uint8_t *dest, const uint8_t *y_src, const __m128i rgb[6], __m128i alpha_mask
+) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i c16 = _mm_set1_epi16(16);
+	__m128i y_frac = _mm_set1_epi16(10773);    // 76309 = 1 << 16 + 10773
+
+	__m128i yv = _mm_loadu_si128((const __m128i *)y_src);
+	__m128i yl = _mm_sub_epi16(_mm_unpacklo_epi8(yv, zero), c16);
+	__m128i yh = _mm_sub_epi16(_mm_unpackhi_epi8(yv, zero), c16);
+	yl = _mm_add_epi16(yl, _mm_mulhi_epi16(yl, y_frac));
+	yh = _mm_add_epi16(yh, _mm_mulhi_epi16(yh, y_frac));
+	plm_frame_put_bgra_sse2(
+		dest,
+		_mm_packus_epi16(_mm_add_epi16(yl, rgb[0]), _mm_add_epi16(yh, rgb[1])),
+		_mm_packus_epi16(_mm_sub_epi16(yl, rgb[2]), _mm_sub_epi16(yh, rgb[3])),
+		_mm_packus_epi16(_mm_add_epi16(yl, rgb[4]), _mm_add_epi16(yh, rgb[5])),
+		alpha_mask
+	);
+}
+
+PLM_TARGET_SSE2 void plm_frame_to_bgra_sse2(plm_frame_t *frame, uint8_t *dest, int stride) {
+	int cols = frame->width >> 1;
+	int rows = frame->height >> 1;
+	int simd_cols = cols & ~7;
+	int yw = frame->y.width;
+	int cw = frame->cb.width;
+
+	__m128i alpha_mask = _mm_set1_epi32((int)0xFF000000);
+
+	for (int row = 0; row < rows; row++) {
+		const uint8_t *y0 = frame->y.data + row * 2 * yw;
+		const uint8_t *y1 = y0 + yw;
+		const uint8_t *cr_row = frame->cr.data + row * cw;
+		const uint8_t *cb_row = frame->cb.data + row * cw;
+		uint8_t *d0 = dest + row * 2 * stride;
+		uint8_t *d1 = d0 + stride;
+
+		for (int col = 0; col < simd_cols; col += 8) {
+			__m128i rgb[6];
+			plm_frame_chroma_sse2(cr_row + col, cb_row + col, rgb);
+			plm_frame_luma_to_bgra_sse2(d0 + col * 8, y0 + col * 2, rgb, alpha_mask);
+			plm_frame_luma_to_bgra_sse2(d1 + col * 8, y1 + col * 2, rgb, alpha_mask);
+		}
+
+		for (int col = simd_cols; col < cols; col++) {
+			plm_frame_pair_to_bgra(d0 + col * 8, y0 + col * 2, cr_row[col], cb_row[col]);
+			plm_frame_pair_to_bgra(d1 + col * 8, y1 + col * 2, cr_row[col], cb_row[col]);
+		}
+	}
+}
+
+PLM_TARGET_SSE2 void plm_frame_row_to_bgra_sse2(plm_frame_t *frame, uint8_t *dest, int row, int first_pair, int end_pair) {
+	const uint8_t *y_row = frame->y.data + row * frame->y.width;
+	const uint8_t *cr_row = frame->cr.data + (row >> 1) * frame->cr.width;
+	const uint8_t *cb_row = frame->cb.data + (row >> 1) * frame->cb.width;
+
+	__m128i alpha_mask = _mm_set1_epi32((int)0xFF000000);
+
+	int col = first_pair;
+	for (; col + 8 <= end_pair; col += 8) {
+		__m128i rgb[6];
+		plm_frame_chroma_sse2(cr_row + col, cb_row + col, rgb);
+		plm_frame_luma_to_bgra_sse2(dest + col * 8, y_row + col * 2, rgb, alpha_mask);
+	}
+	for (; col < end_pair; col++) {
+		plm_frame_pair_to_bgra(dest + col * 8, y_row + col * 2, cr_row[col], cb_row[col]);
+	}
+}
+
+#endif // PLM_SIMD_X86
+
+static void (*plm_frame_to_bgra_kernel)(plm_frame_t *frame, uint8_t *dest, int stride) = plm_frame_to_bgra_scalar;
+
+void plm_frame_to_bgra(plm_frame_t *frame, uint8_t *dest, int stride) {
+	PLM_PROFILE_ENTER(PLM_PROFILE_CONVERT);
+	plm_frame_to_bgra_kernel(frame, dest, stride);
+	PLM_PROFILE_LEAVE();
+}
+
+static void (*plm_frame_row_to_bgra_kernel)(plm_frame_t *frame, uint8_t *dest, int row, int first_pair, int end_pair) = plm_frame_row_to_bgra_scalar;
+
+void plm_frame_row_to_bgra(plm_frame_t *frame, uint8_t *dest, int row, int col_begin, int col_end) {
+	int end_pair = (col_end + 1) >> 1;
+	if (end_pair > (int)(frame->width >> 1)) {
+		end_pair = frame->width >> 1;
+	}
+	if (row < 0 || row >= (int)frame->height || col_begin < 0 || (col_begin >> 1) >= end_pair) {
+		return;
+	}
+	PLM_PROFILE_ENTER(PLM_PROFILE_CONVERT);
+	plm_frame_row_to_bgra_kernel(frame, dest, row, col_begin >> 1, end_pair);
+	PLM_PROFILE_LEAVE();
+}
+
 
 
 // -----------------------------------------------------------------------------
@@ -3777,17 +4975,25 @@ typedef struct plm_audio_t {
 	int sample[2][32][3];
 
 	plm_samples_t samples;
+	float output_scale;
 	float D[1024];
 	float V[2][1024];
 	float U[32];
 } plm_audio_t;
 
+static plm_samples_t *plm_audio_decode_next(plm_audio_t *self);
 int plm_audio_find_frame_sync(plm_audio_t *self);
 int plm_audio_decode_header(plm_audio_t *self);
 void plm_audio_decode_frame(plm_audio_t *self);
 const plm_quantizer_spec_t *plm_audio_read_allocation(plm_audio_t *self, int sb, int tab3);
 void plm_audio_read_samples(plm_audio_t *self, int ch, int sb, int part); 
 void plm_audio_idct36(int s[32][3], int ss, float *d, int dp);
+void plm_audio_synthesize_scalar(plm_audio_t *self, int out_pos);
+#if defined(PLM_SIMD_X86)
+void plm_audio_synthesize_sse2(plm_audio_t *self, int out_pos);
+#endif
+
+static void (*plm_audio_synthesize_kernel)(plm_audio_t *self, int out_pos) = plm_audio_synthesize_scalar;
 
 plm_audio_t *plm_audio_create_with_buffer(plm_buffer_t *buffer, int destroy_when_done) {
 	plm_audio_t *self = (plm_audio_t *)malloc(sizeof(plm_audio_t));
@@ -3797,6 +5003,11 @@ plm_audio_t *plm_audio_create_with_buffer(plm_buffer_t *buffer, int destroy_when
 	self->buffer = buffer;
 	self->destroy_buffer_when_done = destroy_when_done;
 	self->samplerate_index = 3; // Indicates 0
+	plm_audio_set_gain(self, 1.0f);
+
+	if (plm_simd_level < 0) {
+		plm_simd_set_level(plm_simd_get_supported());
+	}
 
 	memcpy(self->D, PLM_AUDIO_SYNTHESIS_WINDOW, 512 * sizeof(float));
 	memcpy(self->D + 512, PLM_AUDIO_SYNTHESIS_WINDOW, 512 * sizeof(float));
@@ -3839,6 +5050,15 @@ void plm_audio_set_time(plm_audio_t *self, double time) {
 	self->time = time;
 }
 
+void plm_audio_set_gain(plm_audio_t *self, float gain) {
+	// The synthesis output is scaled by 2^31 - 2^16
+	#ifdef PLM_AUDIO_S16_OUTPUT
+		self->output_scale = gain * (32767.0f / 2147418112.0f);
+	#else
+		self->output_scale = gain / 2147418112.0f;
+	#endif
+}
+
 void plm_audio_rewind(plm_audio_t *self) {
 	plm_buffer_rewind(self->buffer);
 	self->time = 0;
@@ -3851,6 +5071,13 @@ int plm_audio_has_ended(plm_audio_t *self) {
 }
 
 plm_samples_t *plm_audio_decode(plm_audio_t *self) {
+	PLM_PROFILE_ENTER(PLM_PROFILE_MP2);
+	plm_samples_t *samples = plm_audio_decode_next(self);
+	PLM_PROFILE_LEAVE();
+	return samples;
+}
+
+static plm_samples_t *plm_audio_decode_next(plm_audio_t *self) {
 	// Do we have at least enough information to decode the frame header?
 	if (!self->next_frame_data_size) {
 		if (!plm_buffer_has(self->buffer, 48)) {
@@ -4079,60 +5306,79 @@ void plm_audio_decode_frame(plm_audio_t *self) {
 			}
 
 			// Synthesis loop
-			for (int p = 0; p < 3; p++) {
-				// Shifting step
-				self->v_pos = (self->v_pos - 64) & 1023;
+			plm_audio_synthesize_kernel(self, out_pos);
+			out_pos += 96;
+		} // Decoding of the granule finished
+	}
 
-				for (int ch = 0; ch < 2; ch++) {
-					plm_audio_idct36(self->sample[ch], p, self->V[ch], self->v_pos);
+	plm_buffer_align(self->buffer);
+}
 
-					// Build U, windowing, calculate output
-					memset(self->U, 0, sizeof(self->U));
+static inline plm_audio_sample_t plm_audio_output_sample(float u, float scale) {
+	#ifdef PLM_AUDIO_S16_OUTPUT
+		float v = u * scale;
+		if (v > 32767.0f) {
+			return 32767;
+		}
+		if (v < -32768.0f) {
+			return -32768;
+		}
+		return (plm_audio_sample_t)v;
+	#else
+		return u * scale;
+	#endif
+}
 
-					int d_index = 512 - (self->v_pos >> 1);
-					int v_index = (self->v_pos % 128) >> 1;
-					while (v_index < 1024) {
-						for (int i = 0; i < 32; ++i) {
-							self->U[i] += self->D[d_index++] * self->V[ch][v_index++];
-						}
+void plm_audio_synthesize_scalar(plm_audio_t *self, int out_pos) {
+	for (int p = 0; p < 3; p++) {
+		// Shifting step
+		self->v_pos = (self->v_pos - 64) & 1023;
 
-						v_index += 128 - 32;
-						d_index += 64 - 32;
-					}
+		for (int ch = 0; ch < 2; ch++) {
+			plm_audio_idct36(self->sample[ch], p, self->V[ch], self->v_pos);
 
-					d_index -= (512 - 32);
-					v_index = (128 - 32 + 1024) - v_index;
-					while (v_index < 1024) {
-						for (int i = 0; i < 32; ++i) {
-							self->U[i] += self->D[d_index++] * self->V[ch][v_index++];
-						}
+			// Build U, windowing, calculate output
+			memset(self->U, 0, sizeof(self->U));
 
-						v_index += 128 - 32;
-						d_index += 64 - 32;
-					}
+			int d_index = 512 - (self->v_pos >> 1);
+			int v_index = (self->v_pos % 128) >> 1;
+			while (v_index < 1024) {
+				for (int i = 0; i < 32; ++i) {
+					self->U[i] += self->D[d_index++] * self->V[ch][v_index++];
+				}
 
-					// Output samples
-					#ifdef PLM_AUDIO_SEPARATE_CHANNELS
-						float *out_channel = ch == 0
-							? self->samples.left
-							: self->samples.right;
-						for (int j = 0; j < 32; j++) {
-							out_channel[out_pos + j] = self->U[j] / 2147418112.0f;
-						}
-					#else
-						for (int j = 0; j < 32; j++) {
-							self->samples.interleaved[((out_pos + j) << 1) + ch] = 
-								self->U[j] / 2147418112.0f;
-						}
-					#endif
-				} // End of synthesis channel loop
-				out_pos += 32;
-			} // End of synthesis sub-block loop
+				v_index += 128 - 32;
+				d_index += 64 - 32;
+			}
 
-		} // Decoding of the granule finished
-	}
+			d_index -= (512 - 32);
+			v_index = (128 - 32 + 1024) - v_index;
+			while (v_index < 1024) {
+				for (int i = 0; i < 32; ++i) {
+					self->U[i] += self->D[d_index++] * self->V[ch][v_index++];
+				}
 
-	plm_buffer_align(self->buffer);
+				v_index += 128 - 32;
+				d_index += 64 - 32;
+			}
+
+			// Output samples
+			#ifdef PLM_AUDIO_SEPARATE_CHANNELS
+				plm_audio_sample_t *out_channel = ch == 0
+					? self->samples.left
+					: self->samples.right;
+				for (int j = 0; j < 32; j++) {
+					out_channel[out_pos + j] = plm_audio_output_sample(self->U[j], self->output_scale);
+				}
+			#else
+				for (int j = 0; j < 32; j++) {
+					self->samples.interleaved[((out_pos + j) << 1) + ch] = 
+						plm_audio_output_sample(self->U[j], self->output_scale);
+				}
+			#endif
+		} // End of synthesis channel loop
+		out_pos += 32;
+	} // End of synthesis sub-block loop
 }
 
 const plm_quantizer_spec_t *plm_audio_read_allocation(plm_audio_t *self, int sb, int tab3) {
@@ -4333,5 +5579,385 @@ void plm_audio_idct36(int s[32][3], int ss, float *d, int dp) {
 	d[dp + 15] = t02; d[dp + 16] = 0.0;
 }
 
+#if defined(PLM_SIMD_X86)
+
+// plm_audio_idct36() for all three sub-blocks (ss) of a granule at once, one
+// per lane. Only the 32 distinct outputs are stored, as a[k][ss] = d[dp + k]
+// and b[k][ss] = -d[dp + 48 + k]; see plm_audio_store_v() for the rest.
+
+PLM_TARGET_SSE2 static void plm_audio_idct36_sse2(int s[32][3], float a[16][4], float b[16][4]) {
+	__m128i x[32];
+	__m128 t01, t02, t03, t04, t05, t06, t07, t08, t09, t10, t11, t12,
+		t13, t14, t15, t16, t17, t18, t19, t20, t21, t22, t23, t24,
+		t25, t26, t27, t28, t29, t30, t31, t32, t33;
+
+	for (int i = 0; i < 32; i++) {
+		x[i] = _mm_setr_epi32(s[i][0], s[i][1], s[i][2], 0);
+	}
+
+	t01 = _mm_cvtepi32_ps(_mm_add_epi32(x[0], x[31])); t02 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(x[0], x[31])), _mm_set1_ps(0.500602998235f));
+	t03 = _mm_cvtepi32_ps(_mm_add_epi32(x[1], x[30])); t04 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(x[1], x[30])), _mm_set1_ps(0.505470959898f));
+	t05 = _mm_cvtepi32_ps(_mm_add_epi32(x[2], x[29])); t06 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(x[2], x[29])), _mm_set1_ps(0.515447309923f));
+	t07 = _mm_cvtepi32_ps(_mm_add_epi32(x[3], x[28])); t08 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(x[3], x[28])), _mm_set1_ps(0.53104259109f));
+	t09 = _mm_cvtepi32_ps(_mm_add_epi32(x[4], x[27])); t10 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(x[4], x[27])), _mm_set1_ps(0.553103896034f));
+	t11 = _mm_cvtepi32_ps(_mm_add_epi32(x[5], x[26])); t12 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(x[5], x[26])), _mm_set1_ps(0.582934968206f));
+	t13 = _mm_cvtepi32_ps(_mm_add_epi32(x[6], x[25])); t14 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(x[6], x[25])), _mm_set1_ps(0.622504123036f));
+	t15 = _mm_cvtepi32_ps(_mm_add_epi32(x[7], x[24])); t16 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(x[7], x[24])), _mm_set1_ps(0.674808341455f));
+	t17 = _mm_cvtepi32_ps(_mm_add_epi32(x[8], x[23])); t18 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(x[8], x[23])), _mm_set1_ps(0.744536271002f));
+	t19 = _mm_cvtepi32_ps(_mm_add_epi32(x[9], x[22])); t20 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(x[9], x[22])), _mm_set1_ps(0.839349645416f));
+	t21 = _mm_cvtepi32_ps(_mm_add_epi32(x[10], x[21])); t22 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(x[10], x[21])), _mm_set1_ps(0.972568237862f));
+	t23 = _mm_cvtepi32_ps(_mm_add_epi32(x[11], x[20])); t24 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(x[11], x[20])), _mm_set1_ps(1.16943993343f));
+	t25 = _mm_cvtepi32_ps(_mm_add_epi32(x[12], x[19])); t26 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(x[12], x[19])), _mm_set1_ps(1.48416461631f));
+	t27 = _mm_cvtepi32_ps(_mm_add_epi32(x[13], x[18])); t28 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(x[13], x[18])), _mm_set1_ps(2.05778100995f));
+	t29 = _mm_cvtepi32_ps(_mm_add_epi32(x[14], x[17])); t30 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(x[14], x[17])), _mm_set1_ps(3.40760841847f));
+	t31 = _mm_cvtepi32_ps(_mm_add_epi32(x[15], x[16])); t32 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(x[15], x[16])), _mm_set1_ps(10.1900081235f));
+	t33 = _mm_add_ps(t01, t31); t31 = _mm_mul_ps(_mm_sub_ps(t01, t31), _mm_set1_ps(0.502419286188f));
+	t01 = _mm_add_ps(t03, t29); t29 = _mm_mul_ps(_mm_sub_ps(t03, t29), _mm_set1_ps(0.52249861494f));
+	t03 = _mm_add_ps(t05, t27); t27 = _mm_mul_ps(_mm_sub_ps(t05, t27), _mm_set1_ps(0.566944034816f));
+	t05 = _mm_add_ps(t07, t25); t25 = _mm_mul_ps(_mm_sub_ps(t07, t25), _mm_set1_ps(0.64682178336f));
+	t07 = _mm_add_ps(t09, t23); t23 = _mm_mul_ps(_mm_sub_ps(t09, t23), _mm_set1_ps(0.788154623451f));
+	t09 = _mm_add_ps(t11, t21); t21 = _mm_mul_ps(_mm_sub_ps(t11, t21), _mm_set1_ps(1.06067768599f));
+	t11 = _mm_add_ps(t13, t19); t19 = _mm_mul_ps(_mm_sub_ps(t13, t19), _mm_set1_ps(1.72244709824f));
+	t13 = _mm_add_ps(t15, t17); t17 = _mm_mul_ps(_mm_sub_ps(t15, t17), _mm_set1_ps(5.10114861869f));
+	t15 = _mm_add_ps(t33, t13); t13 = _mm_mul_ps(_mm_sub_ps(t33, t13), _mm_set1_ps(0.509795579104f));
+	t33 = _mm_add_ps(t01, t11); t01 = _mm_mul_ps(_mm_sub_ps(t01, t11), _mm_set1_ps(0.601344886935f));
+	t11 = _mm_add_ps(t03, t09); t09 = _mm_mul_ps(_mm_sub_ps(t03, t09), _mm_set1_ps(0.899976223136f));
+	t03 = _mm_add_ps(t05, t07); t07 = _mm_mul_ps(_mm_sub_ps(t05, t07), _mm_set1_ps(2.56291544774f));
+	t05 = _mm_add_ps(t15, t03); t15 = _mm_mul_ps(_mm_sub_ps(t15, t03), _mm_set1_ps(0.541196100146f));
+	t03 = _mm_add_ps(t33, t11); t11 = _mm_mul_ps(_mm_sub_ps(t33, t11), _mm_set1_ps(1.30656296488f));
+	t33 = _mm_add_ps(t05, t03); t05 = _mm_mul_ps(_mm_sub_ps(t05, t03), _mm_set1_ps(0.707106781187f));
+	t03 = _mm_add_ps(t15, t11); t15 = _mm_mul_ps(_mm_sub_ps(t15, t11), _mm_set1_ps(0.707106781187f));
+	t03 = _mm_add_ps(t03, t15);
+	t11 = _mm_add_ps(t13, t07); t13 = _mm_mul_ps(_mm_sub_ps(t13, t07), _mm_set1_ps(0.541196100146f));
+	t07 = _mm_add_ps(t01, t09); t09 = _mm_mul_ps(_mm_sub_ps(t01, t09), _mm_set1_ps(1.30656296488f));
+	t01 = _mm_add_ps(t11, t07); t07 = _mm_mul_ps(_mm_sub_ps(t11, t07), _mm_set1_ps(0.707106781187f));
+	t11 = _mm_add_ps(t13, t09); t13 = _mm_mul_ps(_mm_sub_ps(t13, t09), _mm_set1_ps(0.707106781187f));
+	t11 = _mm_add_ps(t11, t13); t01 = _mm_add_ps(t01, t11);
+	t11 = _mm_add_ps(t11, t07); t07 = _mm_add_ps(t07, t13);
+	t09 = _mm_add_ps(t31, t17); t31 = _mm_mul_ps(_mm_sub_ps(t31, t17), _mm_set1_ps(0.509795579104f));
+	t17 = _mm_add_ps(t29, t19); t29 = _mm_mul_ps(_mm_sub_ps(t29, t19), _mm_set1_ps(0.601344886935f));
+	t19 = _mm_add_ps(t27, t21); t21 = _mm_mul_ps(_mm_sub_ps(t27, t21), _mm_set1_ps(0.899976223136f));
+	t27 = _mm_add_ps(t25, t23); t23 = _mm_mul_ps(_mm_sub_ps(t25, t23), _mm_set1_ps(2.56291544774f));
+	t25 = _mm_add_ps(t09, t27); t09 = _mm_mul_ps(_mm_sub_ps(t09, t27), _mm_set1_ps(0.541196100146f));
+	t27 = _mm_add_ps(t17, t19); t19 = _mm_mul_ps(_mm_sub_ps(t17, t19), _mm_set1_ps(1.30656296488f));
+	t17 = _mm_add_ps(t25, t27); t27 = _mm_mul_ps(_mm_sub_ps(t25, t27), _mm_set1_ps(0.707106781187f));
+	t25 = _mm_add_ps(t09, t19); t19 = _mm_mul_ps(_mm_sub_ps(t09, t19), _mm_set1_ps(0.707106781187f));
+	t25 = _mm_add_ps(t25, t19);
+	t09 = _mm_add_ps(t31, t23); t31 = _mm_mul_ps(_mm_sub_ps(t31, t23), _mm_set1_ps(0.541196100146f));
+	t23 = _mm_add_ps(t29, t21); t21 = _mm_mul_ps(_mm_sub_ps(t29, t21), _mm_set1_ps(1.30656296488f));
+	t29 = _mm_add_ps(t09, t23); t23 = _mm_mul_ps(_mm_sub_ps(t09, t23), _mm_set1_ps(0.707106781187f));
+	t09 = _mm_add_ps(t31, t21); t31 = _mm_mul_ps(_mm_sub_ps(t31, t21), _mm_set1_ps(0.707106781187f));
+	t09 = _mm_add_ps(t09, t31); t29 = _mm_add_ps(t29, t09); t09 = _mm_add_ps(t09, t23); t23 = _mm_add_ps(t23, t31);
+	t17 = _mm_add_ps(t17, t29); t29 = _mm_add_ps(t29, t25); t25 = _mm_add_ps(t25, t09); t09 = _mm_add_ps(t09, t27);
+	t27 = _mm_add_ps(t27, t23); t23 = _mm_add_ps(t23, t19); t19 = _mm_add_ps(t19, t31);
+	t21 = _mm_add_ps(t02, t32); t02 = _mm_mul_ps(_mm_sub_ps(t02, t32), _mm_set1_ps(0.502419286188f));
+	t32 = _mm_add_ps(t04, t30); t04 = _mm_mul_ps(_mm_sub_ps(t04, t30), _mm_set1_ps(0.52249861494f));
+	t30 = _mm_add_ps(t06, t28); t28 = _mm_mul_ps(_mm_sub_ps(t06, t28), _mm_set1_ps(0.566944034816f));
+	t06 = _mm_add_ps(t08, t26); t08 = _mm_mul_ps(_mm_sub_ps(t08, t26), _mm_set1_ps(0.64682178336f));
+	t26 = _mm_add_ps(t10, t24); t10 = _mm_mul_ps(_mm_sub_ps(t10, t24), _mm_set1_ps(0.788154623451f));
+	t24 = _mm_add_ps(t12, t22); t22 = _mm_mul_ps(_mm_sub_ps(t12, t22), _mm_set1_ps(1.06067768599f));
+	t12 = _mm_add_ps(t14, t20); t20 = _mm_mul_ps(_mm_sub_ps(t14, t20), _mm_set1_ps(1.72244709824f));
+	t14 = _mm_add_ps(t16, t18); t16 = _mm_mul_ps(_mm_sub_ps(t16, t18), _mm_set1_ps(5.10114861869f));
+	t18 = _mm_add_ps(t21, t14); t14 = _mm_mul_ps(_mm_sub_ps(t21, t14), _mm_set1_ps(0.509795579104f));
+	t21 = _mm_add_ps(t32, t12); t32 = _mm_mul_ps(_mm_sub_ps(t32, t12), _mm_set1_ps(0.601344886935f));
+	t12 = _mm_add_ps(t30, t24); t24 = _mm_mul_ps(_mm_sub_ps(t30, t24), _mm_set1_ps(0.899976223136f));
+	t30 = _mm_add_ps(t06, t26); t26 = _mm_mul_ps(_mm_sub_ps(t06, t26), _mm_set1_ps(2.56291544774f));
+	t06 = _mm_add_ps(t18, t30); t18 = _mm_mul_ps(_mm_sub_ps(t18, t30), _mm_set1_ps(0.541196100146f));
+	t30 = _mm_add_ps(t21, t12); t12 = _mm_mul_ps(_mm_sub_ps(t21, t12), _mm_set1_ps(1.30656296488f));
+	t21 = _mm_add_ps(t06, t30); t30 = _mm_mul_ps(_mm_sub_ps(t06, t30), _mm_set1_ps(0.707106781187f));
+	t06 = _mm_add_ps(t18, t12); t12 = _mm_mul_ps(_mm_sub_ps(t18, t12), _mm_set1_ps(0.707106781187f));
+	t06 = _mm_add_ps(t06, t12);
+	t18 = _mm_add_ps(t14, t26); t26 = _mm_mul_ps(_mm_sub_ps(t14, t26), _mm_set1_ps(0.541196100146f));
+	t14 = _mm_add_ps(t32, t24); t24 = _mm_mul_ps(_mm_sub_ps(t32, t24), _mm_set1_ps(1.30656296488f));
+	t32 = _mm_add_ps(t18, t14); t14 = _mm_mul_ps(_mm_sub_ps(t18, t14), _mm_set1_ps(0.707106781187f));
+	t18 = _mm_add_ps(t26, t24); t24 = _mm_mul_ps(_mm_sub_ps(t26, t24), _mm_set1_ps(0.707106781187f));
+	t18 = _mm_add_ps(t18, t24); t32 = _mm_add_ps(t32, t18);
+	t18 = _mm_add_ps(t18, t14); t26 = _mm_add_ps(t14, t24);
+	t14 = _mm_add_ps(t02, t16); t02 = _mm_mul_ps(_mm_sub_ps(t02, t16), _mm_set1_ps(0.509795579104f));
+	t16 = _mm_add_ps(t04, t20); t04 = _mm_mul_ps(_mm_sub_ps(t04, t20), _mm_set1_ps(0.601344886935f));
+	t20 = _mm_add_ps(t28, t22); t22 = _mm_mul_ps(_mm_sub_ps(t28, t22), _mm_set1_ps(0.899976223136f));
+	t28 = _mm_add_ps(t08, t10); t10 = _mm_mul_ps(_mm_sub_ps(t08, t10), _mm_set1_ps(2.56291544774f));
+	t08 = _mm_add_ps(t14, t28); t14 = _mm_mul_ps(_mm_sub_ps(t14, t28), _mm_set1_ps(0.541196100146f));
+	t28 = _mm_add_ps(t16, t20); t20 = _mm_mul_ps(_mm_sub_ps(t16, t20), _mm_set1_ps(1.30656296488f));
+	t16 = _mm_add_ps(t08, t28); t28 = _mm_mul_ps(_mm_sub_ps(t08, t28), _mm_set1_ps(0.707106781187f));
+	t08 = _mm_add_ps(t14, t20); t20 = _mm_mul_ps(_mm_sub_ps(t14, t20), _mm_set1_ps(0.707106781187f));
+	t08 = _mm_add_ps(t08, t20);
+	t14 = _mm_add_ps(t02, t10); t02 = _mm_mul_ps(_mm_sub_ps(t02, t10), _mm_set1_ps(0.541196100146f));
+	t10 = _mm_add_ps(t04, t22); t22 = _mm_mul_ps(_mm_sub_ps(t04, t22), _mm_set1_ps(1.30656296488f));
+	t04 = _mm_add_ps(t14, t10); t10 = _mm_mul_ps(_mm_sub_ps(t14, t10), _mm_set1_ps(0.707106781187f));
+	t14 = _mm_add_ps(t02, t22); t02 = _mm_mul_ps(_mm_sub_ps(t02, t22), _mm_set1_ps(0.707106781187f));
+	t14 = _mm_add_ps(t14, t02); t04 = _mm_add_ps(t04, t14); t14 = _mm_add_ps(t14, t10); t10 = _mm_add_ps(t10, t02);
+	t16 = _mm_add_ps(t16, t04); t04 = _mm_add_ps(t04, t08); t08 = _mm_add_ps(t08, t14); t14 = _mm_add_ps(t14, t28);
+	t28 = _mm_add_ps(t28, t10); t10 = _mm_add_ps(t10, t20); t20 = _mm_add_ps(t20, t02); t21 = _mm_add_ps(t21, t16);
+	t16 = _mm_add_ps(t16, t32); t32 = _mm_add_ps(t32, t04); t04 = _mm_add_ps(t04, t06); t06 = _mm_add_ps(t06, t08);
+	t08 = _mm_add_ps(t08, t18); t18 = _mm_add_ps(t18, t14); t14 = _mm_add_ps(t14, t30); t30 = _mm_add_ps(t30, t28);
+	t28 = _mm_add_ps(t28, t26); t26 = _mm_add_ps(t26, t10); t10 = _mm_add_ps(t10, t12); t12 = _mm_add_ps(t12, t20);
+	t20 = _mm_add_ps(t20, t24); t24 = _mm_add_ps(t24, t02);
+
+	_mm_storeu_ps(a[0], t05); _mm_storeu_ps(b[0], t33);
+	_mm_storeu_ps(a[1], t30); _mm_storeu_ps(b[1], t21);
+	_mm_storeu_ps(a[2], t27); _mm_storeu_ps(b[2], t17);
+	_mm_storeu_ps(a[3], t28); _mm_storeu_ps(b[3], t16);
+	_mm_storeu_ps(a[4], t07); _mm_storeu_ps(b[4], t01);
+	_mm_storeu_ps(a[5], t26); _mm_storeu_ps(b[5], t32);
+	_mm_storeu_ps(a[6], t23); _mm_storeu_ps(b[6], t29);
+	_mm_storeu_ps(a[7], t10); _mm_storeu_ps(b[7], t04);
+	_mm_storeu_ps(a[8], t15); _mm_storeu_ps(b[8], t03);
+	_mm_storeu_ps(a[9], t12); _mm_storeu_ps(b[9], t06);
+	_mm_storeu_ps(a[10], t19); _mm_storeu_ps(b[10], t25);
+	_mm_storeu_ps(a[11], t20); _mm_storeu_ps(b[11], t08);
+	_mm_storeu_ps(a[12], t13); _mm_storeu_ps(b[12], t11);
+	_mm_storeu_ps(a[13], t24); _mm_storeu_ps(b[13], t18);
+	_mm_storeu_ps(a[14], t31); _mm_storeu_ps(b[14], t09);
+	_mm_storeu_ps(a[15], t02); _mm_storeu_ps(b[15], t14);
+}
+
+static void plm_audio_store_v(float *d, float a[16][4], float b[16][4], int ss) {
+	for (int k = 0; k < 16; k++) {
+		d[k] = a[k][ss];
+	}
+	d[16] = 0.0f;
+	for (int k = 1; k < 16; k++) {
+		d[16 + k] = -a[16 - k][ss];
+	}
+	d[32] = -a[0][ss];
+	d[48] = -b[0][ss];
+	for (int k = 1; k < 16; k++) {
+		d[48 + k] = d[48 - k] = -b[k][ss];
+	}
+}
+
+PLM_TARGET_SSE2 void plm_audio_synthesize_sse2(plm_audio_t *self, int out_pos) {
+	float a[2][16][4], b[2][16][4];
+	plm_audio_idct36_sse2(self->sample[0], a[0], b[0]);
+	plm_audio_idct36_sse2(self->sample[1], a[1], b[1]);
+
+	__m128 scale = _mm_set1_ps(self->output_scale);
+	for (int p = 0; p < 3; p++) {
+		// Shifting step
+		self->v_pos = (self->v_pos - 64) & 1023;
+
+		// Build U, windowing; 32 subbands in 8 vectors per channel
+		__m128 u[2][8];
+		for (int ch = 0; ch < 2; ch++) {
+			const float *v = self->V[ch];
+			plm_audio_store_v(self->V[ch] + self->v_pos, a[ch], b[ch], p);
+			for (int i = 0; i < 8; i++) {
+				u[ch][i] = _mm_setzero_ps();
+			}
+
+			int d_index = 512 - (self->v_pos >> 1);
+			int v_index = (self->v_pos % 128) >> 1;
+			while (v_index < 1024) {
+				for (int i = 0; i < 8; i++) {
+					u[ch][i] = _mm_add_ps(u[ch][i], _mm_mul_ps(
+						_mm_loadu_ps(self->D + d_index + i * 4),
+						_mm_loadu_ps(v + v_index + i * 4)
+					));
+				}
+				v_index += 128;
+				d_index += 64;
+			}
+
+			d_index -= (512 - 32);
+			v_index = (128 - 32 + 1024) - v_index;
+			while (v_index < 1024) {
+				for (int i = 0; i < 8; i++) {
+					u[ch][i] = _mm_add_ps(u[ch][i], _mm_mul_ps(
+						_mm_loadu_ps(self->D + d_index + i * 4),
+						_mm_loadu_ps(v + v_index + i * 4)
+					));
+				}
+				v_index += 128;
+				d_index += 64;
+			}
+
+			for (int i = 0; i < 8; i++) {
+				u[ch][i] = _mm_mul_ps(u[ch][i], scale);
+			}
+		}
+
+		// Output samples
+		#ifdef PLM_AUDIO_S16_OUTPUT
+			__m128 hi = _mm_set1_ps(32767.0f);
+			__m128 lo = _mm_set1_ps(-32768.0f);
+			__m128i s16[2][4];
+			for (int ch = 0; ch < 2; ch++) {
+				for (int i = 0; i < 4; i++) {
+					s16[ch][i] = _mm_packs_epi32(
+						_mm_cvttps_epi32(_mm_max_ps(_mm_min_ps(u[ch][i * 2], hi), lo)),
+						_mm_cvttps_epi32(_mm_max_ps(_mm_min_ps(u[ch][i * 2 + 1], hi), lo))
+					);
+				}
+			}
+			#ifdef PLM_AUDIO_SEPARATE_CHANNELS
+				for (int i = 0; i < 4; i++) {
+					_mm_storeu_si128((__m128i *)(self->samples.left + out_pos + i * 8), s16[0][i]);
+					_mm_storeu_si128((__m128i *)(self->samples.right + out_pos + i * 8), s16[1][i]);
+				}
+			#else
+				for (int i = 0; i < 4; i++) {
+					plm_audio_sample_t *out = self->samples.interleaved + ((out_pos + i * 8) << 1);
+					_mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi16(s16[0][i], s16[1][i]));
+					_mm_storeu_si128((__m128i *)(out + 8), _mm_unpackhi_epi16(s16[0][i], s16[1][i]));
+				}
+			#endif
+		#else
+			#ifdef PLM_AUDIO_SEPARATE_CHANNELS
+				for (int i = 0; i < 8; i++) {
+					_mm_storeu_ps(self->samples.left + out_pos + i * 4, u[0][i]);
+					_mm_storeu_ps(self->samples.right + out_pos + i * 4, u[1][i]);
+				}
+			#else
+				for (int i = 0; i < 8; i++) {
+					plm_audio_sample_t *out = self->samples.interleaved + ((out_pos + i * 4) << 1);
+					_mm_storeu_ps(out, _mm_unpacklo_ps(u[0][i], u[1][i]));
+					_mm_storeu_ps(out + 4, _mm_unpackhi_ps(u[0][i], u[1][i]));
+				}
+			#endif
+		#endif
+		out_pos += 32;
+	}
+}
+
+#endif // PLM_SIMD_X86
+
+
+
+// -----------------------------------------------------------------------------
+// plm_simd implementation
+
+int plm_simd_get_supported(void) {
+	#if defined(PLM_SIMD_X86) && defined(_MSC_VER) && !defined(__clang__)
+		int info[4];
+		__cpuid(info, 0);
+		int max_leaf = info[0];
+		__cpuid(info, 1);
+		if (!(info[3] & (1 << 26))) {
+			return PLM_SIMD_SCALAR;
+		}
+		// AVX2 also needs the OS to save the YMM registers (OSXSAVE + XCR0)
+		if (
+			max_leaf >= 7 && (info[2] & (1 << 27)) && (info[2] & (1 << 28)) &&
+			(_xgetbv(0) & 6) == 6
+		) {
+			__cpuidex(info, 7, 0);
+			if (info[1] & (1 << 5)) {
+				return PLM_SIMD_AVX2;
+			}
+		}
+		return PLM_SIMD_SSE2;
+	#elif defined(PLM_SIMD_X86)
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) {
+			return PLM_SIMD_AVX2;
+		}
+		if (__builtin_cpu_supports("sse2")) {
+			return PLM_SIMD_SSE2;
+		}
+		return PLM_SIMD_SCALAR;
+	#elif defined(PLM_SIMD_ARM_NEON)
+		return PLM_SIMD_NEON;
+	#else
+		return PLM_SIMD_SCALAR;
+	#endif
+}
+
+int plm_simd_set_level(int level) {
+	int supported = plm_simd_get_supported();
+	if (supported == PLM_SIMD_NEON && level > PLM_SIMD_SCALAR) {
+		level = PLM_SIMD_NEON;
+	}
+	if (level > supported) {
+		level = supported;
+	}
+	if (level < PLM_SIMD_SCALAR) {
+		level = PLM_SIMD_SCALAR;
+	}
+
+	plm_video_idct_kernel = plm_video_idct;
+	plm_video_mc_kernel = plm_video_mc_scalar;
+	plm_frame_to_bgra_kernel = plm_frame_to_bgra_scalar;
+	plm_frame_row_to_bgra_kernel = plm_frame_row_to_bgra_scalar;
+	plm_audio_synthesize_kernel = plm_audio_synthesize_scalar;
+	#if defined(PLM_SIMD_X86)
+		if (level >= PLM_SIMD_AVX2) {
+			plm_video_idct_kernel = plm_video_idct_avx2;
+		}
+		else if (level >= PLM_SIMD_SSE2) {
+			plm_video_idct_kernel = plm_video_idct_sse2;
+		}
+		if (level >= PLM_SIMD_SSE2) {
+			plm_frame_to_bgra_kernel = plm_frame_to_bgra_sse2;
+			plm_frame_row_to_bgra_kernel = plm_frame_row_to_bgra_sse2;
+			plm_audio_synthesize_kernel = plm_audio_synthesize_sse2;
+			if (plm_video_mc_self_test(plm_video_mc_sse2)) {
+				plm_video_mc_kernel = plm_video_mc_sse2;
+			}
+		}
+	#endif
+	#if defined(PLM_SIMD_ARM_NEON)
+		if (level == PLM_SIMD_NEON && plm_video_mc_self_test(plm_video_mc_neon)) {
+			plm_video_mc_kernel = plm_video_mc_neon;
+		}
+	#endif
+
+	plm_simd_level = level;
+	return level;
+}
+
+int plm_simd_get_level(void) {
+	return plm_simd_level < 0
+		? plm_simd_get_supported()
+		: plm_simd_level;
+}
+
+
+
+#ifdef PLM_PROFILE
+
+// -----------------------------------------------------------------------------
+// plm_profile implementation
+
+#define PLM_PROFILE_MAX_DEPTH 8
+
+static uint64_t plm_profile_ticks[PLM_PROFILE_STAGES];
+static int plm_profile_stack[PLM_PROFILE_MAX_DEPTH];
+static int plm_profile_depth = 0;
+static uint64_t plm_profile_mark = 0;
+
+static void plm_profile_enter(int stage) {
+	uint64_t now = PLM_PROFILE_CLOCK();
+	if (plm_profile_depth > 0) {
+		plm_profile_ticks[plm_profile_stack[plm_profile_depth - 1]] += now - plm_profile_mark;
+	}
+	if (plm_profile_depth < PLM_PROFILE_MAX_DEPTH) {
+		plm_profile_stack[plm_profile_depth] = stage;
+	}
+	plm_profile_depth++;
+	plm_profile_mark = now;
+}
+
+static void plm_profile_leave(void) {
+	uint64_t now = PLM_PROFILE_CLOCK();
+	plm_profile_depth--;
+	int top = plm_profile_depth < PLM_PROFILE_MAX_DEPTH
+		? plm_profile_depth
+		: PLM_PROFILE_MAX_DEPTH - 1;
+	plm_profile_ticks[plm_profile_stack[top]] += now - plm_profile_mark;
+	plm_profile_mark = now;
+}
+
+void plm_profile_get_ticks(uint64_t ticks[PLM_PROFILE_STAGES]) {
+	memcpy(ticks, plm_profile_ticks, sizeof(plm_profile_ticks));
+}
+
+void plm_profile_reset(void) {
+	memset(plm_profile_ticks, 0, sizeof(plm_profile_ticks));
+}
+
+#endif // PLM_PROFILE
+
+
 
 #endif // PL_MPEG_IMPLEMENTATION
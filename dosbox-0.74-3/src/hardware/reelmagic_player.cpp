@@ -25,19 +25,32 @@
 #include "dos_system.h"
 #include "mixer.h"
 
+#include "SDL_thread.h"
 
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
 #include <strings.h>
 
+#include <deque>
 #include <exception>
+#include <map>
 #include <string>
+#include <vector>
 
 //bring in the MPEG-1 decoder library...
 #define PL_MPEG_IMPLEMENTATION
+#define PLM_AUDIO_S16_OUTPUT //ready to mix with "audiolevel" applied
 #include "./reelmagic_pl_mpeg.h"
 
+//bring in the MPEG asset index files...
+#define REELMAGIC_INDEX_IMPLEMENTATION
+#include "./reelmagic_index.h"
+
+//bring in the "magical" f_code recovery...
+#define REELMAGIC_FCODE_IMPLEMENTATION
+#include "./reelmagic_fcode.h"
+
 //global config
 static ReelMagic_PlayerConfiguration _globalDefaultPlayerConfiguration;
 static double _audioLevel = 1.5;
@@ -45,6 +58,11 @@ static Bitu _audioFifoSize = 30;
 static Bitu _audioFifoDispose = 2;
 static Bitu _initialMagicKey = 0x40044041;
 static int _magicalFcodeOverride = 0; //0 = no override
+static bool _decodeThreads = false;
+static Bitu _sliceThreads = 0; //0 = decode slices on the calling thread
+static Bitu _fileReadSize = 32768;
+static std::string _indexCacheDir; //empty = no index files
+static size_t _loopCacheSize = 0; //bytes, 0 = no loop cache
 
 
 
@@ -65,106 +83,372 @@ namespace {
   };
 
   #define ARRAY_COUNT(T) (sizeof(T) / sizeof(T[0]))
+  //
+  // single-producer/single-consumer ring of decoded MPEG audio frames...
+  // the player produces and the mixer channel callback consumes. every index and counter
+  // is only ever written by one side, so the two need no lock between them. the producer
+  // never moves the consumer's index; a clear is a request the consumer carries out the
+  // next time it looks at the ring
+  //
+  // the consumer also keeps the audio clock the player picks video frames by: the decoder
+  // time of the next sample to play. it runs on through short gaps in the audio and only
+  // jumps to the time of a frame when it is way off, e.g. after a seek or looping around
+  //
+  // the frames themselves are only allocated as the producer first fills each ring entry
+  // and go back to a pool shared by all players when the player is destroyed, so players
+  // without audio or that are never played hold no sample storage at all
+  //
+  #if defined(_MSC_VER)
+  #define RM_RING_BARRIER() _ReadWriteBarrier() //x86 keeps stores and loads in order
+  #elif defined(__GNUC__)
+  #define RM_RING_BARRIER() __sync_synchronize()
+  #else
+  #define RM_RING_BARRIER()
+  #endif
   class AudioSampleFIFO {
     struct Frame {
-      bool    produced;
-      Bitu    samplesConsumed;
+      double  time; //decoder time of the first sample
       struct {
         Bit16s left;
         Bit16s right;
       } samples[PLM_AUDIO_SAMPLES_PER_FRAME];
-      inline Frame() : produced(false) {}
     };
-    Frame _fifo[100]; //up to 100 is roughly 512k of RAM
-    const Bitu _fifoMax;
-    const Bitu _disposeFrameCount;
-    Bitu _producePtr;
-    Bitu _consumePtr;
+    std::vector<Frame*> _ring; //one entry always stays free to tell full from empty
+    Bitu _disposeFrameCount;
     Bitu _sampleRate;
 
-    inline void DisposeForProduction() {
-      LOG(LOG_REELMAGIC, LOG_WARN)("Audio FIFO consumer not keeping up. Disposing %u Interleaved Samples", (unsigned)(_disposeFrameCount * ARRAY_COUNT(_fifo[0].samples)));
-      for (Bitu i = 0; i < _disposeFrameCount; ++i) {
-        _fifo[_consumePtr++].produced = false;
-        if (_consumePtr >= _fifoMax) _consumePtr = 0;
-      }
+    //producer side...
+    volatile Bitu _producePtr;
+    volatile Bitu _clearSerial;
+    volatile Bitu _clearPtr;
+    Bitu _disposeRemaining;
+    volatile Bitu _samplesDropped;
+
+    //consumer side...
+    volatile Bitu _consumePtr;
+    volatile Bitu _samplesConsumed; //of the frame at _consumePtr
+    Bitu _clearSerialSeen;
+    Bitu _samplesRepeating; //since the consumer ran dry
+    volatile Bitu _samplesDuplicated;
+    volatile double _clock;
+    volatile bool _clockValid;
+
+    static double ClockTolerance() {return 0.1;} //seconds
+
+    static std::vector<Frame*>& FramePool() {
+      static std::vector<Frame*> pool;
+      return pool;
+    }
+    static Frame *AcquireFrame() {
+      std::vector<Frame*>& pool = FramePool();
+      if (pool.empty()) return new Frame;
+      Frame * const rv = pool.back();
+      pool.pop_back();
+      return rv;
+    }
+    static void ReleaseFrame(Frame * const frame) {
+      //keep one player's worth of frames around for the next player to use...
+      std::vector<Frame*>& pool = FramePool();
+      if (pool.size() <= ComputeFifoSize(FIFO_SIZE_RATE)) pool.push_back(frame);
+      else delete frame;
     }
 
-    inline Bit16u ConvertSample(const double samp) {
-      return (Bit16u)(samp * 32767.0 * _audioLevel);
+    inline Bitu Next(const Bitu ptr) const {
+      return ((ptr + 1) < _ring.size()) ? (ptr + 1) : 0;
     }
 
-    static Bitu ComputeFifoMax(const Bitu fifoMax) {
-      Bitu rv = _audioFifoSize;
-      if (rv > fifoMax) {
-        rv = fifoMax;
-        LOG(LOG_REELMAGIC, LOG_WARN)("Requested audio FIFO size %u is too big. Limiting to %u", (unsigned)_audioFifoSize, (unsigned)rv);
-      }
-      return rv;
+    //"audiofifosize" counts MPEG audio frames at 44.1kHz... streams at other rates get
+    //as many frames as hold the same length of audio
+    enum { FIFO_SIZE_MIN = 2, FIFO_SIZE_MAX = 100, FIFO_SIZE_RATE = 44100 };
+    static Bitu ComputeFifoSize(const Bitu sampleRate) {
+      //"audiofifosize" is already within range (see LimitConfig())
+      const Bitu rv = ((_audioFifoSize * sampleRate) + FIFO_SIZE_RATE - 1) / FIFO_SIZE_RATE;
+      return (rv < FIFO_SIZE_MIN) ? FIFO_SIZE_MIN : rv;
     }
 
     static Bitu ComputeDisposeFrameCount(const Bitu fifoSize) {
-      Bitu rv = _audioFifoDispose;
-      if (rv > fifoSize) {
-        rv = fifoSize;
-        LOG(LOG_REELMAGIC, LOG_WARN)("Requested audio FIFO dispose frame count %u is too big. Limiting to %u", (unsigned)_audioFifoDispose, (unsigned)rv);
-      }
-      return rv;
+      return (_audioFifoDispose > fifoSize) ? fifoSize : _audioFifoDispose;
+    }
+
+    inline void ApplyClear() {
+      if (_clearSerialSeen == _clearSerial) return;
+      _clearSerialSeen = _clearSerial;
+      RM_RING_BARRIER();
+      _consumePtr = _clearPtr;
+      _samplesConsumed = 0;
+      _samplesRepeating = 0;
+      _clockValid = false;
     }
 
   public:
+    static void LimitConfig() {
+      //called once the config is read... the FIFO sizes are computed from these again
+      //and again, so they are brought into range and warned about just here
+      if (((Bits)_audioFifoSize < FIFO_SIZE_MIN) || (_audioFifoSize > FIFO_SIZE_MAX)) {
+        const Bitu limited = ((Bits)_audioFifoSize < FIFO_SIZE_MIN) ? FIFO_SIZE_MIN : FIFO_SIZE_MAX;
+        LOG(LOG_REELMAGIC, LOG_WARN)("Requested audio FIFO size %d is out of range. Limiting to %u", (int)_audioFifoSize, (unsigned)limited);
+        _audioFifoSize = limited;
+      }
+      if (_audioFifoDispose > _audioFifoSize) {
+        LOG(LOG_REELMAGIC, LOG_WARN)("Requested audio FIFO dispose frame count %d is too big. Limiting to %u", (int)_audioFifoDispose, (unsigned)_audioFifoSize);
+        _audioFifoDispose = _audioFifoSize;
+      }
+    }
+
     AudioSampleFIFO() :
-      _fifoMax(ComputeFifoMax(ARRAY_COUNT(_fifo))),
-      _disposeFrameCount(ComputeDisposeFrameCount(_fifoMax)),
-      _producePtr(0), _consumePtr(0), _sampleRate(0) { }
+      _ring(ComputeFifoSize(FIFO_SIZE_RATE) + 1, (Frame*)NULL),
+      _disposeFrameCount(ComputeDisposeFrameCount(_ring.size() - 1)),
+      _sampleRate(0),
+      _producePtr(0), _clearSerial(0), _clearPtr(0), _disposeRemaining(0), _samplesDropped(0),
+      _consumePtr(0), _samplesConsumed(0), _clearSerialSeen(0), _samplesRepeating(0), _samplesDuplicated(0),
+      _clock(0.0), _clockValid(false) { }
+    ~AudioSampleFIFO() {
+      //the consumer must no longer be using this FIFO by now...
+      for (Bitu i = 0; i < _ring.size(); ++i) {
+        if (_ring[i] != NULL) ReleaseFrame(_ring[i]);
+      }
+    }
     inline Bitu GetSampleRate() const {return _sampleRate;}
-    inline void SetSampleRate(const Bitu value) {_sampleRate = value;}
+    void SetSampleRate(const Bitu value) {
+      //the stream is set up before anything gets produced, so the ring is still empty
+      //and the consumer doesn't look at it yet...
+      _sampleRate = value;
+      if ((value == 0) || (_producePtr != 0)) return;
+      _ring.assign(ComputeFifoSize(value) + 1, (Frame*)NULL);
+      _disposeFrameCount = ComputeDisposeFrameCount(_ring.size() - 1);
+    }
+    inline Bitu GetSamplesDropped() const {return _samplesDropped;}
+    inline Bitu GetSamplesDuplicated() const {return _samplesDuplicated;}
 
     //consumer -- 1 sample include left and right
     inline Bitu SamplesAvailableForConsumption() {
-      const Frame& f = _fifo[_consumePtr];
-      if (!f.produced) return 0;
-      return ARRAY_COUNT(f.samples) - f.samplesConsumed;
+      ApplyClear();
+      if (_consumePtr == _producePtr) return 0;
+      RM_RING_BARRIER();
+      _samplesDuplicated += _samplesRepeating;
+      _samplesRepeating = 0;
+      if (_samplesConsumed == 0) {
+        const double frameTime = _ring[_consumePtr]->time;
+        if ((!_clockValid) || (frameTime < (_clock - ClockTolerance())) || (frameTime > (_clock + ClockTolerance()))) {
+          _clock = frameTime;
+          _clockValid = true;
+        }
+      }
+      return ARRAY_COUNT(_ring[0]->samples) - _samplesConsumed;
     }
     inline const Bit16s *GetConsumableInterleavedSamples() {
-      const Frame& f = _fifo[_consumePtr];
-      return &f.samples[f.samplesConsumed].left;
+      return &_ring[_consumePtr]->samples[_samplesConsumed].left;
     }
     inline void Consume(const Bitu sampleCount) {
-      Frame& f = _fifo[_consumePtr];
-      f.samplesConsumed += sampleCount;
-      if (f.samplesConsumed >= ARRAY_COUNT(f.samples)) {
-        f.produced = false;
-        if (++_consumePtr >= _fifoMax) _consumePtr = 0;
+      _clock = _clock + ((double)sampleCount / (double)_sampleRate);
+      const Bitu consumed = _samplesConsumed + sampleCount;
+      if (consumed < ARRAY_COUNT(_ring[0]->samples)) {
+        _samplesConsumed = consumed;
+        return;
+      }
+      RM_RING_BARRIER();
+      _samplesConsumed = 0;
+      _consumePtr = Next(_consumePtr);
+    }
+    inline void Duplicated(const Bitu sampleCount) {
+      //the consumer ran dry and repeated what it played last... once that goes on for
+      //too long, playback has stopped rather than fallen behind
+      if (!_clockValid) return;
+      _samplesRepeating += sampleCount;
+      _clock = _clock + ((double)sampleCount / (double)_sampleRate);
+      if (_samplesRepeating > (ClockTolerance() * _sampleRate)) {
+        _samplesRepeating = 0;
+        _clockValid = false;
       }
     }
 
     //producer...
     inline void Produce(const plm_samples_t& s) {
-      Frame& f = _fifo[_producePtr];
-      if (f.produced) DisposeForProduction(); //WARNING dropping samples !?
-
-      for (Bitu i = 0; i < ARRAY_COUNT(s.interleaved); i+=2) {
-        f.samples[i >> 1].left  = ConvertSample(s.interleaved[i]);
-        f.samples[i >> 1].right = ConvertSample(s.interleaved[i+1]);
+      if (_sampleRate == 0) return;
+      if (_disposeRemaining == 0) {
+        //a clear the consumer hasn't got to yet already freed everything up to _clearPtr...
+        const Bitu consumePtr = (_clearSerialSeen != _clearSerial) ? _clearPtr : _consumePtr;
+        if (Next(_producePtr) == consumePtr) {
+          LOG(LOG_REELMAGIC, LOG_WARN)("Audio FIFO consumer not keeping up. Disposing %u Interleaved Samples", (unsigned)(_disposeFrameCount * ARRAY_COUNT(_ring[0]->samples)));
+          _disposeRemaining = (_disposeFrameCount > 0) ? _disposeFrameCount : 1;
+        }
+      }
+      if (_disposeRemaining > 0) {
+        //WARNING dropping samples !? (the consumer owns the queued ones, so these go instead)
+        --_disposeRemaining;
+        _samplesDropped += ARRAY_COUNT(_ring[0]->samples);
+        return;
       }
 
-      f.samplesConsumed = 0;
-      f.produced = true;
-      if (++_producePtr >= _fifoMax) _producePtr = 0;
+      if (_ring[_producePtr] == NULL) _ring[_producePtr] = AcquireFrame();
+      Frame& f = *_ring[_producePtr];
+      f.time = s.time;
+      memcpy(f.samples, s.interleaved, sizeof(f.samples));
+      RM_RING_BARRIER();
+      _producePtr = Next(_producePtr);
     }
     inline void Clear() {
-      for (Bitu i = 0; i < _fifoMax; ++i) {
-        _fifo[i].produced = false;
+      //have the consumer drop everything produced so far...
+      _clearPtr = _producePtr;
+      RM_RING_BARRIER();
+      ++_clearSerial;
+      _disposeRemaining = 0;
+    }
+
+    //false if there is no audio clock, i.e. the consumer ran dry for a while or has
+    //yet to catch up with a Clear()
+    bool GetClock(double& clock) const {
+      if ((_clearSerialSeen != _clearSerial) || (!_clockValid)) return false;
+      clock = _clock;
+      return true;
+    }
+  };
+
+  //
+  // one entry of a player's decoded-frame ring...
+  // pl_mpeg reuses its internal frame buffers, so decoded pictures are copied out here
+  // together with the audio decoded along with them and where the demuxer was at that time
+  //
+  struct DecodedFrame {
+    bool                        hasFrame; //false marks the end of the stream
+    bool                        skipped;  //a B picture that was not decoded; planes are stale
+    plm_frame_t                 frame;
+    std::vector<uint8_t>        planes;
+    std::vector<plm_samples_t>  audio;
+    size_t                      demuxPosition;
+
+    DecodedFrame() : hasFrame(false), skipped(false), demuxPosition(0) {
+      memset(&frame, 0, sizeof(frame));
+    }
+
+    void CopyFrame(const plm_frame_t& src, const bool skippedPicture = false) {
+      const size_t ySize  = src.y.width * src.y.height;
+      const size_t crSize = src.cr.width * src.cr.height;
+      const size_t cbSize = src.cb.width * src.cb.height;
+      if (planes.size() != (ySize + crSize + cbSize)) planes.resize(ySize + crSize + cbSize);
+      frame = src;
+      frame.y.data  = &planes[0];
+      frame.cr.data = frame.y.data + ySize;
+      frame.cb.data = frame.cr.data + crSize;
+      if (!skippedPicture) {
+        memcpy(frame.y.data,  src.y.data,  ySize);
+        memcpy(frame.cr.data, src.cr.data, crSize);
+        memcpy(frame.cb.data, src.cb.data, cbSize);
       }
-      _producePtr = 0;
-      _consumePtr = 0;
+      hasFrame = true;
+      skipped = skippedPicture;
+    }
+  };
+
+  //
+  // worker threads shared by all players to decode the slices of a picture in parallel...
+  // (only used when "slicethreads" is non-zero)
+  // one picture at a time is spread across the workers and the thread that asked for it
+  // joins in; if another player's picture is already in flight, the slices are decoded inline
+  //
+  class SliceThreadPool {
+    SDL_mutex *_mutex;
+    SDL_cond  *_cond;
+    bool       _busy;
+    bool       _quit;
+    std::vector<SDL_Thread*> _threads;
+    void     (*_job)(void *arg, int index);
+    void      *_arg;
+    int        _count;
+    int        _next;
+    int        _done;
+
+    //must be called with _mutex locked...
+    void RunJobs() {
+      while (_next < _count) {
+        const int index = _next++;
+        SDL_mutexV(_mutex);
+        _job(_arg, index);
+        SDL_mutexP(_mutex);
+        if (++_done == _count) SDL_CondBroadcast(_cond);
+      }
+    }
+
+    static int SDLCALL WorkerThreadMain(void *data) {
+      SliceThreadPool * const pool = (SliceThreadPool*)data;
+      SDL_mutexP(pool->_mutex);
+      for (;;) {
+        pool->RunJobs();
+        if (pool->_quit) break;
+        SDL_CondWait(pool->_cond, pool->_mutex);
+      }
+      SDL_mutexV(pool->_mutex);
+      return 0;
+    }
+
+  public:
+    SliceThreadPool(const Bitu threadCount) :
+      _mutex(SDL_CreateMutex()), _cond(SDL_CreateCond()), _busy(false), _quit(false),
+      _job(NULL), _arg(NULL), _count(0), _next(0), _done(0) {
+      for (Bitu i = 0; i < threadCount; ++i) {
+        SDL_Thread * const thread = SDL_CreateThread(&WorkerThreadMain, this);
+        if (thread == NULL) {
+          LOG(LOG_REELMAGIC, LOG_WARN)("Failed to create MPEG slice thread #%u", (unsigned)i);
+          break;
+        }
+        _threads.push_back(thread);
+      }
+    }
+    ~SliceThreadPool() {
+      SDL_mutexP(_mutex);
+      _quit = true;
+      SDL_CondBroadcast(_cond);
+      SDL_mutexV(_mutex);
+      for (size_t i = 0; i < _threads.size(); ++i) SDL_WaitThread(_threads[i], NULL);
+      SDL_DestroyCond(_cond);
+      SDL_DestroyMutex(_mutex);
+    }
+
+    void Run(void (*job)(void *arg, int index), void *arg, const int count) {
+      SDL_mutexP(_mutex);
+      if (_busy) {
+        SDL_mutexV(_mutex);
+        for (int i = 0; i < count; ++i) job(arg, i);
+        return;
+      }
+      _busy = true;
+      _job = job; _arg = arg;
+      _count = count; _next = 0; _done = 0;
+      SDL_CondBroadcast(_cond);
+      RunJobs();
+      while (_done < _count) SDL_CondWait(_cond, _mutex);
+      _count = 0; _next = 0;
+      _busy = false;
+      SDL_mutexV(_mutex);
+    }
+
+    static void plmParallelCallback(void (*job)(void *arg, int index), void *arg, int count, void *user) {
+      ((SliceThreadPool*)user)->Run(job, arg, count);
     }
   };
 }
 
+static SliceThreadPool *_sliceThreadPool = NULL;
+
+//every asset index loaded or built this session, by asset size and hash... assets that
+//could not be indexed are kept too, so nothing gets scanned twice even when its index
+//file can't be written (read-only directory, ...)
+struct IndexCacheEntry {
+  bool    valid;
+  rmidx_t index;
+};
+typedef std::map<std::pair<Bit32u, Bit64u>, IndexCacheEntry> IndexCache;
+static IndexCache _indexCache;
+
+static void ClearIndexCache() {
+  for (IndexCache::iterator it = _indexCache.begin(); it != _indexCache.end(); ++it)
+    rmidx_free(&it->second.index);
+  _indexCache.clear();
+}
+
 static void ActivatePlayerAudioFifo(AudioSampleFIFO& fifo);
 static void DeactivatePlayerAudioFifo(AudioSampleFIFO& fifo);
+static bool IsActivePlayerAudioFifo(const AudioSampleFIFO& fifo);
 
 
 
@@ -180,6 +464,8 @@ namespace { class ReelMagic_MediaPlayerImplementation : public ReelMagic_MediaPl
   // running / adjustable variables...
   bool                                _stopOnComplete;
   bool                                _playing;
+  bool                                _statsReported; //since playback last started
+  Bitu                                _bytesReadThroughDOS; //none when decoding from a host mapping
 
   // output state...
   float                               _vgaFps;
@@ -187,27 +473,326 @@ namespace { class ReelMagic_MediaPlayerImplementation : public ReelMagic_MediaPl
   double                              _waitVgaFramesUntilNextMpegFrame;
   bool                                _drawNextFrame;
 
+  bool                                _pictureOutdated;  //_shownPicture is behind _nextFrame
+  DecodedFrame                       *_shownPicture;     //the picture on display; the mixer converts just the rows and columns it needs
+  DecodedFrame                        _shownPictureCopy; //holds it when it isn't in a ring or loop cache entry (see DetachShownPicture())
+
+  //catching up... B pictures that are passed over in a refresh are never decoded, and
+  //while the video trails the audio too far, they are not decoded or shown at all. the
+  //same goes while the video output is hidden, as only the timing matters then
+  bool                                _nextFrameSkipped; //_nextFrame is a B picture that was not decoded
+  bool                                _presentIPOnly;
+  Bitu                                _catchUpRefreshes;
+  Bitu                                _picturesSkipped; //passed over while catching up
+  Bitu                                _picturesDropped; //not shown while presenting I/P pictures only
+
   //stuff about the MPEG decoder...
   plm_t                              *_plm;
   plm_frame_t                        *_nextFrame;
+  DecodedFrame                       *_nextDecodedFrame; //ring or loop cache entry holding _nextFrame; NULL if it is pl_mpeg's own
   double                              _framerate;
-  Bit8u                               _magicalRSizeOverride;
+  rmfc_t                              _magicalFCodes;
+  const rmidx_t                      *_index;        //in _indexCache; NULL if there is none (yet)
+  Bit64u                              _indexHash;
+  bool                                _indexPending; //no index file; the asset is scanned when first seeked into
+
+  //stuff about stream mode... (the application hands over the data as it plays)
+  //the decoder is opened once enough of the stream has come in to detect it
+  enum { STREAM_PROBE_SIZE = 32 * 1024 };
+  plm_buffer_t                       *_streamBuffer; //not NULL until the decoder is opened
+  bool                                _streamPlayPending;
+  PlayMode                            _streamPlayMode;
 
   AudioSampleFIFO                     _audioFifo;
 
+  //stuff about the decode thread... (only used when "decodethreads" is enabled)
+  //the worker owns _plm while it is running and not parked. it never touches the DOS
+  //file; instead the emulation thread keeps a read-ahead buffer topped up for it...
+  enum { DECODE_RING_SIZE = 7, READ_AHEAD_SIZE = 256 * 1024, READ_AHEAD_CHUNK = 32 * 1024 };
+  SDL_Thread                         *_worker;
+  Uint32                              _workerThreadId;
+  SDL_mutex                          *_workerMutex;
+  SDL_cond                           *_workerCond;
+  bool                                _workerQuit;
+  bool                                _workerParkRequest;
+  bool                                _workerParked;
+  bool                                _workerAbort;
+  bool                                _workerEnded;
+  bool                                _workerLoop;
+  bool                                _workerSkipB;
+  DecodedFrame                        _ring[DECODE_RING_SIZE];
+  Bitu                                _ringHead; //next entry to display; the two entries before it hold _nextFrame and maybe _shownPicture
+  Bitu                                _ringCount;
+  size_t                              _displayDemuxPosition;
+  std::vector<plm_samples_t>          _pendingAudio; //popped but not yet handed to _audioFifo
+  std::vector<Bit8u>                  _readAhead;
+  size_t                              _readAheadStart;
+  size_t                              _readAheadUsed;
+  bool                                _readAheadEnded;
+  bool                                _readAheadSeekPending;
+  size_t                              _readAheadSeekPos;
+
+  //stuff about the loop cache... (only used when "loopcachemb" is non-zero)
+  //the frames shown during one pass of a looping clip are copied here along with their
+  //audio. later passes are played back from here while the decoder sits idle
+  enum LoopCacheState {
+    LOOPCACHE_OFF,       //not looping or the clip doesn't fit
+    LOOPCACHE_ARMED,     //looping; recording starts once the clip comes around
+    LOOPCACHE_RECORDING, //first pass from the start of the clip
+    LOOPCACHE_PLAYING    //later passes come from _loopCache
+  };
+  LoopCacheState                      _loopCacheState;
+  std::deque<DecodedFrame>            _loopCache; //a deque so entries never move while on display
+  size_t                              _loopCacheBytes;
+  Bitu                                _loopCachePos; //next entry to display when playing
+  double                              _loopCacheLastTime;
+
+  Bit32u ReadFile(Bit8u * const data, const Bit32u amount) {
+    //called on the emulation thread only...
+    const Bit32u bytesRead = _file->Read(data, amount);
+    _bytesReadThroughDOS += bytesRead;
+    return bytesRead;
+  }
+
+  inline bool OnWorkerThread() const {
+    return (_worker != NULL) && (SDL_ThreadID() == _workerThreadId);
+  }
+
+  void LoadFromReadAhead(plm_buffer_t * const buf) {
+    //called on the worker thread... blocks until the emulation thread has provided data
+    plm_buffer_make_room(buf, _fileReadSize);
+    size_t wanted = buf->capacity - buf->length;
+    if (wanted > _fileReadSize) wanted = _fileReadSize;
+
+    SDL_mutexP(_workerMutex);
+    while ((!_workerAbort) && (_readAheadSeekPending || ((_readAheadUsed < wanted) && (!_readAheadEnded))))
+      SDL_CondWait(_workerCond, _workerMutex);
+    if (_workerAbort || (_readAheadUsed == 0)) {
+      buf->has_ended = TRUE;
+    }
+    else {
+      if (wanted > _readAheadUsed) wanted = _readAheadUsed;
+      for (size_t copied = 0, amount; copied < wanted; copied += amount) {
+        amount = wanted - copied;
+        if (amount > (_readAhead.size() - _readAheadStart)) amount = _readAhead.size() - _readAheadStart;
+        memcpy(buf->bytes + buf->length + copied, &_readAhead[_readAheadStart], amount);
+        _readAheadStart += amount;
+        if (_readAheadStart >= _readAhead.size()) _readAheadStart = 0;
+      }
+      _readAheadUsed -= wanted;
+      buf->length += wanted;
+    }
+    SDL_mutexV(_workerMutex);
+  }
+
+  void ServiceReadAhead() {
+    //called on the emulation thread... this is the only place the DOS file is touched
+    //while the worker is running...
+    if ((_worker == NULL) || _readAhead.empty()) return; //empty when decoding from a host mapping
+    SDL_mutexP(_workerMutex);
+    if (!_workerParkRequest) {
+      try {
+        if (_readAheadSeekPending) {
+          _readAheadSeekPending = false;
+          _readAheadStart = 0;
+          _readAheadUsed = 0;
+          _readAheadEnded = false;
+          _file->Seek((Bit32u)_readAheadSeekPos, DOS_SEEK_SET);
+        }
+        while ((!_readAheadEnded) && (_readAheadUsed < _readAhead.size())) {
+          const size_t tail = (_readAheadStart + _readAheadUsed) % _readAhead.size();
+          size_t amount = _readAhead.size() - _readAheadUsed;
+          if (amount > (_readAhead.size() - tail)) amount = _readAhead.size() - tail;
+          if (amount > READ_AHEAD_CHUNK) amount = READ_AHEAD_CHUNK;
+          const Bit32u bytesRead = ReadFile(&_readAhead[tail], (Bit32u)amount);
+          if (bytesRead == 0) _readAheadEnded = true;
+          _readAheadUsed += bytesRead;
+        }
+      }
+      catch (...) {
+        _readAheadEnded = true;
+      }
+    }
+    SDL_CondBroadcast(_workerCond);
+    SDL_mutexV(_workerMutex);
+  }
+
+  static int SDLCALL WorkerThreadMain(void *user) {
+    ((ReelMagic_MediaPlayerImplementation*)user)->WorkerLoop();
+    return 0;
+  }
+
+  void WorkerLoop() {
+    SDL_mutexP(_workerMutex);
+    _workerThreadId = SDL_ThreadID();
+    for (;;) {
+      while (!_workerQuit) {
+        if (_workerParkRequest) {
+          _workerParked = true;
+          SDL_CondBroadcast(_workerCond);
+        }
+        else if ((!_workerEnded) && (_ringCount < (DECODE_RING_SIZE - 2))) {
+          break;
+        }
+        SDL_CondWait(_workerCond, _workerMutex);
+      }
+      _workerParked = false;
+      if (_workerQuit) break;
+
+      plm_set_loop(_plm, _workerLoop ? TRUE : FALSE);
+      plm_video_set_skip_b_pictures(_plm->video_decoder, _workerSkipB ? TRUE : FALSE);
+      DecodedFrame& df = _ring[(_ringHead + _ringCount) % DECODE_RING_SIZE];
+      SDL_mutexV(_workerMutex);
+
+      plm_frame_t *frame = plm_decode_video(_plm);
+      if ((frame == NULL) && plm_get_loop(_plm)) frame = plm_decode_video(_plm); //see advanceNextFrame()
+      df.hasFrame = false;
+      if (frame != NULL) df.CopyFrame(*frame, plm_video_get_frame_skipped(_plm->video_decoder) ? true : false);
+      df.audio.clear();
+      decodeBufferedAudio(df.audio);
+      df.demuxPosition = plm_buffer_tell(_plm->demux->buffer);
+
+      SDL_mutexP(_workerMutex);
+      if (_workerAbort) continue; //whoever aborted us is about to reposition the decoder
+      ++_ringCount;
+      if (!df.hasFrame) _workerEnded = true;
+      SDL_CondBroadcast(_workerCond);
+    }
+    SDL_mutexV(_workerMutex);
+  }
+
+  void StartWorker() {
+    _workerMutex = SDL_CreateMutex();
+    _workerCond = SDL_CreateCond();
+    _workerQuit = false;
+    _workerParkRequest = true; //start parked, AdoptCurrentFrame() will release it
+    _workerParked = false;
+    _workerAbort = false;
+    _workerSkipB = false;
+    if (_file->GetHostMapping() == NULL) _readAhead.resize(READ_AHEAD_SIZE);
+    _worker = SDL_CreateThread(&WorkerThreadMain, this);
+    if (_worker == NULL) {
+      LOG(LOG_REELMAGIC, LOG_WARN)("Media Player #%u failed to create decode thread. Decoding on the emulation thread.", (unsigned)_attrs.Handles.Master);
+      DestroyWorkerSync();
+      return;
+    }
+    LOG(LOG_REELMAGIC, LOG_NORMAL)("Media Player #%u started decode thread", (unsigned)_attrs.Handles.Master);
+    SDL_mutexP(_workerMutex);
+    while (!_workerParked) SDL_CondWait(_workerCond, _workerMutex);
+    SDL_mutexV(_workerMutex);
+    AdoptCurrentFrame();
+  }
+
+  void DestroyWorkerSync() {
+    if (_worker != NULL) {
+      SDL_mutexP(_workerMutex);
+      _workerQuit = true;
+      _workerAbort = true;
+      SDL_CondBroadcast(_workerCond);
+      SDL_mutexV(_workerMutex);
+      SDL_WaitThread(_worker, NULL);
+      _worker = NULL;
+    }
+    if (_workerCond != NULL) SDL_DestroyCond(_workerCond);
+    if (_workerMutex != NULL) SDL_DestroyMutex(_workerMutex);
+    _workerCond = NULL;
+    _workerMutex = NULL;
+  }
+
+  void ParkWorker() {
+    //stops the worker at the top of its loop, abandoning whatever it is decoding...
+    //the caller owns _plm afterwards and MUST reposition it before UnparkWorker()
+    SDL_mutexP(_workerMutex);
+    _workerParkRequest = true;
+    _workerAbort = true;
+    SDL_CondBroadcast(_workerCond);
+    while (!_workerParked) SDL_CondWait(_workerCond, _workerMutex);
+    SDL_mutexV(_workerMutex);
+    plm_video_set_skip_b_pictures(_plm->video_decoder, FALSE);
+  }
+
+  void AdoptCurrentFrame() {
+    //the worker must be parked here... takes what the emulation thread decoded in
+    //_nextFrame and makes it the frame on display, then lets the worker go from there
+    DetachShownPicture(); //the whole ring is rewritten
+    DecodedFrame& df = _ring[0];
+    df.hasFrame = false;
+    if (_nextFrame != NULL) df.CopyFrame(*_nextFrame, _nextFrameSkipped);
+    df.audio.clear();
+    df.demuxPosition = plm_buffer_tell(_plm->demux->buffer);
+    _nextFrame = df.hasFrame ? &df.frame : NULL;
+    _nextDecodedFrame = df.hasFrame ? &df : NULL;
+    _displayDemuxPosition = df.demuxPosition;
+    _pendingAudio.clear();
+    decodeBufferedAudio(_pendingAudio);
+
+    SDL_mutexP(_workerMutex);
+    _ringHead = 1;
+    _ringCount = 0;
+    _workerEnded = (_nextFrame == NULL);
+    _readAheadStart = 0;
+    _readAheadUsed = 0;
+    _readAheadEnded = false;
+    _readAheadSeekPending = false;
+    _workerAbort = false;
+    _workerParkRequest = false;
+    SDL_CondBroadcast(_workerCond);
+    SDL_mutexV(_workerMutex);
+    ServiceReadAhead();
+  }
+
+  void popNextFrame() {
+    //the emulation thread side of advanceNextFrame() when the worker is running...
+    SDL_mutexP(_workerMutex);
+    while ((_ringCount == 0) && (!_workerEnded)) {
+      //the worker may well be waiting on us for file data...
+      SDL_mutexV(_workerMutex);
+      ServiceReadAhead();
+      SDL_mutexP(_workerMutex);
+      if ((_ringCount == 0) && (!_workerEnded)) SDL_CondWaitTimeout(_workerCond, _workerMutex, 5);
+    }
+    if (_ringCount == 0) {
+      //already handed out the end of the stream...
+      SDL_mutexV(_workerMutex);
+      _nextFrame = NULL;
+      _nextDecodedFrame = NULL;
+      _playing = false;
+      return;
+    }
+    //the worker may write the entry two before the head from here on
+    if (_shownPicture == &_ring[(_ringHead + DECODE_RING_SIZE - 2) % DECODE_RING_SIZE]) DetachShownPicture();
+    DecodedFrame& df = _ring[_ringHead];
+    if (++_ringHead >= DECODE_RING_SIZE) _ringHead = 0;
+    --_ringCount;
+    SDL_CondBroadcast(_workerCond);
+    SDL_mutexV(_workerMutex);
+
+    _pendingAudio.insert(_pendingAudio.end(), df.audio.begin(), df.audio.end());
+    df.audio.clear();
+    _displayDemuxPosition = df.demuxPosition;
+    _nextFrame = df.hasFrame ? &df.frame : NULL;
+    _nextDecodedFrame = df.hasFrame ? &df : NULL;
+    _nextFrameSkipped = df.skipped;
+    if (_nextFrame == NULL) _playing = false;
+  }
+
   static void plmBufferLoadCallback(plm_buffer_t *self, void *user) {
     //note: based on plm_buffer_load_file_callback()
+    ReelMagic_MediaPlayerImplementation * const player = (ReelMagic_MediaPlayerImplementation*)user;
+    if (player->OnWorkerThread()) {
+      player->LoadFromReadAhead(self);
+      return;
+    }
     try {
-      if (self->discard_read_bytes) {
-        plm_buffer_discard_read_bytes(self);
-      }
+      //only shift the unread data down once the next read no longer fits behind it...
+      plm_buffer_make_room(self, _fileReadSize);
       size_t bytes_available = self->capacity - self->length;
-      if (bytes_available > 4096) bytes_available = 4096;
-      const Bit32u bytes_read = ((ReelMagic_MediaPlayerImplementation*)user)->
-        _file->Read(self->bytes + self->length, bytes_available);
+      if (bytes_available > _fileReadSize) bytes_available = _fileReadSize;
+      const Bit32u bytes_read = player->ReadFile(self->bytes + self->length, bytes_available);
       self->length += bytes_read;
 
-      if (bytes_read == 0) {
+      //a stream is only waiting on the application for more...
+      if ((bytes_read == 0) && player->_file->HasStreamEnded()) {
         self->has_ended = TRUE;
       }
     }
@@ -216,101 +801,218 @@ namespace { class ReelMagic_MediaPlayerImplementation : public ReelMagic_MediaPl
     }
   }
   static void plmBufferSeekCallback(plm_buffer_t *self, void *user, size_t absPos) {
+    ReelMagic_MediaPlayerImplementation * const player = (ReelMagic_MediaPlayerImplementation*)user;
+    if (player->OnWorkerThread()) {
+      //looping... have the emulation thread do the seek for us...
+      SDL_mutexP(player->_workerMutex);
+      player->_readAheadSeekPending = true;
+      player->_readAheadSeekPos = absPos;
+      player->_readAheadStart = 0;
+      player->_readAheadUsed = 0;
+      player->_readAheadEnded = false;
+      SDL_mutexV(player->_workerMutex);
+      return;
+    }
+    if (player->_file->IsStream()) {
+      LOG(LOG_REELMAGIC, LOG_WARN)("Media Player #%u Can't Seek a Stream to 0x%X", (unsigned)player->_attrs.Handles.Master, (unsigned)absPos);
+      return;
+    }
     try {
-      ((ReelMagic_MediaPlayerImplementation*)user)->
-        _file->Seek(absPos, DOS_SEEK_SET);
+      player->_file->Seek(absPos, DOS_SEEK_SET);
     }
     catch (...) {
       //XXX what to do on failure !?
     }
   }
 
-  static void plmDecodeMagicalPictureHeaderCallback(plm_video_t *self, void *user) {
-    switch (self->picture_type) {
-    case PLM_VIDEO_PICTURE_TYPE_B:
-      self->motion_backward.r_size = ((ReelMagic_MediaPlayerImplementation*)user)->_magicalRSizeOverride;
-      //fallthrough
-    case PLM_VIDEO_PICTURE_TYPE_PREDICTIVE:
-      self->motion_forward.r_size = ((ReelMagic_MediaPlayerImplementation*)user)->_magicalRSizeOverride;
+  void advanceNextFrame(const bool willDisplay = true) {
+    if (_loopCacheState == LOOPCACHE_PLAYING) {
+      popCachedFrame();
+      return;
+    }
+    if (_worker != NULL) {
+      popNextFrame();
+    }
+    else {
+      const bool skipB = (!willDisplay) ? (_loopCacheState == LOOPCACHE_OFF) : SkipBPictures();
+      if (skipB) plm_video_set_skip_b_pictures(_plm->video_decoder, TRUE);
+      decodeNextFrame();
+      if (skipB) {
+        _nextFrameSkipped = (_nextFrame != NULL) && plm_video_get_frame_skipped(_plm->video_decoder);
+        plm_video_set_skip_b_pictures(_plm->video_decoder, FALSE);
+      }
+    }
+    if (_nextFrameSkipped && _config.VideoOutputVisible) {
+      if (willDisplay) ++_picturesDropped;
+      else ++_picturesSkipped;
+    }
+    if (_loopCacheState != LOOPCACHE_OFF) recordCachedFrame();
+  }
+
+  void popCachedFrame() {
+    if (_loopCachePos >= _loopCache.size()) {
+      if (!_workerLoop) {
+        //looping was turned off during this pass... it was the last one
+        _nextFrame = NULL;
+        _nextDecodedFrame = NULL;
+        _playing = false;
+        _loopCacheState = LOOPCACHE_OFF;
+        ClearLoopCache();
+        return;
+      }
+      _loopCachePos = 0;
+    }
+    DecodedFrame& df = _loopCache[_loopCachePos++];
+    _pendingAudio.insert(_pendingAudio.end(), df.audio.begin(), df.audio.end());
+    _displayDemuxPosition = df.demuxPosition;
+    _nextFrame = &df.frame;
+    _nextDecodedFrame = &df;
+    _nextFrameSkipped = false;
+  }
+
+  void recordCachedFrame() {
+    if ((_nextFrame == NULL) || _nextFrameSkipped) {
+      //ran off the end without looping... or the decode thread was still skipping
+      //B pictures, so this pass can't be cached
+      ResetLoopCache(false);
+      return;
+    }
+
+    //pl_mpeg restarts the frame time when it loops around...
+    const bool wrapped = _nextFrame->time < _loopCacheLastTime;
+    _loopCacheLastTime = _nextFrame->time;
+    if (_loopCacheState == LOOPCACHE_ARMED) {
+      if (!wrapped) return;
+      _loopCacheState = LOOPCACHE_RECORDING;
+    }
+    else if (wrapped) {
+      //the frame just decoded is the first one cached... the audio that came with it is
+      //discarded as the cached audio of that frame is played instead
+      LOG(LOG_REELMAGIC, LOG_NORMAL)("Media Player #%u Looping %u Frames (%uKB) From Cache", (unsigned)_attrs.Handles.Master, (unsigned)_loopCache.size(), (unsigned)(_loopCacheBytes / 1024));
+      _loopCacheState = LOOPCACHE_PLAYING;
+      _loopCachePos = 0;
+      _pendingAudio.clear();
+      if ((_worker == NULL) && _plm->audio_decoder) plm_buffer_rewind(_plm->audio_decoder->buffer);
+      popCachedFrame();
+      return;
+    }
+
+    cacheNextFrame();
+  }
+
+  void cacheNextFrame() {
+    _loopCache.push_back(DecodedFrame());
+    DecodedFrame& df = _loopCache.back();
+    df.CopyFrame(*_nextFrame);
+    df.demuxPosition = (_worker != NULL) ? _displayDemuxPosition : plm_buffer_tell(_plm->demux->buffer);
+    _loopCacheBytes += sizeof(df) + df.planes.size();
+    if (_loopCacheBytes > _loopCacheSize) AbandonLoopCache();
+  }
+
+  void recordCachedAudio(const plm_samples_t& samples) {
+    if (_loopCacheState != LOOPCACHE_RECORDING) return;
+    _loopCache.back().audio.push_back(samples);
+    _loopCacheBytes += sizeof(samples);
+    if (_loopCacheBytes > _loopCacheSize) AbandonLoopCache();
+  }
+
+  void AbandonLoopCache() {
+    LOG(LOG_REELMAGIC, LOG_NORMAL)("Media Player #%u Clip Exceeds the %uMB Loop Cache", (unsigned)_attrs.Handles.Master, (unsigned)(_loopCacheSize / (1024 * 1024)));
+    _loopCacheState = LOOPCACHE_OFF;
+    ClearLoopCache();
+  }
+
+  void ClearLoopCache() {
+    DetachShownPicture(); //it may be one of the entries
+    _loopCache.clear();
+    _loopCacheBytes = 0;
+  }
+
+  void DetachShownPicture() {
+    //copies the picture on display out of the ring or loop cache entry it is in before
+    //that entry gets reused
+    if ((_shownPicture == NULL) || (_shownPicture == &_shownPictureCopy)) return;
+    _shownPictureCopy.CopyFrame(_shownPicture->frame);
+    _shownPicture = &_shownPictureCopy;
+  }
+
+  void ResetLoopCache(const bool resumeDecoding) {
+    //called whenever the cached frames may no longer be what comes next...
+    const bool wasPlaying = (_loopCacheState == LOOPCACHE_PLAYING);
+    const Bitu framesShown = _loopCachePos;
+    _loopCacheState = (_playing && _workerLoop && _loopCacheSize) ? LOOPCACHE_ARMED : LOOPCACHE_OFF;
+    _loopCacheLastTime = 0.0;
+    if (wasPlaying) {
+      _nextFrame = NULL; //don't leave it pointing into the cache
+      _nextDecodedFrame = NULL;
+      _pendingAudio.clear();
     }
+    ClearLoopCache();
+    if (!(wasPlaying && resumeDecoding)) return;
+
+    //the decoder sat idle at the start of the clip's second pass... bring it to the
+    //frame on display. the clip fit the cache, so decoding up to there again is cheap
+    if (_worker != NULL) ParkWorker();
+    plm_rewind(_plm);
+    if (framesShown > 1) SkipPictures(framesShown - 1, _displayDemuxPosition);
+    if (_worker != NULL) {
+      plm_set_loop(_plm, _workerLoop ? TRUE : FALSE);
+      decodeNextFrame();
+      AdoptCurrentFrame();
+      _pendingAudio.clear(); //already played from the cache
+      return;
+    }
+    decodeNextFrame();
+    if (_plm->audio_decoder) plm_buffer_rewind(_plm->audio_decoder->buffer); //already played from the cache
   }
 
-  void advanceNextFrame() {
+  void decodeNextFrame() {
+    plm_frame_t * const shownFrame = _nextFrame;
+    DecodedFrame * const shownDecodedFrame = _nextDecodedFrame;
+    const bool shownFrameSkipped = _nextFrameSkipped;
+    _nextFrameSkipped = false;
     _nextFrame = plm_decode_video(_plm);
+    _nextDecodedFrame = NULL;
     if (_nextFrame == NULL) {
       if (plm_get_loop(_plm)) _nextFrame = plm_decode_video(_plm); //note: will return NULL frame once when looping... give it one more go...
+      if ((_nextFrame == NULL) && (!_file->HasStreamEnded())) {
+        //the next picture of the stream isn't all here yet... keep showing this one
+        _nextFrame = shownFrame;
+        _nextDecodedFrame = shownDecodedFrame;
+        _nextFrameSkipped = shownFrameSkipped;
+        return;
+      }
       if (_nextFrame == NULL) _playing = false;
     }
   }
 
   void decodeBufferedAudio() {
+    //the worker already decoded the audio along with each frame, and the loop cache
+    //kept it with each frame...
+    for (size_t i = 0; i < _pendingAudio.size(); ++i) {
+      _audioFifo.Produce(_pendingAudio[i]);
+      recordCachedAudio(_pendingAudio[i]);
+    }
+    _pendingAudio.clear();
+    if ((_worker != NULL) || (_loopCacheState == LOOPCACHE_PLAYING)) return;
     if (!_plm->audio_decoder) return;
     plm_samples_t *samples;
     while (plm_buffer_get_remaining(_plm->audio_decoder->buffer) > 0) {
       samples = plm_audio_decode(_plm->audio_decoder);
       if (samples == NULL) break;
       _audioFifo.Produce(*samples);
+      recordCachedAudio(*samples);
     }
   }
 
-  unsigned FindMagicalFCode() {
-    //now this is some mighty fine half assery...
-    //i'm sure this is suppoed to be done on a per-picture basis, but for now, this hack seems
-    //to work ok...
-    //the idea here is that MPEG-1 assets with a picture_rate code >= 0x9 in the MPEG sequence
-    //header have screwed up f_code values. i'm not sure why but this may be some form of copy
-    //and/or clone protection for ReelMagic. pictures with a temporal sequence number of either
-    //3 or 8 seem to contain a truthful f_code when a "key" of 0x40044041 (ReelMagic default)
-    //is given to us and a temporal sequence number of 4 seems to contain the truthful f_code
-    //when a "key" of 0xC39D7088 is given to us
-    //
-    //for now, this hack scrubs the MPEG file in search of the first P or B pictures with a
-    //temporal sequence number matching a truthful value based on the player's "magic key"
-    //the player then applies the found f_code value as a global static forward and
-    //backward value for this entire asset.
-    //
-    //ultimately, this should probably be done on a per-picture basis using some sort of
-    //algorithm to translate the screwed-up values on-the-fly...
-
-    unsigned result = 0;
-
-    const int audio_enabled = plm_get_audio_enabled(_plm);
-    const int loop_enabled  = plm_get_loop(_plm);
-    plm_rewind(_plm);
-    plm_set_audio_enabled(_plm, FALSE);
-    plm_set_loop(_plm, FALSE);
-
-    do {
-      if (plm_buffer_find_start_code(_plm->video_decoder->buffer, PLM_START_PICTURE) == -1) {
-        break;
-      }
-      const unsigned temporal_seqnum = plm_buffer_read(_plm->video_decoder->buffer, 10);
-      const unsigned picture_type = plm_buffer_read(_plm->video_decoder->buffer, 3);
-      if ((picture_type == PLM_VIDEO_PICTURE_TYPE_PREDICTIVE) || (picture_type == PLM_VIDEO_PICTURE_TYPE_B)) {
-        plm_buffer_skip(_plm->video_decoder->buffer, 16); // skip vbv_delay
-        plm_buffer_skip(_plm->video_decoder->buffer, 1); //skip full_px
-        result = plm_buffer_read(_plm->video_decoder->buffer, 3);
-        switch (_config.MagicDecodeKey) {
-        case 0xC39D7088: //The Horde uses this "key"
-          if (temporal_seqnum != 4) result = 0;
-          break;
-
-        default:
-          LOG(LOG_REELMAGIC, LOG_WARN)("Unknown magic key 0x%08X. Defaulting to 0x40044041", (unsigned)_config.MagicDecodeKey);
-          //fall-through
-        case 0x40044041: //most ReelMagic games seem to use this "key"
-          //tsn=3 and tsn=8 seem to contain truthful 
-          if ((temporal_seqnum != 3) && (temporal_seqnum != 8)) result = 0;
-          break;
-        }
-      }
-    } while (result == 0);
-
-    plm_set_loop(_plm, loop_enabled);
-    plm_set_audio_enabled(_plm, audio_enabled);
-    plm_rewind(_plm);
-
-    return result;
+  void decodeBufferedAudio(std::vector<plm_samples_t>& output) {
+    if (!_plm->audio_decoder) return;
+    plm_samples_t *samples;
+    while (plm_buffer_get_remaining(_plm->audio_decoder->buffer) > 0) {
+      samples = plm_audio_decode(_plm->audio_decoder);
+      if (samples == NULL) break;
+      output.push_back(*samples);
+    }
   }
 
   void CollectVideoStats() {
@@ -319,14 +1021,16 @@ namespace { class ReelMagic_MediaPlayerImplementation : public ReelMagic_MediaPl
     if (_attrs.PictureSize.Width && _attrs.PictureSize.Height) {
       if (_plm->video_decoder->seqh_picture_rate >= 0x9) {
         LOG(LOG_REELMAGIC, LOG_NORMAL)("Detected a magical picture_rate code of 0x%X.", (unsigned)_plm->video_decoder->seqh_picture_rate);
-        const unsigned magical_f_code = _magicalFcodeOverride ? _magicalFcodeOverride: FindMagicalFCode();
-        if (magical_f_code) {
-          _magicalRSizeOverride = magical_f_code - 1;
-          plm_video_set_decode_picture_header_callback(_plm->video_decoder, &plmDecodeMagicalPictureHeaderCallback, this);
-          LOG(LOG_REELMAGIC, LOG_NORMAL)("Applying static %u:%u f_code override", magical_f_code, magical_f_code);
+        if (_magicalFcodeOverride) {
+          rmfc_init_static(&_magicalFCodes, _magicalFcodeOverride);
+          plm_video_set_decode_picture_header_callback(_plm->video_decoder, &rmfc_decode_static_picture_header, &_magicalFCodes);
+          LOG(LOG_REELMAGIC, LOG_NORMAL)("Applying static %u:%u f_code override", (unsigned)_magicalFcodeOverride, (unsigned)_magicalFcodeOverride);
         }
         else {
-          LOG(LOG_REELMAGIC, LOG_WARN)("No magical f_code found. Playback will likely be screwed up!");
+          if (!rmfc_init(&_magicalFCodes, _config.MagicDecodeKey))
+            LOG(LOG_REELMAGIC, LOG_WARN)("Unknown magic key 0x%08X. Defaulting to 0x%08X", (unsigned)_config.MagicDecodeKey, (unsigned)RMFC_KEY_DEFAULT);
+          plm_video_set_decode_picture_header_callback(_plm->video_decoder, &rmfc_decode_picture_header, &_magicalFCodes);
+          LOG(LOG_REELMAGIC, LOG_NORMAL)("Applying per-picture f_code recovery for magic key 0x%08X", (unsigned)_config.MagicDecodeKey);
         }
         _plm->video_decoder->framerate = PLM_VIDEO_PICTURE_RATE[0x7 & _plm->video_decoder->seqh_picture_rate];
       }
@@ -338,6 +1042,186 @@ namespace { class ReelMagic_MediaPlayerImplementation : public ReelMagic_MediaPl
     _framerate = plm_get_framerate(_plm);
   }
 
+  struct IndexReadContext {
+    ReelMagic_MediaPlayerImplementation *player;
+    Bit32u fileSize;
+  };
+  static size_t rmidxReadCallback(void *user, uint8_t *dest, uint32_t offset, size_t len) {
+    const IndexReadContext& ctx = *(const IndexReadContext*)user;
+    if (offset >= ctx.fileSize) return 0;
+    if (len > (ctx.fileSize - offset)) len = ctx.fileSize - offset;
+    const Bit8u * const hostMapping = ctx.player->_file->GetHostMapping();
+    if (hostMapping != NULL) {
+      memcpy(dest, hostMapping + offset, len);
+      return len;
+    }
+    try {
+      ctx.player->_file->Seek(offset, DOS_SEEK_SET);
+      return ctx.player->ReadFile(dest, (Bit32u)len);
+    }
+    catch (...) {
+      return 0;
+    }
+  }
+
+  std::string IndexPath(const Bit32u fileSize) const {
+    std::string path(_indexCacheDir.size() + 64, '\0');
+    rmidx_make_path(&path[0], path.size(), _indexCacheDir.c_str(), fileSize, _indexHash);
+    path.resize(strlen(path.c_str()));
+    return path;
+  }
+
+  void LoadIndex(const Bit32u fileSize) {
+    //with "indexcachedir" set, the stream layout and picture table of each asset is
+    //kept in an index file (see reelmagic_index.h)... only the head and tail of the
+    //asset are read here to find it; assets without one are scanned by BuildIndex()
+    _index = NULL;
+    _indexPending = false;
+    if (_indexCacheDir.empty() || (fileSize == 0)) return;
+
+    IndexReadContext ctx = { this, fileSize };
+    _indexHash = rmidx_hash(&rmidxReadCallback, &ctx, fileSize);
+    const IndexCache::iterator it = _indexCache.find(std::make_pair(fileSize, _indexHash));
+    if (it != _indexCache.end()) {
+      if (it->second.valid) _index = &it->second.index;
+    }
+    else {
+      const std::string path(IndexPath(fileSize));
+      IndexCacheEntry entry;
+      if (rmidx_load(&entry.index, path.c_str(), fileSize, _indexHash)) {
+        entry.valid = true;
+        _index = &(_indexCache[std::make_pair(fileSize, _indexHash)] = entry).index;
+        LOG(LOG_REELMAGIC, LOG_NORMAL)("Media Player #%u Loaded Index %s With %u Pictures", (unsigned)_attrs.Handles.Master, path.c_str(), (unsigned)_index->picture_count);
+      }
+      else {
+        _indexPending = true;
+      }
+    }
+
+    if (_file->GetHostMapping() == NULL) {
+      try {
+        _file->Seek(0, DOS_SEEK_SET);
+      }
+      catch (...) {}
+    }
+  }
+
+  void BuildIndex() {
+    //scans the whole asset the first time it is seeked into rather than when it is
+    //opened, as many are only ever played from the start... the result is kept for
+    //the rest of the session whether or not the index file can be written
+    _indexPending = false;
+    const Bit32u fileSize = _file->GetFileSize();
+    const std::pair<Bit32u, Bit64u> key(fileSize, _indexHash);
+    IndexCache::iterator it = _indexCache.find(key);
+    if (it == _indexCache.end()) {
+      IndexReadContext ctx = { this, fileSize };
+      IndexCacheEntry entry;
+      entry.valid = rmidx_build(&entry.index, &rmidxReadCallback, &ctx, fileSize, _indexHash) != 0;
+      if (!entry.valid) rmidx_free(&entry.index);
+      it = _indexCache.insert(std::make_pair(key, entry)).first;
+      if (entry.valid) {
+        const std::string path(IndexPath(fileSize));
+        if (rmidx_save(&entry.index, path.c_str()))
+          LOG(LOG_REELMAGIC, LOG_NORMAL)("Media Player #%u Saved Index %s With %u Pictures", (unsigned)_attrs.Handles.Master, path.c_str(), (unsigned)entry.index.picture_count);
+        else
+          LOG(LOG_REELMAGIC, LOG_WARN)("Media Player #%u Failed to Write Index %s; Keeping It in Memory", (unsigned)_attrs.Handles.Master, path.c_str());
+      }
+    }
+    if (it->second.valid) _index = &it->second.index;
+  }
+
+  void FindSeekPoint(const Bit32u offset, Bit32u& seekOffset, Bitu& skipPictures) {
+    //seeking into the middle of a GOP and decoding from there shows garbage until the
+    //next I picture... decoding has to start at the GOP in front of the target and the
+    //pictures in between are decoded without being shown. assets without an index are
+    //scanned backwards from the target in small steps until a GOP turns up
+    seekOffset = offset;
+    skipPictures = 0;
+    if (_indexPending) BuildIndex();
+    if (_index != NULL) {
+      CountSkipPictures(*_index, offset, seekOffset, skipPictures);
+      return;
+    }
+
+    //each step overlaps the one after it so a GOP header whose picture starts in the
+    //next step still gets seen... one step plus the overlap is one index read chunk
+    enum { SCAN_STEP = 56 * 1024, SCAN_OVERLAP = 8 * 1024, SCAN_LIMIT = 512 * 1024 };
+    IndexReadContext ctx = { this, _file->GetFileSize() };
+    const int layout = HasSystem() ? RMIDX_LAYOUT_PS : RMIDX_LAYOUT_ES;
+    rmidx_t window;
+    Bit32u start = offset;
+    do {
+      const Bit32u end = start + SCAN_OVERLAP;
+      start = (start > SCAN_STEP) ? (start - SCAN_STEP) : 0;
+      rmidx_build_range(&window, &rmidxReadCallback, &ctx, ctx.fileSize, layout, start, end);
+      const rmidx_picture_t * const gop = rmidx_find_gop(&window, offset);
+      if (gop != NULL) {
+        //the first step reaches past the target so it has all the pictures to count...
+        //otherwise scan again from the GOP to the target to count them
+        if (end < offset + SCAN_OVERLAP) {
+          const Bit32u gopOffset = gop->offset;
+          rmidx_free(&window);
+          rmidx_build_range(&window, &rmidxReadCallback, &ctx, ctx.fileSize, layout, gopOffset, offset + SCAN_OVERLAP);
+        }
+        CountSkipPictures(window, offset, seekOffset, skipPictures);
+        rmidx_free(&window);
+        return;
+      }
+      rmidx_free(&window);
+    } while ((start > 0) && ((offset - start) < SCAN_LIMIT));
+  }
+
+  static void CountSkipPictures(const rmidx_t& index, const Bit32u offset, Bit32u& seekOffset, Bitu& skipPictures) {
+    const rmidx_picture_t * const gop = rmidx_find_gop(&index, offset);
+    if (gop == NULL) return;
+    seekOffset = gop->offset;
+    const rmidx_picture_t * const end = index.pictures + index.picture_count;
+    for (const rmidx_picture_t *p = gop; (p != end) && (p->offset < offset); ++p) ++skipPictures;
+  }
+
+  void SkipPictures(const Bitu count, const Bit32u offset) {
+    //B pictures need not be decoded at all to get to the target... audio that was
+    //demuxed from before the target offset is thrown away as it goes...
+    plm_video_set_skip_b_pictures(_plm->video_decoder, TRUE);
+    for (Bitu i = 0; i < count; ++i) {
+      if (plm_decode_video(_plm) == NULL) break;
+      if (_plm->audio_decoder && (plm_buffer_tell(_plm->demux->buffer) <= offset))
+        plm_buffer_rewind(_plm->audio_decoder->buffer);
+    }
+    plm_video_set_skip_b_pictures(_plm->video_decoder, FALSE);
+
+    //the audio that is left starts about where the video is now...
+    if (_plm->audio_decoder)
+      plm_audio_set_time(_plm->audio_decoder, plm_video_get_time(_plm->video_decoder));
+  }
+
+  void ServiceStream() {
+    //takes in as much of the application's buffer as fits... the driver asks for the
+    //next one once this one is used up and what's left here runs low
+    plm_buffer_t * const buf = (_streamBuffer != NULL) ? _streamBuffer : ((_plm != NULL) ? _plm->demux->buffer : NULL);
+    if ((buf == NULL) || (!_file->IsStream())) return;
+    for (;;) {
+      plm_buffer_make_room(buf, _fileReadSize);
+      if (buf->length >= buf->capacity) break;
+      Bit32u bytesRead = 0;
+      try {
+        bytesRead = ReadFile(buf->bytes + buf->length, (Bit32u)(buf->capacity - buf->length));
+      }
+      catch (...) {}
+      if (bytesRead == 0) break;
+      buf->length += bytesRead;
+      buf->has_ended = FALSE;
+    }
+    if ((_streamBuffer != NULL) && ((plm_buffer_get_remaining(_streamBuffer) >= STREAM_PROBE_SIZE) || _file->HasStreamEnded())) {
+      plm_buffer_t * const plmBuf = _streamBuffer;
+      _streamBuffer = NULL;
+      OpenDecoder(plmBuf);
+      if ((_plm != NULL) && _streamPlayPending) Play(_streamPlayMode);
+      _streamPlayPending = false;
+    }
+  }
+
   void SetupVESOnlyDecode() {
     plm_set_audio_enabled(_plm, FALSE);
     if (_plm->audio_decoder) {
@@ -351,55 +1235,56 @@ namespace { class ReelMagic_MediaPlayerImplementation : public ReelMagic_MediaPl
     _plm->video_decoder = plm_video_create_with_buffer(_plm->demux->buffer, FALSE);
   }
 
-public:
-  ReelMagic_MediaPlayerImplementation(ReelMagic_MediaPlayerFile * const file, const ReelMagic_MediaPlayer_Handle handle) :
-    _file(file),
-    _stopOnComplete(false),
-    _playing(false),
-    _vgaFps(0.0f),
-    _plm(NULL),
-    _nextFrame(NULL),
-    _magicalRSizeOverride(0) {
-
-    memcpy(&_config, &_globalDefaultPlayerConfiguration, sizeof(_config));
-    memset(&_attrs, 0, sizeof(_attrs));
-    
-    _attrs.Handles.Master = handle;
-
+  void OpenDecoder(plm_buffer_t * const plmBuf) {
     bool detetectedFileTypeVesOnly = false;
-
-    plm_buffer_t * const plmBuf = plm_buffer_create_with_virtual_file(
-      &plmBufferLoadCallback,
-      &plmBufferSeekCallback,
-      this,
-      _file->GetFileSize()
-    );
-    _plm = plm_create_with_buffer(plmBuf, TRUE); //TRUE = destroy buffer when done
-    plm_demux_set_stop_on_program_end(_plm->demux, TRUE);
-
-    if (!plm_has_headers(_plm)) {
-      //failed to detect an MPEG-1 PS (muxed) stream... try MPEG-ES assuming video-only...
+    if ((_index != NULL) && (_index->layout == RMIDX_LAYOUT_ES)) {
+      //the index says this is a video ES... no need to search it for MPEG-PS headers
+      _plm = plm_create_with_video_buffer(plmBuf, TRUE); //TRUE = destroy buffer when done
+      plm_demux_set_stop_on_program_end(_plm->demux, TRUE);
       detetectedFileTypeVesOnly = true;
-      SetupVESOnlyDecode();
       _attrs.Handles.Video = _attrs.Handles.Master;
     }
     else {
-      _attrs.Handles.Demux = _attrs.Handles.Master;
+      _plm = plm_create_with_buffer(plmBuf, TRUE); //TRUE = destroy buffer when done
+      plm_demux_set_stop_on_program_end(_plm->demux, TRUE);
+
+      if (!plm_has_headers(_plm)) {
+        if (_file->IsStream()) {
+          //the start of a stream is gone once it has been read; it can't be retried as an ES
+          LOG(LOG_REELMAGIC, LOG_ERROR)("Media Player #%u Stream Is Not an MPEG-PS", (unsigned)_attrs.Handles.Master);
+          plm_destroy(_plm);
+          _plm = NULL;
+          return;
+        }
+        //failed to detect an MPEG-1 PS (muxed) stream... try MPEG-ES assuming video-only...
+        detetectedFileTypeVesOnly = true;
+        SetupVESOnlyDecode();
+        _attrs.Handles.Video = _attrs.Handles.Master;
+      }
+      else {
+        _attrs.Handles.Demux = _attrs.Handles.Master;
+      }
     }
 
     //disable audio buffer load callback so pl_mpeg dont try to "auto fetch" audio samples
     //when we ask it for audio data...
     if (_plm->audio_decoder) {
       _plm->audio_decoder->buffer->load_callback = NULL;
+      plm_audio_set_gain(_plm->audio_decoder, (float)_audioLevel);
       _audioFifo.SetSampleRate((Bitu)plm_get_samplerate(_plm));
     }
 
+    if ((_sliceThreadPool != NULL) && (_plm->video_decoder != NULL))
+      plm_video_set_parallel_callback(_plm->video_decoder, &SliceThreadPool::plmParallelCallback, _sliceThreadPool);
+
     CollectVideoStats();
     advanceNextFrame(); //attempt to decode the first frame of video...
     if ((_nextFrame == NULL) || (_attrs.PictureSize.Width == 0) || (_attrs.PictureSize.Height == 0)) {
       //something failed... asset is deemed bad at this point...
       plm_destroy(_plm);
       _plm = NULL;
+      _nextFrame = NULL;
+      _nextDecodedFrame = NULL;
     }
 
     if (_plm == NULL) {
@@ -411,11 +1296,91 @@ public:
         LOG(LOG_REELMAGIC, LOG_NORMAL)("Media Player #%u Audio Decoder Enabled @ %uHz", (unsigned)_attrs.Handles.Master, (unsigned)_audioFifo.GetSampleRate());
     }
   }
+
+public:
+  ReelMagic_MediaPlayerImplementation(ReelMagic_MediaPlayerFile * const file, const ReelMagic_MediaPlayer_Handle handle) :
+    _file(file),
+    _stopOnComplete(false),
+    _playing(false),
+    _statsReported(true),
+    _bytesReadThroughDOS(0),
+    _vgaFps(0.0f),
+    _pictureOutdated(false),
+    _shownPicture(NULL),
+    _nextFrameSkipped(false),
+    _presentIPOnly(false),
+    _catchUpRefreshes(0),
+    _picturesSkipped(0),
+    _picturesDropped(0),
+    _plm(NULL),
+    _nextFrame(NULL),
+    _nextDecodedFrame(NULL),
+    _index(NULL),
+    _indexHash(0),
+    _indexPending(false),
+    _streamBuffer(NULL),
+    _streamPlayPending(false),
+    _streamPlayMode(MPPM_PAUSEONCOMPLETE),
+    _worker(NULL),
+    _workerThreadId(0),
+    _workerMutex(NULL),
+    _workerCond(NULL),
+    _workerLoop(false),
+    _workerSkipB(false),
+    _ringHead(0),
+    _ringCount(0),
+    _displayDemuxPosition(0),
+    _readAheadStart(0),
+    _readAheadUsed(0),
+    _readAheadEnded(false),
+    _readAheadSeekPending(false),
+    _readAheadSeekPos(0),
+    _loopCacheState(LOOPCACHE_OFF),
+    _loopCacheBytes(0),
+    _loopCachePos(0),
+    _loopCacheLastTime(0.0) {
+
+    memcpy(&_config, &_globalDefaultPlayerConfiguration, sizeof(_config));
+    memset(&_attrs, 0, sizeof(_attrs));
+    memset(&_magicalFCodes, 0, sizeof(_magicalFCodes));
+    
+    _attrs.Handles.Master = handle;
+
+    if (_file->IsStream()) {
+      //nothing to detect the stream by until the application has handed some of it over...
+      //it is taken for an MPEG-PS with audio and video in the meantime
+      _streamBuffer = plm_buffer_create_with_virtual_file(&plmBufferLoadCallback, &plmBufferSeekCallback, this, 0);
+      _attrs.Handles.Demux = _attrs.Handles.Master;
+      LOG(LOG_REELMAGIC, LOG_NORMAL)("Created Media Player #%u Waiting on Stream Data %s", (unsigned)_attrs.Handles.Master, _file->GetFileName());
+      return;
+    }
+
+    const Bit32u fileSize = _file->GetFileSize();
+    LoadIndex(fileSize);
+
+    //decode straight out of the host file when it is mapped into memory...
+    //otherwise, the file is loaded through the DOS file callbacks
+    const Bit8u * const hostMapping = _file->GetHostMapping();
+    OpenDecoder((hostMapping != NULL) ?
+      plm_buffer_create_with_memory((uint8_t*)hostMapping, fileSize, FALSE) :
+      plm_buffer_create_with_virtual_file(
+        &plmBufferLoadCallback,
+        &plmBufferSeekCallback,
+        this,
+        fileSize
+      ));
+    if ((_plm != NULL) && (hostMapping != NULL))
+      LOG(LOG_REELMAGIC, LOG_NORMAL)("Media Player #%u Reading From Memory-Mapped Host File", (unsigned)_attrs.Handles.Master);
+  }
   virtual ~ReelMagic_MediaPlayerImplementation() {
     LOG(LOG_REELMAGIC, LOG_NORMAL)("Destroying Media Player #%u %s", (unsigned)_attrs.Handles.Master, _file->GetFileName());
+    LOG(LOG_REELMAGIC, LOG_NORMAL)("Media Player #%u Read %u Bytes Through DOS%s", (unsigned)_attrs.Handles.Master, (unsigned)_bytesReadThroughDOS, IsReadingHostMapping() ? " and Decoded From the Host File Mapping" : "");
+    ReportPlaybackStats();
     DeactivatePlayerAudioFifo(_audioFifo);
     if(ReelMagic_GetVideoMixerMPEGProvider() == this) ReelMagic_SetVideoMixerMPEGProvider(NULL);
+    DestroyWorkerSync();
     if (_plm != NULL) plm_destroy(_plm);
+    if (_streamBuffer != NULL) plm_buffer_destroy(_streamBuffer);
     delete _file;
   }
 
@@ -450,7 +1415,7 @@ public:
   //
   // ReelMagic_VideoMixerMPEGProvider implementation here...
   //
-  void OnVerticalRefresh(void * const outputBuffer, const float fps) {
+  bool OnVerticalRefresh(const float fps) {
     if (fps != _vgaFps) {
       _vgaFps = fps;
       _vgaFramesPerMpegFrame = _vgaFps;
@@ -459,22 +1424,120 @@ public:
       _drawNextFrame = true;
     }
 
-    if (_drawNextFrame) {
-      if (_nextFrame != NULL)
-        plm_frame_to_rgb(_nextFrame, (uint8_t*)outputBuffer, _attrs.PictureSize.Width * 3);
-      decodeBufferedAudio();
+    UpdateWorkerSkipB();
+    ServiceReadAhead();
+    ServiceStream();
+
+    bool pictureChanged = false;
+    if (_drawNextFrame || _pictureOutdated) {
+      //nothing to convert while hidden... the picture is brought up to date once there
+      //is a decoded one to show again
+      if ((_nextFrame != NULL) && (!_nextFrameSkipped) && _config.VideoOutputVisible) {
+        if (_nextDecodedFrame != NULL) {
+          _shownPicture = _nextDecodedFrame; //stays put until DetachShownPicture()
+        }
+        else {
+          _shownPictureCopy.CopyFrame(*_nextFrame); //the decoder reuses the planes of _nextFrame
+          _shownPicture = &_shownPictureCopy;
+        }
+        pictureChanged = true;
+        _pictureOutdated = false;
+      }
+      else if (_nextFrame != NULL) {
+        _pictureOutdated = true;
+      }
+      if (_drawNextFrame) decodeBufferedAudio();
       _drawNextFrame = false;
     }
 
     if (!_playing) {
+      ReportPlaybackStats();
       if (_stopOnComplete) ReelMagic_SetVideoMixerMPEGProvider(NULL);
-      return;
+      return pictureChanged;
     }
 
-    for (_waitVgaFramesUntilNextMpegFrame -= 1.00; _waitVgaFramesUntilNextMpegFrame < 0.00; _waitVgaFramesUntilNextMpegFrame += _vgaFramesPerMpegFrame) {
-      advanceNextFrame();
+    if (SyncToAudioClock()) {
+      _waitVgaFramesUntilNextMpegFrame = _vgaFramesPerMpegFrame;
+      return pictureChanged;
+    }
+    SetPresentIPOnly(false);
+    Bitu framesAdvanced = 0;
+    for (_waitVgaFramesUntilNextMpegFrame -= 1.00; _waitVgaFramesUntilNextMpegFrame < 0.00; ++framesAdvanced) {
+      //only the last of the frames due this refresh is displayed...
+      _waitVgaFramesUntilNextMpegFrame += _vgaFramesPerMpegFrame;
+      advanceNextFrame(_waitVgaFramesUntilNextMpegFrame >= 0.00);
       _drawNextFrame = true;
     }
+    if (framesAdvanced > 1) ++_catchUpRefreshes;
+    return pictureChanged;
+  }
+
+  bool SyncToAudioClock() {
+    //while our audio is playing, the frame on display is picked by the time of the
+    //sample the mixer is at... falls back to counting VGA refreshes when there is no
+    //such time, i.e. no audio, the mixer ran dry, or it is way off because one side
+    //already looped around or was repositioned
+    enum { MAX_FRAMES_PER_REFRESH = 4 };
+    static const double SYNC_WINDOW = 1.0; //seconds
+    if (!IsActivePlayerAudioFifo(_audioFifo) || (_nextFrame == NULL)) return false;
+    double clock;
+    if (!_audioFifo.GetClock(clock)) return false;
+    if ((clock < (_nextFrame->time - SYNC_WINDOW)) || (clock > (_nextFrame->time + SYNC_WINDOW))) return false;
+
+    //when the video can't catch up within a refresh, only I and P pictures are decoded
+    //and shown until it has...
+    const double frameDuration = 1.0 / _framerate;
+    const double framesDue = (clock - _nextFrame->time) / frameDuration;
+    if (framesDue > (MAX_FRAMES_PER_REFRESH + 1)) SetPresentIPOnly(true);
+    else if (framesDue < 2.0) SetPresentIPOnly(false);
+
+    Bitu i;
+    for (i = 0; i < MAX_FRAMES_PER_REFRESH; ++i) {
+      if ((!_playing) || (_nextFrame == NULL) || ((_nextFrame->time + frameDuration) > clock)) break;
+      const bool lastDue = ((_nextFrame->time + (2.0 * frameDuration)) > clock) || ((i + 1) == MAX_FRAMES_PER_REFRESH);
+      advanceNextFrame(lastDue);
+      _drawNextFrame = true;
+    }
+    if (i > 1) ++_catchUpRefreshes;
+    return true;
+  }
+
+  void SetPresentIPOnly(const bool value) {
+    if (value == _presentIPOnly) return;
+    _presentIPOnly = value;
+    if (value)
+      LOG(LOG_REELMAGIC, LOG_NORMAL)("Media Player #%u Fell Behind the Audio; Showing I and P Pictures Only", (unsigned)_attrs.Handles.Master);
+    else
+      LOG(LOG_REELMAGIC, LOG_NORMAL)("Media Player #%u Caught Up With the Audio After Dropping %u B Pictures So Far", (unsigned)_attrs.Handles.Master, (unsigned)_picturesDropped);
+  }
+
+  void ReportPlaybackStats() {
+    //once each time playback stops, pauses or runs out...
+    if (_statsReported) return;
+    _statsReported = true;
+    if (_audioFifo.GetSamplesDropped() || _audioFifo.GetSamplesDuplicated())
+      LOG(LOG_REELMAGIC, LOG_NORMAL)("Media Player #%u Audio Dropped %u Samples and Repeated %u Samples", (unsigned)_attrs.Handles.Master, (unsigned)_audioFifo.GetSamplesDropped(), (unsigned)_audioFifo.GetSamplesDuplicated());
+    if (_catchUpRefreshes || _picturesDropped)
+      LOG(LOG_REELMAGIC, LOG_NORMAL)("Media Player #%u Caught Up %u Times Skipping %u B Pictures and Dropped %u B Pictures", (unsigned)_attrs.Handles.Master, (unsigned)_catchUpRefreshes, (unsigned)_picturesSkipped, (unsigned)_picturesDropped);
+  }
+
+  bool SkipBPictures() const {
+    //the loop cache needs every picture it records...
+    return (_presentIPOnly || (!_config.VideoOutputVisible)) && (_loopCacheState == LOOPCACHE_OFF);
+  }
+
+  void UpdateWorkerSkipB() {
+    //the decode thread picks this up from the next picture it decodes...
+    if ((_worker == NULL) || (_workerSkipB == SkipBPictures())) return;
+    SDL_mutexP(_workerMutex);
+    _workerSkipB = SkipBPictures();
+    SDL_mutexV(_workerMutex);
+  }
+
+  bool GetPictureRow(void * const out, const Bitu row, const Bitu begin, const Bitu end) {
+    if ((_shownPicture == NULL) || (!_shownPicture->hasFrame) || (row >= _shownPicture->frame.height)) return false;
+    plm_frame_row_to_bgra(&_shownPicture->frame, (uint8_t*)out, (int)row, (int)begin, (int)end);
+    return true;
   }
 
   const ReelMagic_PlayerConfiguration& GetConfig() const { return _config; }
@@ -489,19 +1552,19 @@ public:
   const ReelMagic_PlayerAttributes& GetAttrs() const { return _attrs; }
 
   bool HasSystem() const {
-    if (_plm == NULL) return false;
+    if (_plm == NULL) return _streamBuffer != NULL;
     return _plm->demux->buffer != _plm->video_decoder->buffer;
   }
   bool HasVideo() const {
-    if (_plm == NULL) return false;
+    if (_plm == NULL) return _streamBuffer != NULL;
     return plm_get_video_enabled(_plm) != FALSE;
   }
   bool HasAudio() const {
-    if (_plm == NULL) return false;
+    if (_plm == NULL) return _streamBuffer != NULL;
     return plm_get_audio_enabled(_plm) != FALSE;
   }
   bool IsPlaying() const {
-    return _playing;
+    return _playing || _streamPlayPending;
   }
   Bitu GetBytesDecoded() const {
     if (_plm == NULL) return 0;
@@ -510,41 +1573,114 @@ public:
     //rounding up the demux position to align....
     //NOTE: I'm not sure if this should be different for DMA streaming mode!
     const Bitu alignTo = 4096;
-    Bitu rv = plm_buffer_tell(_plm->demux->buffer);
+    Bitu rv = ((_worker != NULL) || (_loopCacheState == LOOPCACHE_PLAYING)) ? _displayDemuxPosition : plm_buffer_tell(_plm->demux->buffer);
     rv += alignTo - 1;
     rv &= ~(alignTo - 1);
     return rv;
   }
+  bool IsReadingHostMapping() const {
+    return (_plm != NULL) && (_file->GetHostMapping() != NULL);
+  }
+  Bitu GetBytesReadThroughDOS() const {
+    return _bytesReadThroughDOS;
+  }
+  Bitu GetCatchUpRefreshes() const {
+    return _catchUpRefreshes;
+  }
+  Bitu GetPicturesSkipped() const {
+    return _picturesSkipped;
+  }
+  Bitu GetPicturesDropped() const {
+    return _picturesDropped;
+  }
 
-  void Play(const PlayMode playMode) {
+  void Play(PlayMode playMode) {
+    if ((_plm == NULL) && (_streamBuffer != NULL)) {
+      //starts once the stream can be decoded...
+      _streamPlayPending = true;
+      _streamPlayMode = playMode;
+      return;
+    }
     if (_plm == NULL) return;
     if (_playing) return;
+    if (_file->IsStream() && (playMode == MPPM_LOOP)) {
+      LOG(LOG_REELMAGIC, LOG_WARN)("Media Player #%u Can't Loop a Stream", (unsigned)_attrs.Handles.Master);
+      playMode = MPPM_PAUSEONCOMPLETE;
+    }
     _playing = true;
-    plm_set_loop(_plm, (playMode == MPPM_LOOP) ? TRUE : FALSE);
+    _statsReported = false;
+    if (_worker != NULL) {
+      SDL_mutexP(_workerMutex);
+      _workerLoop = (playMode == MPPM_LOOP); //applied by the worker between frames
+      SDL_CondBroadcast(_workerCond);
+      SDL_mutexV(_workerMutex);
+    }
+    else {
+      plm_set_loop(_plm, (playMode == MPPM_LOOP) ? TRUE : FALSE);
+      _workerLoop = (playMode == MPPM_LOOP);
+      if (_decodeThreads && (!_file->IsStream())) StartWorker(); //streams are fed on the emulation thread
+    }
     _stopOnComplete = playMode == MPPM_STOPONCOMPLETE;
+    if ((_loopCacheState == LOOPCACHE_OFF) && (playMode == MPPM_LOOP) && _loopCacheSize && (_nextFrame != NULL)) {
+      //start recording right away if the clip is at its start...
+      _loopCacheLastTime = _nextFrame->time;
+      _loopCacheState = LOOPCACHE_ARMED;
+      if (_nextFrame->time == 0.0) {
+        _loopCacheState = LOOPCACHE_RECORDING;
+        cacheNextFrame();
+      }
+    }
     ReelMagic_SetVideoMixerMPEGProvider(this);
     ActivatePlayerAudioFifo(_audioFifo);
     _vgaFps = 0.0f; //force drawing of next frame and timing reset
   }
   void Pause() {
     _playing = false;
+    _streamPlayPending = false;
+    ReportPlaybackStats();
   }
   void Stop() {
     _playing = false;
+    ReportPlaybackStats();
+    _streamPlayPending = false;
+    ResetLoopCache(true);
     if(ReelMagic_GetVideoMixerMPEGProvider() == this) ReelMagic_SetVideoMixerMPEGProvider(NULL);
   }
   void SeekToByteOffset(const Bit32u offset) {
+    if (_plm == NULL) return;
+    if (_file->IsStream()) {
+      LOG(LOG_REELMAGIC, LOG_WARN)("Media Player #%u Can't Seek a Stream to 0x%X", (unsigned)_attrs.Handles.Master, (unsigned)offset);
+      return;
+    }
+    ResetLoopCache(false);
+    if (_worker != NULL) ParkWorker();
+    Bit32u seekOffset;
+    Bitu skipPictures;
+    FindSeekPoint(offset, seekOffset, skipPictures);
+    if (seekOffset != offset)
+      LOG(LOG_REELMAGIC, LOG_NORMAL)("Media Player #%u Seeking to GOP at 0x%X and skipping %u pictures to reach 0x%X", (unsigned)_attrs.Handles.Master, (unsigned)seekOffset, (unsigned)skipPictures, (unsigned)offset);
     plm_rewind(_plm);
-    plm_buffer_seek(_plm->demux->buffer, (size_t)offset);
+    plm_buffer_seek(_plm->demux->buffer, (size_t)seekOffset);
+    if (skipPictures) SkipPictures(skipPictures, offset);
     _audioFifo.Clear();
     if (_plm->audio_decoder)                   //this is a hacky way to force an audio decoder reset...
       _plm->audio_decoder->has_header = FALSE; //something (hopefully not sample rate) changes between byte seeks in crime patrol...
+    if (_worker != NULL) {
+      plm_set_loop(_plm, _workerLoop ? TRUE : FALSE);
+      decodeNextFrame(); //the worker is parked; decode the seeked-to frame right here...
+      AdoptCurrentFrame();
+      return;
+    }
     advanceNextFrame();
   }
   void NotifyConfigChange() {
+    ResetLoopCache(true);
     if (ReelMagic_GetVideoMixerMPEGProvider() == this)
       ReelMagic_SetVideoMixerMPEGProvider(this);
   }
+  void NotifyStreamData() {
+    ServiceStream();
+  }
 };};
 
 
@@ -661,6 +1797,10 @@ static void DeactivatePlayerAudioFifo(AudioSampleFIFO& fifo) {
   if (_activePlayerAudioFifo == &fifo) _activePlayerAudioFifo = NULL;
 }
 
+static bool IsActivePlayerAudioFifo(const AudioSampleFIFO& fifo) {
+  return _activePlayerAudioFifo == &fifo;
+}
+
 static Bit16s _lastAudioSample[2];
 static void RMMixerChannelCallback(Bitu samplesNeeded) {
   //samplesNeeded is sample count, including both channels...
@@ -673,6 +1813,7 @@ static void RMMixerChannelCallback(Bitu samplesNeeded) {
     available = _activePlayerAudioFifo->SamplesAvailableForConsumption();
     if (available == 0) {
       _rmaudio->AddSamples_s16(1, _lastAudioSample);
+      _activePlayerAudioFifo->Duplicated(1);
       --samplesNeeded;
       continue;
 //      _rmaudio->AddSilence();
@@ -695,8 +1836,17 @@ static void RMMixerChannelCallback(Bitu samplesNeeded) {
   }
 }
 
+static void ReelMagic_ShutDownPlayer(Section* /*sec*/) {
+  //players may still be decoding on the slice threads, so they go first...
+  ReelMagic_DeleteAllPlayers();
+  delete _sliceThreadPool;
+  _sliceThreadPool = NULL;
+  ClearIndexCache();
+}
+
 void ReelMagic_InitPlayer(Section* sec) {
   Section_prop * section=static_cast<Section_prop *>(sec);
+  sec->AddDestroyFunction(&ReelMagic_ShutDownPlayer, true);
 
   _rmaudio = MIXER_AddChannel(&RMMixerChannelCallback, 44100, "REELMAGC");
   _rmaudio->Enable(true); 
@@ -705,6 +1855,26 @@ void ReelMagic_InitPlayer(Section* sec) {
   _audioLevel /= 100.0;
   _audioFifoSize = section->Get_int("audiofifosize");
   _audioFifoDispose = section->Get_int("audiofifodispose");
+  AudioSampleFIFO::LimitConfig();
+  _decodeThreads = section->Get_bool("decodethreads");
+  _fileReadSize = section->Get_int("filereadsize");
+  _indexCacheDir = section->Get_path("indexcachedir")->realpath;
+  _loopCacheSize = (size_t)section->Get_int("loopcachemb") * 1024 * 1024;
+  _sliceThreads = section->Get_int("slicethreads");
+  if ((_sliceThreads > 0) && (_sliceThreadPool == NULL)) {
+    _sliceThreadPool = new SliceThreadPool(_sliceThreads);
+    LOG(LOG_REELMAGIC, LOG_NORMAL)("Decoding MPEG slices on %u additional threads", (unsigned)_sliceThreads);
+  }
+
+  //pick the MPEG decoder SIMD kernels; anything but "auto" caps what the CPU supports
+  static const char * const simdNames[] = { "scalar", "sse2", "avx2", "neon" };
+  const char * const simd = section->Get_string("simd");
+  int simdLevel = plm_simd_get_supported();
+  for (int i = 0; i < (int)ARRAY_COUNT(simdNames); ++i) {
+    if (strcasecmp(simd, simdNames[i]) == 0) simdLevel = i;
+  }
+  simdLevel = plm_simd_set_level(simdLevel);
+  LOG(LOG_REELMAGIC, LOG_NORMAL)("MPEG decoder using %s kernels", simdNames[simdLevel]);
 
   //read in the initial global magic key from configuration
   unsigned long scanval;
@@ -737,3 +1907,7 @@ void ReelMagic_ResetPlayers() {
 ReelMagic_PlayerConfiguration& ReelMagic_GlobalDefaultPlayerConfig() {
   return _globalDefaultPlayerConfiguration;
 }
+
+ReelMagic_SIMDLevel ReelMagic_GetSIMDLevel() {
+  return (ReelMagic_SIMDLevel)plm_simd_get_level();
+}
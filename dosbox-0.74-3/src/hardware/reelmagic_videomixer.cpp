@@ -31,6 +31,22 @@
 #include <exception>
 #include <string>
 
+//SIMD line mixers are built with function level target attributes like the
+//MPEG decoder's kernels and picked at runtime (see ReelMagic_InitVideoMixer())
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#if defined(_MSC_VER) && !defined(__clang__)
+#define RMR_SIMD_X86
+#define RMR_TARGET_SSE2
+#define RMR_TARGET_AVX2
+#include <immintrin.h>
+#elif defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define RMR_SIMD_X86
+#define RMR_TARGET_SSE2 __attribute__((target("sse2")))
+#define RMR_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+#endif
+
 namespace {
   struct RMException : ::std::exception { //XXX currently duplicating this in realmagic_*.cpp files to avoid header pollution... TDB if this is a good idea...
     std::string _msg;
@@ -58,10 +74,28 @@ struct RenderOutputPixel {
   Bit8u alpha;
 };
 
+//hi-colour pixels are expanded the same way RENDER does it (low bits left clear)...
+//the transparent colour key is in the pixel's own format (see ReelMagic_InitVideoMixer())
+struct VGA15bppPixel {
+  enum { RED_SHIFT = 10, GREEN_BITS = 5, PIXEL_MASK = 0x7FFF };
+  Bit16u value;
+  template <typename T> inline void CopyRGBTo(T& out) const {out.red=(value>>7)&0xF8; out.green=(value>>2)&0xF8; out.blue=(value<<3)&0xF8;}
+};
+struct VGAUnder15bppPixel : VGA15bppPixel { inline bool IsTransparent() const { return true; } };
+struct VGAOver15bppPixel  : VGA15bppPixel {
+  static Bit16u _colorKey;
+  inline bool IsTransparent() const { return (value & PIXEL_MASK) == _colorKey; }
+};
+
 struct VGA16bppPixel {
-  /* ??? */
-  template <typename T> inline void CopyRGBTo(T& out) { }
-  inline bool IsTransparent() const { return false; }
+  enum { RED_SHIFT = 11, GREEN_BITS = 6, PIXEL_MASK = 0xFFFF };
+  Bit16u value;
+  template <typename T> inline void CopyRGBTo(T& out) const {out.red=(value>>8)&0xF8; out.green=(value>>3)&0xFC; out.blue=(value<<3)&0xF8;}
+};
+struct VGAUnder16bppPixel : VGA16bppPixel { inline bool IsTransparent() const { return true; } };
+struct VGAOver16bppPixel  : VGA16bppPixel {
+  static Bit16u _colorKey;
+  inline bool IsTransparent() const { return value == _colorKey; }
 };
 
 struct VGA32bppPixel {
@@ -72,8 +106,13 @@ struct VGA32bppPixel {
   template <typename T> inline void CopyRGBTo(T& out) const {out.red=red; out.green=green; out.blue=blue;}
 };
 struct VGAUnder32bppPixel : VGA32bppPixel { inline bool IsTransparent() const { return true; } };
-struct VGAOver32bppPixel  : VGA32bppPixel { inline bool IsTransparent() const { return (red|green|blue) == 0; } };
+struct VGAOver32bppPixel  : VGA32bppPixel {
+  static Bit32u _colorKey; //0xRRGGBB
+  inline bool IsTransparent() const { return (((Bit32u)red << 16) | ((Bit32u)green << 8) | blue) == _colorKey; }
+};
 
+//the palette doubles as a lookup table for the mixers... the entry of the alpha channel
+//index carries alpha 0xFF and all others 0, so a single lookup gives colour and transparency
 struct VGAPalettePixel {
   static VGA32bppPixel _vgaPalette[256];
   Bit8u index;
@@ -82,14 +121,17 @@ struct VGAPalettePixel {
 struct VGAUnderPalettePixel : VGAPalettePixel { inline bool IsTransparent() const { return true; } };
 struct VGAOverPalettePixel  : VGAPalettePixel {
   static Bit8u _alphaChannelIndex;
-  inline bool IsTransparent() const { return index == _alphaChannelIndex; }
+  inline bool IsTransparent() const { return _vgaPalette[index].alpha != 0; }
+  static void SetAlphaChannelIndex(const Bit8u alphaIndex) {
+    _vgaPalette[_alphaChannelIndex].alpha = 0;
+    _alphaChannelIndex = alphaIndex;
+    _vgaPalette[alphaIndex].alpha = 0xFF;
+  }
 };
 
-struct PlayerPicturePixel {
-  Bit8u red;
-  Bit8u green;
-  Bit8u blue;
-  template <typename T> inline void CopyRGBTo(T& out) const {out.red=red; out.green=green; out.blue=blue;}
+//same memory layout as RenderOutputPixel so the player converts straight into it (see plm_frame_row_to_bgra())
+struct PlayerPicturePixel : RenderOutputPixel {
+  inline void CopyRGBTo(RenderOutputPixel& out) const {out = *this;}
   inline bool IsTransparent() const {return false;}
 };
 }
@@ -107,6 +149,9 @@ static bool                     _vgaDup5Enabled           = false;
 //state captured from VGA
 VGA32bppPixel                   VGAPalettePixel::_vgaPalette[256];
 Bit8u                           VGAOverPalettePixel::_alphaChannelIndex = 0;
+Bit16u                          VGAOver15bppPixel::_colorKey = 0;
+Bit16u                          VGAOver16bppPixel::_colorKey = 0;
+Bit32u                          VGAOver32bppPixel::_colorKey = 0;
 static Bitu                     _vgaWidth                 = 0;
 static Bitu                     _vgaHeight                = 0;
 static Bitu                     _vgaBitsPerPixel          = 0; // != 0 on this variable means we have collected the first call
@@ -116,11 +161,22 @@ static bool                     _vgaDoubleWidth           = false;
 static bool                     _vgaDoubleHeight          = false;
 
 //state captured from current/active MPEG player
-static PlayerPicturePixel       _mpegPictureBuffer[SCALER_MAXWIDTH*SCALER_MAXHEIGHT];
-static PlayerPicturePixel      *_mpegPictureBufferPtr     = _mpegPictureBuffer;
 static Bitu                     _mpegPictureWidth         = 0;
 static Bitu                     _mpegPictureHeight        = 0;
 
+//the MPEG picture row last fetched from the player... only the columns showing through
+//the VGA picture are converted, and neighbouring RENDER lines often share a row
+static PlayerPicturePixel       _mpegLineBuffer[SCALER_MAXWIDTH];
+static Bitu                     _mpegLineRow              = (Bitu)-1; //(Bitu)-1 if nothing is fetched
+static Bitu                     _mpegLineBegin            = 0;
+static Bitu                     _mpegLineEnd              = 0;
+
+//MPEG scaling maps computed at mode change time (see BuildMpegScaleMaps())
+static Bit32u                   _mpegRowMap[SCALER_MAXHEIGHT];       //RENDER line -> MPEG picture row
+static Bit32u                   _mpegColumnMap[SCALER_MAXWIDTH];     //VGA column -> MPEG picture column
+static bool                     _mpegColumnMapIsIdentity  = true;
+static PlayerPicturePixel       _mpegScaledLineBuffer[SCALER_MAXWIDTH];
+
 static const Bitu               VIDEOMIXER_BITSPERPIXEL = 32;  //video mixer is exclusively 32bpp on the RENDER... VGA color palette mapping is re-done here...
 
 //current RENDER state
@@ -130,6 +186,24 @@ static ReelMagic_VideoMixerMPEGProvider                  *_requestedMpegProvider
 static ReelMagic_VideoMixerMPEGProvider                  *_activeMpegProvider = NULL;
 static RenderOutputPixel                                  _finalMixedRenderLineBuffer[SCALER_MAXWIDTH];
 static Bitu                                               _currentRenderLineNumber = 0;
+static Bitu                                               _vgaDup5LineCounter      = 0;
+
+//dirty line tracking... a VGA line is handed to RENDER as unchanged (NULL) when it and the
+//MPEG picture showing through it are the same as when it was last drawn. anything else
+//that changes the mixed output (mode, palette, alpha index) starts a new generation
+struct MixedLineState {
+  Bit32u generation; //_mixedLinesGeneration when last drawn
+  bool   showsMpeg;  //the MPEG picture showed through it
+  Bit8u  vga[SCALER_MAXWIDTH * 4]; //the VGA line as last drawn
+};
+static MixedLineState                                     _mixedLines[SCALER_MAXHEIGHT + 1]; //last entry is scratch for excess lines
+static MixedLineState                                    *_mixedLine               = &_mixedLines[0]; //VGA line being drawn
+static Bit32u                                             _mixedLinesGeneration    = 1;
+static Bitu                                               _vgaLineNumber           = 0;
+static Bitu                                               _vgaLineBytes            = 0;
+static bool                                               _skipCleanLines          = false; //for the frame being drawn
+static bool                                               _mpegPictureChanged      = true;  //since the last frame RENDER drew
+static bool                                               _mpegChangedThisFrame    = true;
 static Bitu                                               _renderWidth             = 0;
 static Bitu                                               _renderHeight            = 0;
 
@@ -144,6 +218,7 @@ static Bitu                                               _renderHeight
 //      how the game originally was as I don't have the hardware, but this seems like a reasonable
 //      workaround to make this look nice and clean for the mean time....
 //      also, as i'm carrying around an alpha channel, i should probably put that to good use...
+//      the "pure black" of the 15/16/32bpp modes can be changed with the "colorkey" setting...
 //
 template <typename VGAPixelT, typename MPEGPixelT>
 static inline void MixPixel(RenderOutputPixel& out, const VGAPixelT& vga, const MPEGPixelT& mpeg) {
@@ -160,14 +235,214 @@ static inline void MixPixel(RenderOutputPixel& out, const VGAPixelT& vga) {
   out.alpha = 0;
 }
 
-static void ClearMpegPictureBuffer(const PlayerPicturePixel& p) {
-  for (Bitu i = 0; i < (sizeof(_mpegPictureBuffer) / sizeof(_mpegPictureBuffer[0])); ++i)
-    _mpegPictureBuffer[i] = p;
+static inline void InvalidateMixedLines() {
+  ++_mixedLinesGeneration;
+}
+
+//returns true if the VGA line can be handed to RENDER as unchanged... the line is compared
+//with an exact copy of it as it was last drawn, the same way RENDER checks its lines
+static inline bool BeginMixedLine(const void * const src) {
+  const Bitu n = _vgaLineNumber++;
+  _mixedLine = &_mixedLines[(n < SCALER_MAXHEIGHT) ? n : SCALER_MAXHEIGHT];
+  if (_skipCleanLines && (n < SCALER_MAXHEIGHT) && (_mixedLine->generation == _mixedLinesGeneration) &&
+      !(_mixedLine->showsMpeg && _mpegChangedThisFrame) && (memcmp(_mixedLine->vga, src, _vgaLineBytes) == 0))
+    return true;
+  _mixedLine->generation = _mixedLinesGeneration;
+  _mixedLine->showsMpeg  = false; //set by MixMPEGLine()
+  memcpy(_mixedLine->vga, src, _vgaLineBytes);
+  return false;
+}
+
+//finds the first and last VGA pixels of a line the MPEG picture shows through...
+template <typename VGAPixelT>
+static inline bool FindTransparentSpan(const VGAPixelT *vga, const Bitu count, Bitu& first, Bitu& last) {
+  for (first = 0; (first < count) && (!vga[first].IsTransparent()); ++first);
+  if (first >= count) return false;
+  for (last = count - 1; !vga[last].IsTransparent(); --last);
+  return true;
 }
 
-static void ClearMpegPictureBuffer() {
-  PlayerPicturePixel p; p.red = 0; p.green = 0; p.blue = 0;
-  ClearMpegPictureBuffer(p);
+//MPEG picture columns begin..end-1 of a row... the rest of the returned line is stale
+static const PlayerPicturePixel *FetchMpegPictureRow(const Bitu row, const Bitu begin, const Bitu end) {
+  if ((row == _mpegLineRow) && (begin >= _mpegLineBegin) && (end <= _mpegLineEnd)) return _mpegLineBuffer;
+  if ((_activeMpegProvider == NULL) || (!_activeMpegProvider->GetPictureRow(_mpegLineBuffer, row, begin, end))) {
+    //no picture yet... show black
+    PlayerPicturePixel p; p.red = 0; p.green = 0; p.blue = 0; p.alpha = 0;
+    for (Bitu i = begin; i < end; ++i) _mpegLineBuffer[i] = p;
+  }
+  _mpegLineRow   = row;
+  _mpegLineBegin = begin;
+  _mpegLineEnd   = end;
+  return _mpegLineBuffer;
+}
+
+
+
+//
+// line mixing kernels... "mpeg" is already scaled to the VGA line here, one MPEG pixel per VGA pixel
+//
+template <typename VGAPixelT>
+static void MixLine_Scalar(RenderOutputPixel *out, const VGAPixelT *vga, const PlayerPicturePixel *mpeg, const Bitu count) {
+  for (Bitu i = 0; i < count; ++i)
+    MixPixel(out[i], vga[i], mpeg[i]);
+}
+
+static void GatherMpegLine_Scalar(PlayerPicturePixel *out, const PlayerPicturePixel *mpegRow, const Bit32u *columnMap, const Bitu count) {
+  for (Bitu i = 0; i < count; ++i)
+    out[i] = mpegRow[columnMap[i]];
+}
+
+#ifdef RMR_SIMD_X86
+//VGA pixels matching the colour key show the MPEG picture...
+RMR_TARGET_SSE2 static void MixLineOver32bpp_SSE2(RenderOutputPixel *out, const VGAOver32bppPixel *vga, const PlayerPicturePixel *mpeg, const Bitu count) {
+  const __m128i rgbMask  = _mm_set1_epi32(0x00FFFFFF);
+  const __m128i colorKey = _mm_set1_epi32(VGAOver32bppPixel::_colorKey);
+  Bitu i = 0;
+  for (; (i + 4) <= count; i += 4) {
+    const __m128i v   = _mm_and_si128(_mm_loadu_si128((const __m128i *)&vga[i]), rgbMask);
+    const __m128i m   = _mm_and_si128(_mm_loadu_si128((const __m128i *)&mpeg[i]), rgbMask);
+    const __m128i key = _mm_cmpeq_epi32(v, colorKey);
+    _mm_storeu_si128((__m128i *)&out[i], _mm_or_si128(_mm_andnot_si128(key, v), _mm_and_si128(key, m)));
+  }
+  MixLine_Scalar(&out[i], &vga[i], &mpeg[i], count - i);
+}
+
+RMR_TARGET_AVX2 static void MixLineOver32bpp_AVX2(RenderOutputPixel *out, const VGAOver32bppPixel *vga, const PlayerPicturePixel *mpeg, const Bitu count) {
+  const __m256i rgbMask  = _mm256_set1_epi32(0x00FFFFFF);
+  const __m256i colorKey = _mm256_set1_epi32(VGAOver32bppPixel::_colorKey);
+  Bitu i = 0;
+  for (; (i + 8) <= count; i += 8) {
+    const __m256i v   = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)&vga[i]), rgbMask);
+    const __m256i m   = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)&mpeg[i]), rgbMask);
+    const __m256i key = _mm256_cmpeq_epi32(v, colorKey);
+    _mm256_storeu_si256((__m256i *)&out[i], _mm256_blendv_epi8(v, m, key));
+  }
+  MixLine_Scalar(&out[i], &vga[i], &mpeg[i], count - i);
+}
+
+//hi-colour VGA pixels matching the colour key show the MPEG picture... the keys are compared
+//on the 16-bit pixels and then widened along with the pixels expanded to 32bpp
+template <typename VGAPixelT>
+RMR_TARGET_SSE2 static inline __m128i ExpandHiColor_SSE2(const __m128i x) {
+  const __m128i r = _mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(31 << VGAPixelT::RED_SHIFT)), 19 - VGAPixelT::RED_SHIFT);
+  const __m128i g = _mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(((1 << VGAPixelT::GREEN_BITS) - 1) << 5)), 11 - VGAPixelT::GREEN_BITS);
+  const __m128i b = _mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(31)), 3);
+  return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+template <typename VGAPixelT>
+RMR_TARGET_SSE2 static void MixLineOverHiColor_SSE2(RenderOutputPixel *out, const VGAPixelT *vga, const PlayerPicturePixel *mpeg, const Bitu count) {
+  const __m128i rgbMask   = _mm_set1_epi32(0x00FFFFFF);
+  const __m128i pixelMask = _mm_set1_epi16((short)VGAPixelT::PIXEL_MASK);
+  const __m128i colorKey  = _mm_set1_epi16((short)VGAPixelT::_colorKey);
+  const __m128i zero      = _mm_setzero_si128();
+  Bitu i = 0;
+  for (; (i + 8) <= count; i += 8) {
+    const __m128i v     = _mm_and_si128(_mm_loadu_si128((const __m128i *)&vga[i]), pixelMask);
+    const __m128i key   = _mm_cmpeq_epi16(v, colorKey);
+    const __m128i keyLo = _mm_unpacklo_epi16(key, key);
+    const __m128i keyHi = _mm_unpackhi_epi16(key, key);
+    const __m128i vLo   = ExpandHiColor_SSE2<VGAPixelT>(_mm_unpacklo_epi16(v, zero));
+    const __m128i vHi   = ExpandHiColor_SSE2<VGAPixelT>(_mm_unpackhi_epi16(v, zero));
+    const __m128i mLo   = _mm_and_si128(_mm_loadu_si128((const __m128i *)&mpeg[i]), rgbMask);
+    const __m128i mHi   = _mm_and_si128(_mm_loadu_si128((const __m128i *)&mpeg[i + 4]), rgbMask);
+    _mm_storeu_si128((__m128i *)&out[i],     _mm_or_si128(_mm_andnot_si128(keyLo, vLo), _mm_and_si128(keyLo, mLo)));
+    _mm_storeu_si128((__m128i *)&out[i + 4], _mm_or_si128(_mm_andnot_si128(keyHi, vHi), _mm_and_si128(keyHi, mHi)));
+  }
+  MixLine_Scalar(&out[i], &vga[i], &mpeg[i], count - i);
+}
+
+template <typename VGAPixelT>
+RMR_TARGET_AVX2 static inline __m256i ExpandHiColor_AVX2(const __m256i x) {
+  const __m256i r = _mm256_slli_epi32(_mm256_and_si256(x, _mm256_set1_epi32(31 << VGAPixelT::RED_SHIFT)), 19 - VGAPixelT::RED_SHIFT);
+  const __m256i g = _mm256_slli_epi32(_mm256_and_si256(x, _mm256_set1_epi32(((1 << VGAPixelT::GREEN_BITS) - 1) << 5)), 11 - VGAPixelT::GREEN_BITS);
+  const __m256i b = _mm256_slli_epi32(_mm256_and_si256(x, _mm256_set1_epi32(31)), 3);
+  return _mm256_or_si256(_mm256_or_si256(r, g), b);
+}
+
+template <typename VGAPixelT>
+RMR_TARGET_AVX2 static void MixLineOverHiColor_AVX2(RenderOutputPixel *out, const VGAPixelT *vga, const PlayerPicturePixel *mpeg, const Bitu count) {
+  const __m256i rgbMask   = _mm256_set1_epi32(0x00FFFFFF);
+  const __m256i pixelMask = _mm256_set1_epi16((short)VGAPixelT::PIXEL_MASK);
+  const __m256i colorKey  = _mm256_set1_epi16((short)VGAPixelT::_colorKey);
+  Bitu i = 0;
+  for (; (i + 16) <= count; i += 16) {
+    const __m256i v     = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)&vga[i]), pixelMask);
+    const __m256i key   = _mm256_cmpeq_epi16(v, colorKey);
+    const __m256i keyLo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(key));
+    const __m256i keyHi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(key, 1));
+    const __m256i vLo   = ExpandHiColor_AVX2<VGAPixelT>(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(v)));
+    const __m256i vHi   = ExpandHiColor_AVX2<VGAPixelT>(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1)));
+    const __m256i mLo   = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)&mpeg[i]), rgbMask);
+    const __m256i mHi   = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)&mpeg[i + 8]), rgbMask);
+    _mm256_storeu_si256((__m256i *)&out[i],     _mm256_blendv_epi8(vLo, mLo, keyLo));
+    _mm256_storeu_si256((__m256i *)&out[i + 8], _mm256_blendv_epi8(vHi, mHi, keyHi));
+  }
+  MixLine_Scalar(&out[i], &vga[i], &mpeg[i], count - i);
+}
+
+//VGA pixels using the alpha channel palette index show the MPEG picture... the alpha byte of
+//the palette entries is spread over the whole pixel to select the MPEG one
+//SSE2 has no gather, so the palette lookups are still done one at a time
+RMR_TARGET_SSE2 static void MixLineOverPalette_SSE2(RenderOutputPixel *out, const VGAOverPalettePixel *vga, const PlayerPicturePixel *mpeg, const Bitu count) {
+  const Bit32u * const palette = (const Bit32u *)VGAPalettePixel::_vgaPalette;
+  const __m128i rgbMask = _mm_set1_epi32(0x00FFFFFF);
+  Bitu i = 0;
+  for (; (i + 4) <= count; i += 4) {
+    const __m128i v   = _mm_set_epi32(palette[vga[i+3].index], palette[vga[i+2].index], palette[vga[i+1].index], palette[vga[i].index]);
+    const __m128i m   = _mm_loadu_si128((const __m128i *)&mpeg[i]);
+    const __m128i key = _mm_srai_epi32(v, 31);
+    _mm_storeu_si128((__m128i *)&out[i], _mm_and_si128(_mm_or_si128(_mm_andnot_si128(key, v), _mm_and_si128(key, m)), rgbMask));
+  }
+  MixLine_Scalar(&out[i], &vga[i], &mpeg[i], count - i);
+}
+
+RMR_TARGET_AVX2 static void MixLineOverPalette_AVX2(RenderOutputPixel *out, const VGAOverPalettePixel *vga, const PlayerPicturePixel *mpeg, const Bitu count) {
+  const int * const palette = (const int *)VGAPalettePixel::_vgaPalette;
+  const __m256i rgbMask = _mm256_set1_epi32(0x00FFFFFF);
+  Bitu i = 0;
+  for (; (i + 8) <= count; i += 8) {
+    const __m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)&vga[i]));
+    const __m256i v     = _mm256_i32gather_epi32(palette, index, 4);
+    const __m256i m     = _mm256_loadu_si256((const __m256i *)&mpeg[i]);
+    const __m256i key   = _mm256_srai_epi32(v, 31);
+    _mm256_storeu_si256((__m256i *)&out[i], _mm256_and_si256(_mm256_blendv_epi8(v, m, key), rgbMask));
+  }
+  MixLine_Scalar(&out[i], &vga[i], &mpeg[i], count - i);
+}
+
+RMR_TARGET_AVX2 static void GatherMpegLine_AVX2(PlayerPicturePixel *out, const PlayerPicturePixel *mpegRow, const Bit32u *columnMap, const Bitu count) {
+  Bitu i = 0;
+  for (; (i + 8) <= count; i += 8) {
+    const __m256i columns = _mm256_loadu_si256((const __m256i *)&columnMap[i]);
+    _mm256_storeu_si256((__m256i *)&out[i], _mm256_i32gather_epi32((const int *)mpegRow, columns, 4));
+  }
+  GatherMpegLine_Scalar(&out[i], mpegRow, &columnMap[i], count - i);
+}
+#endif
+
+//kernels in use; picked by ReelMagic_InitVideoMixer()
+static void (*_mixLineOver32bpp)(RenderOutputPixel *, const VGAOver32bppPixel *, const PlayerPicturePixel *, const Bitu)     = &MixLine_Scalar<VGAOver32bppPixel>;
+static void (*_mixLineOverPalette)(RenderOutputPixel *, const VGAOverPalettePixel *, const PlayerPicturePixel *, const Bitu) = &MixLine_Scalar<VGAOverPalettePixel>;
+static void (*_mixLineOver15bpp)(RenderOutputPixel *, const VGAOver15bppPixel *, const PlayerPicturePixel *, const Bitu)     = &MixLine_Scalar<VGAOver15bppPixel>;
+static void (*_mixLineOver16bpp)(RenderOutputPixel *, const VGAOver16bppPixel *, const PlayerPicturePixel *, const Bitu)     = &MixLine_Scalar<VGAOver16bppPixel>;
+static void (*_gatherMpegLine)(PlayerPicturePixel *, const PlayerPicturePixel *, const Bit32u *, const Bitu)                  = &GatherMpegLine_Scalar;
+
+template <typename VGAPixelT>
+static inline void MixLine(RenderOutputPixel *out, const VGAPixelT *vga, const PlayerPicturePixel *mpeg, const Bitu count) {
+  MixLine_Scalar(out, vga, mpeg, count);
+}
+static inline void MixLine(RenderOutputPixel *out, const VGAOver32bppPixel *vga, const PlayerPicturePixel *mpeg, const Bitu count) {
+  _mixLineOver32bpp(out, vga, mpeg, count);
+}
+static inline void MixLine(RenderOutputPixel *out, const VGAOverPalettePixel *vga, const PlayerPicturePixel *mpeg, const Bitu count) {
+  _mixLineOverPalette(out, vga, mpeg, count);
+}
+static inline void MixLine(RenderOutputPixel *out, const VGAOver15bppPixel *vga, const PlayerPicturePixel *mpeg, const Bitu count) {
+  _mixLineOver15bpp(out, vga, mpeg, count);
+}
+static inline void MixLine(RenderOutputPixel *out, const VGAOver16bppPixel *vga, const PlayerPicturePixel *mpeg, const Bitu count) {
+  _mixLineOver16bpp(out, vga, mpeg, count);
 }
 
 
@@ -179,14 +454,10 @@ static void ClearMpegPictureBuffer() {
 // they are called at a high frequency... these functions are
 // responsible for both mixing pixels and scaling the VGA and
 // MPEG pictures...
-// 
-// TODO: Go through and profile these and test things like 
-//       using a lookup table vs computing values on the fly...
-//       is the general purpose function just as fast
-//       the specicific purpose ones?
-//       For the first go at this, the specific purpose functions
-//       were indeed faster, but so much has changed since then
-//       that this may no longer be the case
+//
+// the MPEG picture is scaled with the row and column maps built
+// by BuildMpegScaleMaps() at mode change time, so all MPEG
+// scaling modes share the same line renderers...
 //
 static void RMR_DrawLine_Passthrough(const void *src) {
   RENDER_DrawLine(src);
@@ -204,24 +475,36 @@ static void RMR_DrawLine_MixerError(const void *src) {
 //its not real enterprise C++ until yer mixing macros and templates...
 #define CREATE_RMR_VGA_TYPED_FUNCTIONS(DRAWLINE_FUNC_NAME)                                                           \
   static void DRAWLINE_FUNC_NAME##_VGAO8(const void *src)  {DRAWLINE_FUNC_NAME((const VGAOverPalettePixel *)src);}   \
+  static void DRAWLINE_FUNC_NAME##_VGAO15(const void *src) {DRAWLINE_FUNC_NAME((const VGAOver15bppPixel*)src);}      \
+  static void DRAWLINE_FUNC_NAME##_VGAO16(const void *src) {DRAWLINE_FUNC_NAME((const VGAOver16bppPixel*)src);}      \
   static void DRAWLINE_FUNC_NAME##_VGAO32(const void *src) {DRAWLINE_FUNC_NAME((const VGAOver32bppPixel*)src);}      \
   static void DRAWLINE_FUNC_NAME##_VGAU8(const void *src)  {DRAWLINE_FUNC_NAME((const VGAUnderPalettePixel *)src);}  \
+  static void DRAWLINE_FUNC_NAME##_VGAU15(const void *src) {DRAWLINE_FUNC_NAME((const VGAUnder15bppPixel*)src);}     \
+  static void DRAWLINE_FUNC_NAME##_VGAU16(const void *src) {DRAWLINE_FUNC_NAME((const VGAUnder16bppPixel*)src);}     \
   static void DRAWLINE_FUNC_NAME##_VGAU32(const void *src) {DRAWLINE_FUNC_NAME((const VGAUnder32bppPixel*)src);}     \
 
 #define ASSIGN_RMR_DRAWLINE_FUNCTION(DRAWLINE_FUNC_NAME, VGA_BPP, VGA_OVER) { \
   if (VGA_OVER) switch(VGA_BPP) {                                             \
   case 8:  ReelMagic_RENDER_DrawLine = &DRAWLINE_FUNC_NAME##_VGAO8;  break;   \
+  case 15: ReelMagic_RENDER_DrawLine = &DRAWLINE_FUNC_NAME##_VGAO15; break;   \
+  case 16: ReelMagic_RENDER_DrawLine = &DRAWLINE_FUNC_NAME##_VGAO16; break;   \
   case 32: ReelMagic_RENDER_DrawLine = &DRAWLINE_FUNC_NAME##_VGAO32; break;   \
   default: ReelMagic_RENDER_DrawLine = &RMR_DrawLine_MixerError;     break;   \
   }                                                                           \
   else switch(VGA_BPP) {                                                      \
   case 8:  ReelMagic_RENDER_DrawLine = &DRAWLINE_FUNC_NAME##_VGAU8;  break;   \
+  case 15: ReelMagic_RENDER_DrawLine = &DRAWLINE_FUNC_NAME##_VGAU15; break;   \
+  case 16: ReelMagic_RENDER_DrawLine = &DRAWLINE_FUNC_NAME##_VGAU16; break;   \
   case 32: ReelMagic_RENDER_DrawLine = &DRAWLINE_FUNC_NAME##_VGAU32; break;   \
   default: ReelMagic_RENDER_DrawLine = &RMR_DrawLine_MixerError;     break;   \
   }                                                                           \
 }
 
 template <typename T> static inline void RMR_DrawLine_VGAOnly(const T *src) {
+  if (BeginMixedLine(src)) {
+    RENDER_DrawLine(NULL);
+    return;
+  }
   const Bitu lineWidth          = _vgaWidth;
   RenderOutputPixel * const out = _finalMixedRenderLineBuffer;
   for (Bitu i = 0; i < lineWidth; ++i)
@@ -229,130 +512,100 @@ template <typename T> static inline void RMR_DrawLine_VGAOnly(const T *src) {
   RENDER_DrawLine(_finalMixedRenderLineBuffer);
 } CREATE_RMR_VGA_TYPED_FUNCTIONS(RMR_DrawLine_VGAOnly)
 
-template <typename T> static inline void RMR_DrawLine_VGAMPEGSameSize(const T *src) {
-  const Bitu lineWidth          = _vgaWidth;
-  RenderOutputPixel * const out = _finalMixedRenderLineBuffer;
-  for (Bitu i = 0; i < lineWidth; ++i)
-    MixPixel(out[i], src[i], _mpegPictureBufferPtr[i]);
-  _mpegPictureBufferPtr += _mpegPictureWidth;
-  RENDER_DrawLine(_finalMixedRenderLineBuffer);
-} CREATE_RMR_VGA_TYPED_FUNCTIONS(RMR_DrawLine_VGAMPEGSameSize)
-
-//VGA Sized Output (RENDER) functions...
-template <typename T> static inline void RMR_DrawLine_VSO_MPEGDoubleVGASize(const T *src) {
-  const Bitu lineWidth          = _vgaWidth;
-  RenderOutputPixel * const out = _finalMixedRenderLineBuffer;
-  _mpegPictureBufferPtr -= _mpegPictureWidth * (_currentRenderLineNumber++ & 1);
-  for (Bitu i = 0; i < lineWidth; ++i) {
-    MixPixel(out[i], src[i], _mpegPictureBufferPtr[i >> 1]);
+template <typename T> static inline void MixMPEGLine(const T *src, const bool clean) {
+  const Bitu line = (_currentRenderLineNumber < SCALER_MAXHEIGHT) ? _currentRenderLineNumber++ : (SCALER_MAXHEIGHT - 1);
+  if (clean) {
+    RENDER_DrawLine(NULL);
+    return;
   }
-  _mpegPictureBufferPtr += _mpegPictureWidth;
-  RENDER_DrawLine(_finalMixedRenderLineBuffer);
-} CREATE_RMR_VGA_TYPED_FUNCTIONS(RMR_DrawLine_VSO_MPEGDoubleVGASize)
-
-template <typename T> static inline void RMR_DrawLine_VSO_VGAMPEGSameWidthSkip6Vertical(const T *src) {
-  const Bitu lineWidth          = _vgaWidth;
-  RenderOutputPixel * const out = _finalMixedRenderLineBuffer;
-  for (Bitu i = 0; i < lineWidth; ++i)
-    MixPixel(out[i], src[i], _mpegPictureBufferPtr[i]);
-  _mpegPictureBufferPtr += _mpegPictureWidth;
-  if (++_currentRenderLineNumber >= 6) {
-    _currentRenderLineNumber = 0;
-    _mpegPictureBufferPtr += _mpegPictureWidth;
+  Bitu first, last;
+  if (!FindTransparentSpan(src, _vgaWidth, first, last)) {
+    //nothing shows through... the MPEG pixels are never picked, so skip fetching them
+    MixLine(_finalMixedRenderLineBuffer, src, _mpegLineBuffer, _vgaWidth);
+    RENDER_DrawLine(_finalMixedRenderLineBuffer);
+    return;
   }
-  RENDER_DrawLine(_finalMixedRenderLineBuffer);
-} CREATE_RMR_VGA_TYPED_FUNCTIONS(RMR_DrawLine_VSO_VGAMPEGSameWidthSkip6Vertical)
-
-template <typename T> static inline void RMR_DrawLine_VSO_VGAMPEGDoubleSameWidthSkip6Vertical(const T *src) {
-  const Bitu lineWidth          = _vgaWidth;
-  RenderOutputPixel * const out = _finalMixedRenderLineBuffer;
-  _mpegPictureBufferPtr -= _mpegPictureWidth * (_currentRenderLineNumber & 1);
-  for (Bitu i = 0; i < lineWidth; ++i)
-    MixPixel(out[i], src[i], _mpegPictureBufferPtr[i >> 1]);
-  _mpegPictureBufferPtr += _mpegPictureWidth;
-  if (++_currentRenderLineNumber >= 6) {
-    _currentRenderLineNumber = 0;
-    _mpegPictureBufferPtr += _mpegPictureWidth;
+  _mixedLine->showsMpeg = true;
+  const PlayerPicturePixel *mpeg = FetchMpegPictureRow(_mpegRowMap[line], _mpegColumnMap[first], _mpegColumnMap[last] + 1);
+  if (!_mpegColumnMapIsIdentity) {
+    _gatherMpegLine(_mpegScaledLineBuffer, mpeg, _mpegColumnMap, _vgaWidth);
+    mpeg = _mpegScaledLineBuffer;
   }
+  MixLine(_finalMixedRenderLineBuffer, src, mpeg, _vgaWidth);
   RENDER_DrawLine(_finalMixedRenderLineBuffer);
-} CREATE_RMR_VGA_TYPED_FUNCTIONS(RMR_DrawLine_VSO_VGAMPEGDoubleSameWidthSkip6Vertical)
+}
+
+template <typename T> static inline void RMR_DrawLine_MixMPEG(const T *src) {
+  MixMPEGLine(src, BeginMixedLine(src));
+} CREATE_RMR_VGA_TYPED_FUNCTIONS(RMR_DrawLine_MixMPEG)
 
 
 
 //VGA "Dup 5" functions
 
 template <typename T> static inline void RMR_DrawLine_VGAOnlyDup5Vertical(const T *src) {
+  const bool clean              = BeginMixedLine(src);
   const Bitu lineWidth          = _vgaWidth;
   RenderOutputPixel * const out = _finalMixedRenderLineBuffer;
-  for (Bitu i = 0; i < lineWidth; ++i)
+  if (!clean) for (Bitu i = 0; i < lineWidth; ++i)
     MixPixel(out[i], src[i]);
+  const void * const line = clean ? NULL : _finalMixedRenderLineBuffer;
   if (++_currentRenderLineNumber >= 5) {
     _currentRenderLineNumber = 0;
-    RENDER_DrawLine(_finalMixedRenderLineBuffer);
+    RENDER_DrawLine(line);
   }
-  RENDER_DrawLine(_finalMixedRenderLineBuffer);
+  RENDER_DrawLine(line);
 } CREATE_RMR_VGA_TYPED_FUNCTIONS(RMR_DrawLine_VGAOnlyDup5Vertical)
 
-template <typename T> static inline void RMR_DrawLine_VGADup5VerticalMPEGSameSize(const T *src) {
-  const Bitu lineWidth          = _vgaWidth;
-  RenderOutputPixel * const out = _finalMixedRenderLineBuffer;
-  for (Bitu i = 0; i < lineWidth; ++i)
-    MixPixel(out[i], src[i], _mpegPictureBufferPtr[i]);
-  _mpegPictureBufferPtr += _mpegPictureWidth;
-  RENDER_DrawLine(_finalMixedRenderLineBuffer);
-
-  if (++_currentRenderLineNumber >= 5) {
-    _currentRenderLineNumber = 0;
-    RMR_DrawLine_VGADup5VerticalMPEGSameSize(src);
-    _currentRenderLineNumber = 0;
+template <typename T> static inline void RMR_DrawLine_MixMPEGDup5Vertical(const T *src) {
+  const bool clean = BeginMixedLine(src);
+  MixMPEGLine(src, clean);
+  if (++_vgaDup5LineCounter >= 5) {
+    _vgaDup5LineCounter = 0;
+    MixMPEGLine(src, clean); //every 5th VGA line is shown twice against the next MPEG row
   }
-} CREATE_RMR_VGA_TYPED_FUNCTIONS(RMR_DrawLine_VGADup5VerticalMPEGSameSize)
+} CREATE_RMR_VGA_TYPED_FUNCTIONS(RMR_DrawLine_MixMPEGDup5Vertical)
 
 
 
 //
-// the catch-all un-optimized MPEG scaling function...
+// MPEG scaling maps...
 //
-// WARNING: this ended up being kinda hacky...
-//          should we perheps re-think this; possibly using a
-//          lookup table computed at mode change time?
-//
-static Bitu _RMR_DrawLine_VSO_GeneralResizeMPEGToVGA_WidthRatio     = 0;
-static Bitu _RMR_DrawLine_VSO_GeneralResizeMPEGToVGA_HeightRatio    = 0;
-static Bitu _RMR_DrawLine_VSO_GeneralResizeMPEGToVGADup5LineCounter = 0;
-static void Initialize_RMR_DrawLine_VSO_GeneralResizeMPEGToVGA_Dimensions() {
-  _RMR_DrawLine_VSO_GeneralResizeMPEGToVGA_WidthRatio   = _mpegPictureWidth << 12;
-  _RMR_DrawLine_VSO_GeneralResizeMPEGToVGA_WidthRatio  /= _renderWidth;
-  _RMR_DrawLine_VSO_GeneralResizeMPEGToVGA_HeightRatio  = _mpegPictureHeight << 12;
-  _RMR_DrawLine_VSO_GeneralResizeMPEGToVGA_HeightRatio /= _renderHeight;
-}
-template <typename T> static inline void RMR_DrawLine_VSO_GeneralResizeMPEGToVGA(const T *src) {
-  const Bitu lineWidth          = _vgaWidth;
-  RenderOutputPixel * const out = _finalMixedRenderLineBuffer;
-  for (Bitu i = 0; i < lineWidth; ++i)
-    MixPixel(out[i], src[i], _mpegPictureBufferPtr[(i * _RMR_DrawLine_VSO_GeneralResizeMPEGToVGA_WidthRatio) >> 12]);
-  _mpegPictureBufferPtr =
-    &_mpegPictureBuffer[_mpegPictureWidth *
-      ((++_currentRenderLineNumber * _RMR_DrawLine_VSO_GeneralResizeMPEGToVGA_HeightRatio) >> 12)];
-  RENDER_DrawLine(_finalMixedRenderLineBuffer);
-} CREATE_RMR_VGA_TYPED_FUNCTIONS(RMR_DrawLine_VSO_GeneralResizeMPEGToVGA)
-
-template <typename T> static inline void RMR_DrawLine_VSO_GeneralResizeMPEGToVGADup5(const T *src) {
-  const Bitu lineWidth          = _vgaWidth;
-  RenderOutputPixel * const out = _finalMixedRenderLineBuffer;
-  for (Bitu i = 0; i < lineWidth; ++i)
-    MixPixel(out[i], src[i], _mpegPictureBufferPtr[(i * _RMR_DrawLine_VSO_GeneralResizeMPEGToVGA_WidthRatio) >> 12]);
-  _mpegPictureBufferPtr =
-    &_mpegPictureBuffer[_mpegPictureWidth *
-      ((++_currentRenderLineNumber * _RMR_DrawLine_VSO_GeneralResizeMPEGToVGA_HeightRatio) >> 12)];
-  RENDER_DrawLine(_finalMixedRenderLineBuffer);
+enum MpegScaleMode {
+  MPEG_SCALE_NONE,
+  MPEG_SCALE_DOUBLE,
+  MPEG_SCALE_SKIP6,        //every 6th MPEG row is skipped
+  MPEG_SCALE_DOUBLE_SKIP6, //rows doubled; after every 6 RENDER lines one MPEG row is skipped
+  MPEG_SCALE_GENERAL,      //12-bit fixed point resize to the RENDER size
+};
+static void BuildMpegScaleMaps(const MpegScaleMode mode) {
+  const Bitu widthRatio  = (_mpegPictureWidth << 12) / _renderWidth;
+  const Bitu heightRatio = (_mpegPictureHeight << 12) / _renderHeight;
+  const Bitu maxRow      = (_mpegPictureHeight > 0) ? (_mpegPictureHeight - 1) : 0;
+
+  for (Bitu line = 0; line < SCALER_MAXHEIGHT; ++line) {
+    Bitu row;
+    switch (mode) {
+    case MPEG_SCALE_NONE:         row = line;                                  break;
+    case MPEG_SCALE_DOUBLE:       row = line >> 1;                             break;
+    case MPEG_SCALE_SKIP6:        row = line + (line / 6);                     break;
+    case MPEG_SCALE_DOUBLE_SKIP6: row = ((line / 6) * 4) + ((line % 6) >> 1);  break;
+    default:                      row = (line * heightRatio) >> 12;            break;
+    }
+    if (row > maxRow) row = maxRow; //stay inside the picture if VGA sends more lines than expected
+    _mpegRowMap[line] = (Bit32u)row;
+  }
 
-  if (++_RMR_DrawLine_VSO_GeneralResizeMPEGToVGADup5LineCounter >= 5) {
-    _RMR_DrawLine_VSO_GeneralResizeMPEGToVGADup5LineCounter = 0;
-    RMR_DrawLine_VSO_GeneralResizeMPEGToVGADup5(src);
-    _RMR_DrawLine_VSO_GeneralResizeMPEGToVGADup5LineCounter = 0;
+  _mpegColumnMapIsIdentity = (mode == MPEG_SCALE_NONE) || (mode == MPEG_SCALE_SKIP6);
+  for (Bitu col = 0; col < _vgaWidth; ++col) {
+    switch (mode) {
+    case MPEG_SCALE_DOUBLE:
+    case MPEG_SCALE_DOUBLE_SKIP6: _mpegColumnMap[col] = col >> 1;                        break;
+    case MPEG_SCALE_GENERAL:      _mpegColumnMap[col] = (col * widthRatio) >> 12;        break;
+    default:                      _mpegColumnMap[col] = col;                             break;
+    }
   }
-} CREATE_RMR_VGA_TYPED_FUNCTIONS(RMR_DrawLine_VSO_GeneralResizeMPEGToVGADup5)
+}
 
 
 
@@ -366,6 +619,9 @@ static void SetupVideoMixer(const bool updateRenderMode) {
   //    . We have not yet received a VGA mode/configuration
   //    . The video mixer is in an error state
   _activeMpegProvider = NULL; //no MPEG activation unless all is good...
+  InvalidateMixedLines();
+  _vgaLineBytes = _vgaWidth * ((_vgaBitsPerPixel + 7) / 8);
+  if (_vgaLineBytes > sizeof(_mixedLines[0].vga)) _vgaLineBytes = sizeof(_mixedLines[0].vga); //never wider than RENDER allows
 
   //need at least one call from VGA before we can do this...
   if (_vgaBitsPerPixel == 0) return;
@@ -441,35 +697,37 @@ static void SetupVideoMixer(const bool updateRenderMode) {
   else {
     if (_vgaDup5Enabled) {
       if ((_renderWidth != _mpegPictureWidth) || (_renderHeight != _mpegPictureHeight)) {
-        modeStr = "Generic Unoptimized MPEG Resize to DUP5 VGA Pictures";
-        Initialize_RMR_DrawLine_VSO_GeneralResizeMPEGToVGA_Dimensions();
-        ASSIGN_RMR_DRAWLINE_FUNCTION(RMR_DrawLine_VSO_GeneralResizeMPEGToVGADup5, _vgaBitsPerPixel, vgaOver);
+        modeStr = "Generic MPEG Resize to DUP5 VGA Pictures";
+        BuildMpegScaleMaps(MPEG_SCALE_GENERAL);
       }
       else {
         modeStr = "Matching Sized MPEG to DUP5 VGA Pictures";
-        ASSIGN_RMR_DRAWLINE_FUNCTION(RMR_DrawLine_VGADup5VerticalMPEGSameSize, _vgaBitsPerPixel, vgaOver);
+        BuildMpegScaleMaps(MPEG_SCALE_NONE);
       }
-    }
-    else if ((_vgaWidth == _mpegPictureWidth) && (_vgaHeight == _mpegPictureHeight)) {
-      modeStr = "Matching Sized MPEG to VGA Pictures";
-      ASSIGN_RMR_DRAWLINE_FUNCTION(RMR_DrawLine_VGAMPEGSameSize, _vgaBitsPerPixel, vgaOver);
-    }
-    else if ((_vgaWidth == (_mpegPictureWidth*2)) && (_vgaHeight == ((_mpegPictureHeight*2)))) {
-      modeStr = "Double Sized MPEG to VGA Pictures";
-      ASSIGN_RMR_DRAWLINE_FUNCTION(RMR_DrawLine_VSO_MPEGDoubleVGASize, _vgaBitsPerPixel, vgaOver);
-    }
-    else if ((_vgaWidth == _mpegPictureWidth) && ((_mpegPictureHeight / (_mpegPictureHeight - _vgaHeight)) == 6)) {
-      modeStr = "Matching Sized MPEG to VGA Pictures, skipping every 6th MPEG line";
-      ASSIGN_RMR_DRAWLINE_FUNCTION(RMR_DrawLine_VSO_VGAMPEGSameWidthSkip6Vertical, _vgaBitsPerPixel, vgaOver);
-    }
-    else if ((_vgaWidth == (_mpegPictureWidth*2)) && (((_mpegPictureHeight*2) / ((_mpegPictureHeight*2) - _vgaHeight)) == 6)) {
-      modeStr = "Double Sized MPEG to VGA Pictures, skipping every 6th MPEG line";
-      ASSIGN_RMR_DRAWLINE_FUNCTION(RMR_DrawLine_VSO_VGAMPEGDoubleSameWidthSkip6Vertical, _vgaBitsPerPixel, vgaOver);
+      ASSIGN_RMR_DRAWLINE_FUNCTION(RMR_DrawLine_MixMPEGDup5Vertical, _vgaBitsPerPixel, vgaOver);
     }
     else {
-      modeStr = "Generic Unoptimized MPEG Resize";
-      Initialize_RMR_DrawLine_VSO_GeneralResizeMPEGToVGA_Dimensions();
-      ASSIGN_RMR_DRAWLINE_FUNCTION(RMR_DrawLine_VSO_GeneralResizeMPEGToVGA, _vgaBitsPerPixel, vgaOver);
+      if ((_vgaWidth == _mpegPictureWidth) && (_vgaHeight == _mpegPictureHeight)) {
+        modeStr = "Matching Sized MPEG to VGA Pictures";
+        BuildMpegScaleMaps(MPEG_SCALE_NONE);
+      }
+      else if ((_vgaWidth == (_mpegPictureWidth*2)) && (_vgaHeight == ((_mpegPictureHeight*2)))) {
+        modeStr = "Double Sized MPEG to VGA Pictures";
+        BuildMpegScaleMaps(MPEG_SCALE_DOUBLE);
+      }
+      else if ((_vgaWidth == _mpegPictureWidth) && ((_mpegPictureHeight / (_mpegPictureHeight - _vgaHeight)) == 6)) {
+        modeStr = "Matching Sized MPEG to VGA Pictures, skipping every 6th MPEG line";
+        BuildMpegScaleMaps(MPEG_SCALE_SKIP6);
+      }
+      else if ((_vgaWidth == (_mpegPictureWidth*2)) && (((_mpegPictureHeight*2) / ((_mpegPictureHeight*2) - _vgaHeight)) == 6)) {
+        modeStr = "Double Sized MPEG to VGA Pictures, skipping every 6th MPEG line";
+        BuildMpegScaleMaps(MPEG_SCALE_DOUBLE_SKIP6);
+      }
+      else {
+        modeStr = "Generic MPEG Resize";
+        BuildMpegScaleMaps(MPEG_SCALE_GENERAL);
+      }
+      ASSIGN_RMR_DRAWLINE_FUNCTION(RMR_DrawLine_MixMPEG, _vgaBitsPerPixel, vgaOver);
     }
   }
 
@@ -488,10 +746,11 @@ static void SetupVideoMixer(const bool updateRenderMode) {
 //
 void ReelMagic_RENDER_SetPal(Bit8u entry,Bit8u red,Bit8u green,Bit8u blue) {
   VGA32bppPixel& p = VGAPalettePixel::_vgaPalette[entry];
+  if ((p.red != red) || (p.green != green) || (p.blue != blue)) InvalidateMixedLines();
   p.red    = red;
   p.green  = green;
   p.blue   = blue;
-  p.alpha  = 0;
+  p.alpha  = (entry == VGAOverPalettePixel::_alphaChannelIndex) ? 0xFF : 0;
   RENDER_SetPal(entry, red, green, blue);
 }
 
@@ -509,17 +768,30 @@ void ReelMagic_RENDER_SetSize(Bitu width,Bitu height,Bitu bpp,float fps,double r
 
 bool ReelMagic_RENDER_StartUpdate(void) {
   if (_activeMpegProvider) {
-    VGAOverPalettePixel::_alphaChannelIndex = _activeMpegProvider->GetConfig().VgaAlphaIndex;
-    _activeMpegProvider->OnVerticalRefresh(_mpegPictureBuffer, _vgaFramesPerSecond);
+    const Bit8u alphaIndex = _activeMpegProvider->GetConfig().VgaAlphaIndex;
+    if (alphaIndex != VGAOverPalettePixel::_alphaChannelIndex) {
+      VGAOverPalettePixel::SetAlphaChannelIndex(alphaIndex);
+      InvalidateMixedLines();
+    }
+    if (_activeMpegProvider->OnVerticalRefresh(_vgaFramesPerSecond)) _mpegPictureChanged = true;
   }
+  _mpegLineRow = (Bitu)-1; //the picture may have changed
   _currentRenderLineNumber = 0;
-  _mpegPictureBufferPtr = _mpegPictureBuffer;
-  return RENDER_StartUpdate();
+  _vgaDup5LineCounter = 0;
+  _vgaLineNumber = 0;
+  if (!RENDER_StartUpdate()) return false;
+
+  //RENDER can't take unchanged lines when it redraws the whole frame (cleared cache,
+  //palette change, capturing)... the lines are still recorded for the next frame
+  _skipCleanLines = !render.fullFrame;
+  _mpegChangedThisFrame = _mpegPictureChanged;
+  _mpegPictureChanged = false;
+  return true;
 }
 
 void ReelMagic_ResetVideoMixer() {
   _requestedMpegProvider = NULL;
-  ClearMpegPictureBuffer();
+  _mpegLineRow = (Bitu)-1;
 }
 
 void ReelMagic_SetVideoMixerEnabled(const bool enabled) {
@@ -541,18 +813,13 @@ void ReelMagic_SetVideoMixerMPEGProvider(ReelMagic_VideoMixerMPEGProvider * cons
     return;
   }
 
-  //check to make sure that our MPEG picture buffer is big enough for the provider's MPEG picture size
-  const Bitu mpegPictureSize     = provider->GetAttrs().PictureSize.Width * provider->GetAttrs().PictureSize.Height;
-  const Bitu maxMpegPictureSize  = sizeof(_mpegPictureBuffer) / sizeof(_mpegPictureBuffer[0]);
-  if (mpegPictureSize > maxMpegPictureSize) {
+  //check to make sure that our MPEG line buffer is big enough for the provider's MPEG picture width
+  const Bitu maxMpegPictureWidth = sizeof(_mpegLineBuffer) / sizeof(_mpegLineBuffer[0]);
+  if (provider->GetAttrs().PictureSize.Width > maxMpegPictureWidth) {
     LOG(LOG_REELMAGIC, LOG_ERROR)("Video Mixing Buffers Too Small for MPEG Video Size. Reject Player Push");
     return;
   }
 
-  //clear the MPEG picture buffer when not replacing an existing provider
-  if (_requestedMpegProvider == NULL)
-    ClearMpegPictureBuffer();
-
   //set the new requested provider
   _requestedMpegProvider = provider;
   
@@ -564,4 +831,43 @@ void ReelMagic_InitVideoMixer(Section* sec) {
   Section_prop * section=static_cast<Section_prop *>(sec);
   //
   _vgaDup5Enabled = section->Get_bool("vgadup5hack");
+  VGAOverPalettePixel::SetAlphaChannelIndex(VGAOverPalettePixel::_alphaChannelIndex);
+
+  //the colour that shows the MPEG picture through hi-colour and true-colour VGA modes...
+  unsigned long colorKey;
+  if (sscanf(section->Get_string("colorkey"), "%lX", &colorKey) != 1) colorKey = 0x000000;
+  colorKey &= 0xFFFFFF;
+  VGAOver32bppPixel::_colorKey = (Bit32u)colorKey;
+  VGAOver16bppPixel::_colorKey = (Bit16u)(((colorKey >> 8) & 0xF800) | ((colorKey >> 5) & 0x07E0) | ((colorKey >> 3) & 0x001F));
+  VGAOver15bppPixel::_colorKey = (Bit16u)(((colorKey >> 9) & 0x7C00) | ((colorKey >> 6) & 0x03E0) | ((colorKey >> 3) & 0x001F));
+
+  //pick the line mixing kernels; follows the MPEG decoder's "simd" setting
+  const char *kernelsStr = "scalar";
+  _mixLineOver32bpp   = &MixLine_Scalar<VGAOver32bppPixel>;
+  _mixLineOverPalette = &MixLine_Scalar<VGAOverPalettePixel>;
+  _mixLineOver15bpp   = &MixLine_Scalar<VGAOver15bppPixel>;
+  _mixLineOver16bpp   = &MixLine_Scalar<VGAOver16bppPixel>;
+  _gatherMpegLine     = &GatherMpegLine_Scalar;
+#ifdef RMR_SIMD_X86
+  switch (ReelMagic_GetSIMDLevel()) {
+  case REELMAGIC_SIMD_AVX2:
+    kernelsStr          = "avx2";
+    _mixLineOver32bpp   = &MixLineOver32bpp_AVX2;
+    _mixLineOverPalette = &MixLineOverPalette_AVX2;
+    _mixLineOver15bpp   = &MixLineOverHiColor_AVX2<VGAOver15bppPixel>;
+    _mixLineOver16bpp   = &MixLineOverHiColor_AVX2<VGAOver16bppPixel>;
+    _gatherMpegLine     = &GatherMpegLine_AVX2;
+    break;
+  case REELMAGIC_SIMD_SSE2:
+    kernelsStr          = "sse2";
+    _mixLineOver32bpp   = &MixLineOver32bpp_SSE2;
+    _mixLineOverPalette = &MixLineOverPalette_SSE2;
+    _mixLineOver15bpp   = &MixLineOverHiColor_SSE2<VGAOver15bppPixel>;
+    _mixLineOver16bpp   = &MixLineOverHiColor_SSE2<VGAOver16bppPixel>;
+    break;
+  default:
+    break;
+  }
+#endif
+  LOG(LOG_REELMAGIC, LOG_NORMAL)("Video mixer using %s line mixers; colour key %06lX", kernelsStr, colorKey);
 }
@@ -0,0 +1,309 @@
+/*
+ *  Copyright (C) 2022 Jon Dennis
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Headless throughput benchmark for the ReelMagic player's MPEG decoder.
+ * Decodes each input file as fast as possible using the same pl_mpeg build
+ * and magical f_code recovery as reelmagic_player.cpp, then reports the
+ * frame rate, the time spent in each decoder stage and the peak memory use.
+ * The "-c" option writes a CRC of every decoded picture and audio frame so
+ * the output of an optimized decoder can be diffed against a golden run.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#define PSAPI_VERSION 2
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_TICKS() ((uint64_t)__rdtsc())
+#else
+#define BENCH_TICKS() bench_nanoseconds()
+#endif
+
+static uint64_t bench_nanoseconds(void);
+
+#define PL_MPEG_IMPLEMENTATION
+#define PLM_AUDIO_S16_OUTPUT /* same sample format as the player */
+#define PLM_PROFILE
+#define PLM_PROFILE_CLOCK() BENCH_TICKS()
+#include "../dosbox-0.74-3/src/hardware/reelmagic_pl_mpeg.h"
+
+#define REELMAGIC_FCODE_IMPLEMENTATION
+#include "../dosbox-0.74-3/src/hardware/reelmagic_fcode.h"
+
+
+static const char * const _stage_names[PLM_PROFILE_STAGES] = {
+  "demux", "vlc", "idct", "mc", "convert", "mp2"
+};
+
+static uint32_t _magic_key = 0x40044041;
+static int      _fcode_override = 0; /* 0 = no override; same as the "magicfhack" option */
+static int      _convert = 1;
+static FILE    *_crc_fp;
+
+static rmfc_t   _magical_f_codes;
+
+static uint64_t _total_frames;
+static double   _total_seconds;
+static uint64_t _total_ticks[PLM_PROFILE_STAGES];
+static double   _seconds_per_tick;
+
+
+static uint64_t
+bench_nanoseconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static unsigned long
+peak_memory_kb(void) {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS pmc;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return 0;
+  return (unsigned long)(pmc.PeakWorkingSetSize / 1024);
+#else
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+#ifdef __APPLE__
+  return (unsigned long)(ru.ru_maxrss / 1024);
+#else
+  return (unsigned long)ru.ru_maxrss;
+#endif
+#endif
+}
+
+
+/* CRC-32 (IEEE 802.3) */
+static uint32_t _crc_table[256];
+
+static void
+crc32_init(void) {
+  for (uint32_t i = 0; i < 256; ++i) {
+    uint32_t c = i;
+    for (unsigned k = 0; k < 8; ++k) c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+    _crc_table[i] = c;
+  }
+}
+
+static uint32_t
+crc32_update(uint32_t crc, const void *data, size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  crc = ~crc;
+  while (len--) crc = _crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+
+static plm_t *
+open_decoder(const char *filename, const char **type) {
+  FILE *fp = fopen(filename, "rb");
+  if (fp == NULL) return NULL;
+  plm_t *plm = plm_create_with_buffer(plm_buffer_create_with_file(fp, 1), 1);
+  plm_demux_set_stop_on_program_end(plm->demux, 1);
+  *type = "MPEG-PS";
+  if (!plm_has_headers(plm)) {
+    /* not an MPEG-PS... retry as a video-only ES like the player does */
+    plm_destroy(plm);
+    if ((fp = fopen(filename, "rb")) == NULL) return NULL;
+    plm = plm_create_with_video_buffer(plm_buffer_create_with_file(fp, 1), 1);
+    *type = "MPEG-ES";
+  }
+
+  if ((plm->video_decoder == NULL) || !plm_video_has_header(plm->video_decoder)) {
+    plm_destroy(plm);
+    return NULL;
+  }
+
+  plm_video_t * const video = plm->video_decoder;
+  if (video->seqh_picture_rate >= 0x9) {
+    if (_fcode_override)
+      plm_video_set_decode_picture_header_callback(video, &rmfc_decode_static_picture_header, &_magical_f_codes);
+    else
+      plm_video_set_decode_picture_header_callback(video, &rmfc_decode_picture_header, &_magical_f_codes);
+    video->framerate = PLM_VIDEO_PICTURE_RATE[0x7 & video->seqh_picture_rate];
+  }
+  if (video->framerate == 0.000) video->framerate = 30.000;
+  return plm;
+}
+
+static void
+print_stages(const uint64_t ticks[PLM_PROFILE_STAGES], double seconds) {
+  for (unsigned i = 0; i < PLM_PROFILE_STAGES; ++i) {
+    const double stage_seconds = ticks[i] * _seconds_per_tick;
+    printf("  %-8s %10.3f ms %6.1f%%\n", _stage_names[i], stage_seconds * 1000.0,
+      (seconds > 0.0) ? (stage_seconds * 100.0 / seconds) : 0.0);
+  }
+}
+
+static void
+benchmark_file(const char *filename) {
+  const char *type;
+  plm_t * const plm = open_decoder(filename, &type);
+  if (plm == NULL) {
+    fprintf(stderr, "%s: not a playable MPEG-PS/ES file\n", filename);
+    return;
+  }
+
+  const int width = plm_get_width(plm);
+  const int height = plm_get_height(plm);
+  uint8_t * const bgra = _convert ? (uint8_t *)malloc((size_t)width * height * 4) : NULL;
+  if (_crc_fp) fprintf(_crc_fp, "# %s\n", filename);
+
+  unsigned frame_count = 0;
+  unsigned audio_count = 0;
+  uint64_t ticks[PLM_PROFILE_STAGES];
+  plm_profile_reset();
+  const uint64_t start_ticks = BENCH_TICKS();
+  const uint64_t start_ns = bench_nanoseconds();
+
+  for (;;) {
+    plm_frame_t * const frame = plm_decode_video(plm);
+    if (frame == NULL) break;
+    if (bgra) plm_frame_to_bgra(frame, bgra, width * 4);
+    if (_crc_fp) {
+      uint32_t crc = crc32_update(0, frame->y.data, (size_t)frame->y.width * frame->y.height);
+      crc = crc32_update(crc, frame->cb.data, (size_t)frame->cb.width * frame->cb.height);
+      crc = crc32_update(crc, frame->cr.data, (size_t)frame->cr.width * frame->cr.height);
+      fprintf(_crc_fp, "V %u %08X", frame_count, (unsigned)crc);
+      if (bgra) fprintf(_crc_fp, " %08X", (unsigned)crc32_update(0, bgra, (size_t)width * height * 4));
+      fputc('\n', _crc_fp);
+    }
+    ++frame_count;
+
+    /* keep the audio decoder roughly in step with the video like the player does */
+    plm_samples_t *samples;
+    while ((plm->audio_decoder != NULL) && ((samples = plm_decode_audio(plm)) != NULL)) {
+      if (_crc_fp) fprintf(_crc_fp, "A %u %08X\n", audio_count, (unsigned)crc32_update(0, samples->interleaved, sizeof(samples->interleaved)));
+      ++audio_count;
+      if (samples->time >= frame->time) break;
+    }
+  }
+  if (plm->audio_decoder != NULL) {
+    plm_samples_t *samples;
+    while ((samples = plm_decode_audio(plm)) != NULL) {
+      if (_crc_fp) fprintf(_crc_fp, "A %u %08X\n", audio_count, (unsigned)crc32_update(0, samples->interleaved, sizeof(samples->interleaved)));
+      ++audio_count;
+    }
+  }
+
+  const double seconds = (bench_nanoseconds() - start_ns) / 1e9;
+  const uint64_t elapsed_ticks = BENCH_TICKS() - start_ticks;
+  if ((elapsed_ticks > 0) && (seconds > 0.0)) _seconds_per_tick = seconds / elapsed_ticks;
+  plm_profile_get_ticks(ticks);
+
+  printf("%s: %s %dx%d picture_rate=0x%X, %u pictures, %u audio frames, %.3fs, %.1f fps\n",
+    filename, type, width, height, (unsigned)plm->video_decoder->seqh_picture_rate,
+    frame_count, audio_count, seconds, (seconds > 0.0) ? (frame_count / seconds) : 0.0);
+  print_stages(ticks, seconds);
+
+  _total_frames += frame_count;
+  _total_seconds += seconds;
+  for (unsigned i = 0; i < PLM_PROFILE_STAGES; ++i) _total_ticks[i] += ticks[i];
+
+  free(bgra);
+  plm_destroy(plm);
+}
+
+static int
+parse_simd_level(const char *arg) {
+  static const char * const names[] = {"scalar", "sse2", "avx2", "neon"};
+  for (int i = 0; i < 4; ++i)
+    if (strcmp(arg, names[i]) == 0) return i;
+  return atoi(arg);
+}
+
+static void
+usage(const char *argv0) {
+  fprintf(stderr, "Usage: %s [-k MAGIC_KEY] [-f F_CODE] [-s SIMD] [-n] [-c CRC_FILE] INPUT_FILE...\n", argv0);
+  fprintf(stderr, "  -k  magic key in hex used to decode \"magical\" files (default 40044041)\n");
+  fprintf(stderr, "  -f  force a static f_code (1-7) like the \"magicfhack\" config option\n");
+  fprintf(stderr, "  -s  SIMD level: scalar, sse2, avx2 or neon (default is the best supported)\n");
+  fprintf(stderr, "  -n  don't convert the decoded pictures to BGRA\n");
+  fprintf(stderr, "  -c  write a CRC of every decoded picture and audio frame to CRC_FILE (\"-\" = stdout)\n");
+}
+
+int
+main(int argc, char *argv[]) {
+  int simd_level = plm_simd_get_supported();
+  const char *crc_filename = NULL;
+  int i;
+
+  for (i = 1; (i < argc) && (argv[i][0] == '-') && (argv[i][1] != '\0'); ++i) {
+    const char opt = argv[i][1];
+    if (opt == 'n') {
+      _convert = 0;
+      continue;
+    }
+    if ((i + 1 >= argc) || (argv[i][2] != '\0')) {
+      usage(argv[0]);
+      return 1;
+    }
+    const char * const arg = argv[++i];
+    switch (opt) {
+    case 'k': _magic_key = (uint32_t)strtoul(arg, NULL, 16); break;
+    case 'f': _fcode_override = atoi(arg); break;
+    case 's': simd_level = parse_simd_level(arg); break;
+    case 'c': crc_filename = arg; break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if ((i >= argc) || (_fcode_override < 0) || (_fcode_override > 7)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (crc_filename != NULL) {
+    _crc_fp = (strcmp(crc_filename, "-") == 0) ? stdout : fopen(crc_filename, "w");
+    if (_crc_fp == NULL) {
+      fprintf(stderr, "Couldn't open file %s\n", crc_filename);
+      return 1;
+    }
+  }
+  crc32_init();
+  if (_fcode_override)
+    rmfc_init_static(&_magical_f_codes, _fcode_override);
+  else if (!rmfc_init(&_magical_f_codes, _magic_key))
+    fprintf(stderr, "Unknown magic key 0x%08X. Defaulting to 0x%08X\n", (unsigned)_magic_key, (unsigned)RMFC_KEY_DEFAULT);
+  simd_level = plm_simd_set_level(simd_level);
+  printf("SIMD level %d, magic key 0x%08X\n", simd_level, (unsigned)_magic_key);
+
+  for (; i < argc; ++i) benchmark_file(argv[i]);
+
+  printf("total: %llu pictures, %.3fs, %.1f fps, peak memory %lu KiB\n",
+    (unsigned long long)_total_frames, _total_seconds,
+    (_total_seconds > 0.0) ? (_total_frames / _total_seconds) : 0.0, peak_memory_kb());
+  print_stages(_total_ticks, _total_seconds);
+
+  if ((_crc_fp != NULL) && (_crc_fp != stdout)) fclose(_crc_fp);
+  return 0;
+}
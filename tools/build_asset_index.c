@@ -0,0 +1,232 @@
+/*
+ *  Copyright (C) 2022 Jon Dennis
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Prebuilds the MPEG asset index files used by the ReelMagic player's
+ * "indexcachedir" option. Inputs are either MPEG asset files or whole CD
+ * images (ISO 9660, with 2048 byte or raw 2352 byte sectors) in which case
+ * every MPEG asset found on the image is indexed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define REELMAGIC_INDEX_IMPLEMENTATION
+#include "../dosbox-0.74-3/src/hardware/reelmagic_index.h"
+
+
+static const char *_index_dir;
+static unsigned _indexed_count;
+
+
+/* reading a plain host file */
+static size_t
+read_host_file(void *user, uint8_t *dest, uint32_t offset, size_t len) {
+  FILE * const fp = (FILE *)user;
+  if (fseek(fp, offset, SEEK_SET) != 0) return 0;
+  return fread(dest, 1, len, fp);
+}
+
+
+/* reading a file from a CD image */
+struct cd_image {
+  FILE     *fp;
+  unsigned  sector_size;   /* 2048 or 2352 */
+  unsigned  data_offset;   /* offset of the user data within a sector */
+};
+struct cd_file {
+  struct cd_image *image;
+  uint32_t         extent;  /* first sector */
+  uint32_t         size;
+};
+
+static size_t
+read_cd_sectors(struct cd_image *image, uint8_t *dest, uint32_t sector, uint32_t sector_offset, size_t len) {
+  size_t total = 0;
+  while (len > 0) {
+    size_t amount = 2048 - sector_offset;
+    if (amount > len) amount = len;
+    if (fseek(image->fp, (long)sector * image->sector_size + image->data_offset + sector_offset, SEEK_SET) != 0) break;
+    const size_t got = fread(dest, 1, amount, image->fp);
+    total += got;
+    if (got != amount) break;
+    dest += amount;
+    len -= amount;
+    sector_offset = 0;
+    ++sector;
+  }
+  return total;
+}
+
+static size_t
+read_cd_file(void *user, uint8_t *dest, uint32_t offset, size_t len) {
+  struct cd_file * const file = (struct cd_file *)user;
+  if (offset >= file->size) return 0;
+  if (len > file->size - offset) len = file->size - offset;
+  return read_cd_sectors(file->image, dest, file->extent + (offset / 2048), offset % 2048, len);
+}
+
+
+static void
+index_asset(const char *name, rmidx_read_callback read, void *user, uint32_t size) {
+  rmidx_t index;
+  char path[4096];
+
+  const uint64_t hash = rmidx_hash(read, user, size);
+  if (!rmidx_build(&index, read, user, size, hash)) {
+    rmidx_free(&index);
+    return;
+  }
+
+  //the PTS span of the pictures... ES assets carry no PTS
+  uint64_t first_pts = RMIDX_NO_PTS, last_pts = RMIDX_NO_PTS;
+  for (uint32_t i = 0; i < index.picture_count; ++i) {
+    if (index.pictures[i].pts == RMIDX_NO_PTS) continue;
+    if (first_pts == RMIDX_NO_PTS) first_pts = index.pictures[i].pts;
+    last_pts = index.pictures[i].pts;
+  }
+
+  rmidx_make_path(path, sizeof(path), _index_dir, size, hash);
+  if (rmidx_save(&index, path)) {
+    printf("%s: %s %u pictures %.1fs -> %s\n", name,
+      (index.layout == RMIDX_LAYOUT_PS) ? "MPEG-PS" : "MPEG-ES",
+      (unsigned)index.picture_count,
+      (last_pts > first_pts) && (last_pts != RMIDX_NO_PTS) ? (double)(last_pts - first_pts) / 90000.0 : 0.0,
+      path);
+    ++_indexed_count;
+  }
+  else {
+    fprintf(stderr, "%s: failed to write %s\n", name, path);
+  }
+  rmidx_free(&index);
+}
+
+
+static void
+index_cd_directory(struct cd_image *image, uint32_t extent, uint32_t size, const char *parent, unsigned depth) {
+  uint8_t sector[2048];
+  char name[1024];
+
+  if (depth > 16) return; /* don't follow loops in broken images */
+
+  for (uint32_t pos = 0; pos < size; pos += 2048) {
+    if (read_cd_sectors(image, sector, extent + (pos / 2048), 0, sizeof(sector)) != sizeof(sector)) return;
+    for (unsigned i = 0; (i < sizeof(sector)) && (sector[i] != 0); i += sector[i]) {
+      const uint8_t * const rec = &sector[i];
+      const unsigned name_len = rec[32];
+      if ((rec[0] < 33 + name_len) || (i + rec[0] > sizeof(sector))) break;
+      if ((name_len == 1) && ((rec[33] == 0) || (rec[33] == 1))) continue; /* "." and ".." */
+
+      /* strip the ";1" version suffix */
+      unsigned len = name_len;
+      for (unsigned k = 0; k < name_len; ++k) {
+        if (rec[33 + k] == ';') {
+          len = k;
+          break;
+        }
+      }
+      const size_t parent_len = strlen(parent);
+      if (parent_len + 1 + len >= sizeof(name)) continue;
+      memcpy(name, parent, parent_len);
+      name[parent_len] = '/';
+      memcpy(&name[parent_len + 1], &rec[33], len);
+      name[parent_len + 1 + len] = '\0';
+
+      struct cd_file file;
+      file.image  = image;
+      file.extent = rec[2] | (rec[3] << 8) | (rec[4] << 16) | ((uint32_t)rec[5] << 24);
+      file.size   = rec[10] | (rec[11] << 8) | (rec[12] << 16) | ((uint32_t)rec[13] << 24);
+      if (rec[25] & 0x02)
+        index_cd_directory(image, file.extent, file.size, name, depth + 1);
+      else if (file.size > 0)
+        index_asset(name, &read_cd_file, &file, file.size);
+    }
+  }
+}
+
+static int
+index_cd_image(const char *filename, FILE *fp) {
+  static const uint8_t sync[12] = {0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00};
+  struct cd_image image;
+  uint8_t pvd[2048];
+
+  image.fp = fp;
+  image.sector_size = 2048;
+  image.data_offset = 0;
+  if ((read_cd_sectors(&image, pvd, 16, 0, sizeof(pvd)) != sizeof(pvd)) || (memcmp(&pvd[1], "CD001", 5) != 0)) {
+    /* raw sectors; the user data of mode 1 sectors starts at 16 and of mode 2 form 1 sectors at 24 */
+    uint8_t raw[2352];
+    if (fseek(fp, 16 * 2352, SEEK_SET) != 0 || fread(raw, 1, sizeof(raw), fp) != sizeof(raw)) return 0;
+    if (memcmp(raw, sync, sizeof(sync)) != 0) return 0;
+    image.sector_size = 2352;
+    image.data_offset = (raw[15] == 2) ? 24 : 16;
+    if ((read_cd_sectors(&image, pvd, 16, 0, sizeof(pvd)) != sizeof(pvd)) || (memcmp(&pvd[1], "CD001", 5) != 0)) return 0;
+  }
+
+  /* the root directory record sits at offset 156 of the primary volume descriptor */
+  const uint8_t * const root = &pvd[156];
+  index_cd_directory(&image,
+    root[2] | (root[3] << 8) | (root[4] << 16) | ((uint32_t)root[5] << 24),
+    root[10] | (root[11] << 8) | (root[12] << 16) | ((uint32_t)root[13] << 24),
+    filename, 0);
+  return 1;
+}
+
+
+static int
+has_cd_image_extension(const char *filename) {
+  static const char * const extensions[] = {".iso", ".bin", ".img", NULL};
+  const char * const dot = strrchr(filename, '.');
+  if (dot == NULL) return 0;
+  for (unsigned i = 0; extensions[i] != NULL; ++i) {
+    unsigned k;
+    for (k = 0; (dot[k] != '\0') && (tolower((unsigned char)dot[k]) == extensions[i][k]); ++k);
+    if ((dot[k] == '\0') && (extensions[i][k] == '\0')) return 1;
+  }
+  return 0;
+}
+
+int
+main(int argc, char *argv[]) {
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s INDEX_DIR INPUT_FILE|CD_IMAGE...\n", argv[0]);
+    fprintf(stderr, "  INDEX_DIR is the directory set as \"indexcachedir\" in the [reelmagic] config section.\n");
+    fprintf(stderr, "  CD images (*.iso, *.bin, *.img) are searched for MPEG assets.\n");
+    return 1;
+  }
+  _index_dir = argv[1];
+
+  for (int i = 2; i < argc; ++i) {
+    FILE * const fp = fopen(argv[i], "rb");
+    if (fp == NULL) {
+      fprintf(stderr, "Couldn't open file %s\n", argv[i]);
+      continue;
+    }
+    if (!has_cd_image_extension(argv[i]) || !index_cd_image(argv[i], fp)) {
+      fseek(fp, 0, SEEK_END);
+      const long size = ftell(fp);
+      if (size > 0) index_asset(argv[i], &read_host_file, fp, (uint32_t)size);
+    }
+    fclose(fp);
+  }
+
+  printf("%u asset(s) indexed\n", _indexed_count);
+  return 0;
+}
@@ -0,0 +1,606 @@
+/*
+ *  Copyright (C) 2022 Jon Dennis
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Pixel comparison test for the video mixer. Builds reelmagic_videomixer.cpp
+ * against a fake RENDER and MPEG player, draws a few frames of random VGA and
+ * MPEG pictures in every mixer mode, and compares each RENDER line with the
+ * output of the per-mode line renderers the mixer used to have (the
+ * "OldMixer" namespace below). This is repeated for every SIMD level the CPU
+ * supports. The old renderers only knew 8bpp and 32bpp with a black colour
+ * key, so the 15/16bpp modes and other colour keys are compared against the
+ * scalar line mixers instead.
+ *
+ * Built and run by "make check"; this needs a configured DOSBox tree as it
+ * includes config.h. Exits with status 1 on the first mismatch.
+ */
+
+#include "../dosbox-0.74-3/src/hardware/reelmagic_videomixer.cpp"
+
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+#define MAX_LINES (SCALER_MAXHEIGHT * 2)
+
+
+
+//
+// fake RENDER... lines passed as NULL must still match the line RENDER has from the last frame
+//
+static std::vector<RenderOutputPixel> _capturedFrame;
+static Bitu _capturedWidth  = 0;
+static Bitu _capturedHeight = 0;
+static Bitu _capturedLines  = 0;
+static bool _capturedNull   = false; //a NULL line was passed during a full frame update
+
+static void CaptureLine(const void *src) {
+  if (_capturedLines >= MAX_LINES) return;
+  if (src != NULL)
+    memcpy(&_capturedFrame[_capturedLines * SCALER_MAXWIDTH], src, _capturedWidth * sizeof(RenderOutputPixel));
+  else if (render.fullFrame)
+    _capturedNull = true;
+  ++_capturedLines;
+}
+
+Render_t render;
+ScalerLineHandler_t RENDER_DrawLine = &CaptureLine;
+void RENDER_SetSize(Bitu width,Bitu height,Bitu bpp,float fps,double ratio,bool dblw,bool dblh) {
+  _capturedWidth  = width;
+  _capturedHeight = height;
+}
+bool RENDER_StartUpdate(void) {
+  _capturedLines = 0;
+  return true;
+}
+void RENDER_SetPal(Bit8u entry,Bit8u red,Bit8u green,Bit8u blue) {}
+void E_Exit(const char * format,...) {
+  fprintf(stderr, "E_Exit: %s\n", format);
+  exit(1);
+}
+#if C_DEBUG
+void LOG::operator() (char const* buf, ...) {}
+#endif
+
+static ReelMagic_SIMDLevel _simdLevel = REELMAGIC_SIMD_SCALAR;
+ReelMagic_SIMDLevel ReelMagic_GetSIMDLevel() {
+  return _simdLevel;
+}
+
+//the [reelmagic] settings read by ReelMagic_InitVideoMixer()
+static bool        _vgaDup5Hack = false;
+static const char *_colorKey    = "000000";
+static Section_prop _section("reelmagic");
+Section_prop::~Section_prop() {}
+void Section_prop::HandleInputline(std::string const& gegevens) {}
+void Section_prop::PrintData(FILE* outfile) const {}
+std::string Section_prop::GetPropValue(std::string const& _property) const { return ""; }
+bool Section_prop::Get_bool(std::string const& _propname) const { return _vgaDup5Hack; }
+const char* Section_prop::Get_string(std::string const& _propname) const { return _colorKey; }
+
+
+
+//
+// fake MPEG player showing a random picture
+//
+static Bit32u _random = 1;
+static Bit32u Random() {
+  _random = _random * 1103515245 + 12345;
+  return _random >> 8;
+}
+
+struct FakePlayer : ReelMagic_VideoMixerMPEGProvider {
+  ReelMagic_PlayerConfiguration config;
+  ReelMagic_PlayerAttributes    attrs;
+  std::vector<Bit32u>           picture;  //BGRA with a random alpha byte the mixer must ignore
+  bool                          newPicture;
+
+  void Setup(const Bit16u width, const Bit16u height) {
+    memset(&config, 0, sizeof(config));
+    memset(&attrs, 0, sizeof(attrs));
+    attrs.PictureSize.Width  = width;
+    attrs.PictureSize.Height = height;
+    picture.resize((size_t)width * height);
+    newPicture = true;
+  }
+  bool OnVerticalRefresh(const float fps) {
+    if (!newPicture) return false;
+    for (size_t i = 0; i < picture.size(); ++i) picture[i] = Random() ^ (Random() << 24);
+    newPicture = false;
+    return true;
+  }
+  bool GetPictureRow(void * const out, const Bitu row, const Bitu begin, const Bitu end) {
+    if (row >= attrs.PictureSize.Height) return false;
+    memcpy((Bit32u *)out + begin, &picture[row * attrs.PictureSize.Width + begin], (end - begin) * sizeof(Bit32u));
+    return true;
+  }
+  const ReelMagic_PlayerConfiguration& GetConfig() const { return config; }
+  const ReelMagic_PlayerAttributes& GetAttrs() const { return attrs; }
+};
+
+
+
+//
+// the line renderers of the video mixer before the MPEG scaling maps and line mixing
+// kernels... these are as they were, only the RENDER output is captured here instead
+//
+namespace OldMixer {
+static std::vector<RenderOutputPixel> _capturedFrame(MAX_LINES * SCALER_MAXWIDTH);
+static Bitu _capturedLines = 0;
+static void RENDER_DrawLine(const void *src) {
+  if (_capturedLines >= MAX_LINES) return;
+  memcpy(&_capturedFrame[_capturedLines++ * SCALER_MAXWIDTH], src, _capturedWidth * sizeof(RenderOutputPixel));
+}
+
+struct VGA32bppPixel {
+  Bit8u blue;
+  Bit8u green;
+  Bit8u red;
+  Bit8u alpha;
+  template <typename T> inline void CopyRGBTo(T& out) const {out.red=red; out.green=green; out.blue=blue;}
+};
+struct VGAUnder32bppPixel : VGA32bppPixel { inline bool IsTransparent() const { return true; } };
+struct VGAOver32bppPixel  : VGA32bppPixel { inline bool IsTransparent() const { return (red|green|blue) == 0; } };
+
+struct VGAPalettePixel {
+  static VGA32bppPixel _vgaPalette[256];
+  Bit8u index;
+  template <typename T> inline void CopyRGBTo(T& out) const { _vgaPalette[index].CopyRGBTo(out); }
+};
+struct VGAUnderPalettePixel : VGAPalettePixel { inline bool IsTransparent() const { return true; } };
+struct VGAOverPalettePixel  : VGAPalettePixel {
+  static Bit8u _alphaChannelIndex;
+  inline bool IsTransparent() const { return index == _alphaChannelIndex; }
+};
+VGA32bppPixel VGAPalettePixel::_vgaPalette[256];
+Bit8u         VGAOverPalettePixel::_alphaChannelIndex = 0;
+
+struct PlayerPicturePixel : RenderOutputPixel {
+  inline void CopyRGBTo(RenderOutputPixel& out) const {out = *this;}
+  inline bool IsTransparent() const {return false;}
+};
+
+//the old mixer read past the end of the picture when VGA sent more lines than the
+//MPEG picture scaled to; the rows past the end hold copies of the last row here as
+//the mixer now repeats it
+static std::vector<PlayerPicturePixel> _mpegPictureBuffer(MAX_LINES * SCALER_MAXWIDTH);
+static PlayerPicturePixel *_mpegPictureBufferPtr = NULL;
+static Bitu _mpegPictureWidth = 0;
+static Bitu _mpegPictureHeight = 0;
+static Bitu _vgaWidth = 0;
+static Bitu _renderWidth = 0;
+static Bitu _renderHeight = 0;
+static RenderOutputPixel _finalMixedRenderLineBuffer[SCALER_MAXWIDTH];
+static Bitu _currentRenderLineNumber = 0;
+
+template <typename VGAPixelT, typename MPEGPixelT>
+static inline void MixPixel(RenderOutputPixel& out, const VGAPixelT& vga, const MPEGPixelT& mpeg) {
+  if (vga.IsTransparent())
+    mpeg.CopyRGBTo(out);
+  else
+    vga.CopyRGBTo(out);
+  out.alpha = 0;
+}
+
+template <typename VGAPixelT>
+static inline void MixPixel(RenderOutputPixel& out, const VGAPixelT& vga) {
+  vga.CopyRGBTo(out);
+  out.alpha = 0;
+}
+
+template <typename T> static inline void RMR_DrawLine_VGAOnly(const T *src) {
+  const Bitu lineWidth          = _vgaWidth;
+  RenderOutputPixel * const out = _finalMixedRenderLineBuffer;
+  for (Bitu i = 0; i < lineWidth; ++i)
+    MixPixel(out[i], src[i]);
+  RENDER_DrawLine(_finalMixedRenderLineBuffer);
+}
+
+template <typename T> static inline void RMR_DrawLine_VGAMPEGSameSize(const T *src) {
+  const Bitu lineWidth          = _vgaWidth;
+  RenderOutputPixel * const out = _finalMixedRenderLineBuffer;
+  for (Bitu i = 0; i < lineWidth; ++i)
+    MixPixel(out[i], src[i], _mpegPictureBufferPtr[i]);
+  _mpegPictureBufferPtr += _mpegPictureWidth;
+  RENDER_DrawLine(_finalMixedRenderLineBuffer);
+}
+
+template <typename T> static inline void RMR_DrawLine_VSO_MPEGDoubleVGASize(const T *src) {
+  const Bitu lineWidth          = _vgaWidth;
+  RenderOutputPixel * const out = _finalMixedRenderLineBuffer;
+  _mpegPictureBufferPtr -= _mpegPictureWidth * (_currentRenderLineNumber++ & 1);
+  for (Bitu i = 0; i < lineWidth; ++i) {
+    MixPixel(out[i], src[i], _mpegPictureBufferPtr[i >> 1]);
+  }
+  _mpegPictureBufferPtr += _mpegPictureWidth;
+  RENDER_DrawLine(_finalMixedRenderLineBuffer);
+}
+
+template <typename T> static inline void RMR_DrawLine_VSO_VGAMPEGSameWidthSkip6Vertical(const T *src) {
+  const Bitu lineWidth          = _vgaWidth;
+  RenderOutputPixel * const out = _finalMixedRenderLineBuffer;
+  for (Bitu i = 0; i < lineWidth; ++i)
+    MixPixel(out[i], src[i], _mpegPictureBufferPtr[i]);
+  _mpegPictureBufferPtr += _mpegPictureWidth;
+  if (++_currentRenderLineNumber >= 6) {
+    _currentRenderLineNumber = 0;
+    _mpegPictureBufferPtr += _mpegPictureWidth;
+  }
+  RENDER_DrawLine(_finalMixedRenderLineBuffer);
+}
+
+template <typename T> static inline void RMR_DrawLine_VSO_VGAMPEGDoubleSameWidthSkip6Vertical(const T *src) {
+  const Bitu lineWidth          = _vgaWidth;
+  RenderOutputPixel * const out = _finalMixedRenderLineBuffer;
+  _mpegPictureBufferPtr -= _mpegPictureWidth * (_currentRenderLineNumber & 1);
+  for (Bitu i = 0; i < lineWidth; ++i)
+    MixPixel(out[i], src[i], _mpegPictureBufferPtr[i >> 1]);
+  _mpegPictureBufferPtr += _mpegPictureWidth;
+  if (++_currentRenderLineNumber >= 6) {
+    _currentRenderLineNumber = 0;
+    _mpegPictureBufferPtr += _mpegPictureWidth;
+  }
+  RENDER_DrawLine(_finalMixedRenderLineBuffer);
+}
+
+template <typename T> static inline void RMR_DrawLine_VGAOnlyDup5Vertical(const T *src) {
+  const Bitu lineWidth          = _vgaWidth;
+  RenderOutputPixel * const out = _finalMixedRenderLineBuffer;
+  for (Bitu i = 0; i < lineWidth; ++i)
+    MixPixel(out[i], src[i]);
+  if (++_currentRenderLineNumber >= 5) {
+    _currentRenderLineNumber = 0;
+    RENDER_DrawLine(_finalMixedRenderLineBuffer);
+  }
+  RENDER_DrawLine(_finalMixedRenderLineBuffer);
+}
+
+template <typename T> static inline void RMR_DrawLine_VGADup5VerticalMPEGSameSize(const T *src) {
+  const Bitu lineWidth          = _vgaWidth;
+  RenderOutputPixel * const out = _finalMixedRenderLineBuffer;
+  for (Bitu i = 0; i < lineWidth; ++i)
+    MixPixel(out[i], src[i], _mpegPictureBufferPtr[i]);
+  _mpegPictureBufferPtr += _mpegPictureWidth;
+  RENDER_DrawLine(_finalMixedRenderLineBuffer);
+
+  if (++_currentRenderLineNumber >= 5) {
+    _currentRenderLineNumber = 0;
+    RMR_DrawLine_VGADup5VerticalMPEGSameSize(src);
+    _currentRenderLineNumber = 0;
+  }
+}
+
+static Bitu _RMR_DrawLine_VSO_GeneralResizeMPEGToVGA_WidthRatio     = 0;
+static Bitu _RMR_DrawLine_VSO_GeneralResizeMPEGToVGA_HeightRatio    = 0;
+static Bitu _RMR_DrawLine_VSO_GeneralResizeMPEGToVGADup5LineCounter = 0;
+static void Initialize_RMR_DrawLine_VSO_GeneralResizeMPEGToVGA_Dimensions() {
+  _RMR_DrawLine_VSO_GeneralResizeMPEGToVGA_WidthRatio   = _mpegPictureWidth << 12;
+  _RMR_DrawLine_VSO_GeneralResizeMPEGToVGA_WidthRatio  /= _renderWidth;
+  _RMR_DrawLine_VSO_GeneralResizeMPEGToVGA_HeightRatio  = _mpegPictureHeight << 12;
+  _RMR_DrawLine_VSO_GeneralResizeMPEGToVGA_HeightRatio /= _renderHeight;
+}
+template <typename T> static inline void RMR_DrawLine_VSO_GeneralResizeMPEGToVGA(const T *src) {
+  const Bitu lineWidth          = _vgaWidth;
+  RenderOutputPixel * const out = _finalMixedRenderLineBuffer;
+  for (Bitu i = 0; i < lineWidth; ++i)
+    MixPixel(out[i], src[i], _mpegPictureBufferPtr[(i * _RMR_DrawLine_VSO_GeneralResizeMPEGToVGA_WidthRatio) >> 12]);
+  _mpegPictureBufferPtr =
+    &_mpegPictureBuffer[_mpegPictureWidth *
+      ((++_currentRenderLineNumber * _RMR_DrawLine_VSO_GeneralResizeMPEGToVGA_HeightRatio) >> 12)];
+  RENDER_DrawLine(_finalMixedRenderLineBuffer);
+}
+
+template <typename T> static inline void RMR_DrawLine_VSO_GeneralResizeMPEGToVGADup5(const T *src) {
+  const Bitu lineWidth          = _vgaWidth;
+  RenderOutputPixel * const out = _finalMixedRenderLineBuffer;
+  for (Bitu i = 0; i < lineWidth; ++i)
+    MixPixel(out[i], src[i], _mpegPictureBufferPtr[(i * _RMR_DrawLine_VSO_GeneralResizeMPEGToVGA_WidthRatio) >> 12]);
+  _mpegPictureBufferPtr =
+    &_mpegPictureBuffer[_mpegPictureWidth *
+      ((++_currentRenderLineNumber * _RMR_DrawLine_VSO_GeneralResizeMPEGToVGA_HeightRatio) >> 12)];
+  RENDER_DrawLine(_finalMixedRenderLineBuffer);
+
+  if (++_RMR_DrawLine_VSO_GeneralResizeMPEGToVGADup5LineCounter >= 5) {
+    _RMR_DrawLine_VSO_GeneralResizeMPEGToVGADup5LineCounter = 0;
+    RMR_DrawLine_VSO_GeneralResizeMPEGToVGADup5(src);
+    _RMR_DrawLine_VSO_GeneralResizeMPEGToVGADup5LineCounter = 0;
+  }
+}
+
+template <typename T, void (*DRAWLINE_FUNC)(const T *)> static void TypedDrawLine(const void *src) {
+  DRAWLINE_FUNC((const T *)src);
+}
+#define OLD_DRAWLINE_FUNCTION(DRAWLINE_FUNC_NAME, VGA_BPP, VGA_OVER) ( \
+  (VGA_OVER) ? \
+    (((VGA_BPP) == 8) ? &TypedDrawLine<VGAOverPalettePixel,  &DRAWLINE_FUNC_NAME<VGAOverPalettePixel> > : \
+                        &TypedDrawLine<VGAOver32bppPixel,    &DRAWLINE_FUNC_NAME<VGAOver32bppPixel> >) : \
+    (((VGA_BPP) == 8) ? &TypedDrawLine<VGAUnderPalettePixel, &DRAWLINE_FUNC_NAME<VGAUnderPalettePixel> > : \
+                        &TypedDrawLine<VGAUnder32bppPixel,   &DRAWLINE_FUNC_NAME<VGAUnder32bppPixel> >))
+
+static void (*_drawLine)(const void *) = NULL;
+
+//mode selection of the old SetupVideoMixer()
+static void Setup(const Bitu vgaWidth, const Bitu vgaHeight, const Bitu bpp, const bool dup5, const FakePlayer *mpeg) {
+  _vgaWidth     = vgaWidth;
+  _renderWidth  = vgaWidth;
+  _renderHeight = dup5 ? ((vgaHeight / 5) * 6) : vgaHeight;
+  if ((!mpeg) || (!mpeg->config.VideoOutputVisible)) {
+    _drawLine = dup5 ? OLD_DRAWLINE_FUNCTION(RMR_DrawLine_VGAOnlyDup5Vertical, bpp, true) :
+                       OLD_DRAWLINE_FUNCTION(RMR_DrawLine_VGAOnly, bpp, true);
+    return;
+  }
+  _mpegPictureWidth  = mpeg->attrs.PictureSize.Width;
+  _mpegPictureHeight = mpeg->attrs.PictureSize.Height;
+  const bool vgaOver = mpeg->config.UnderVga;
+  if (dup5) {
+    if ((_renderWidth != _mpegPictureWidth) || (_renderHeight != _mpegPictureHeight)) {
+      Initialize_RMR_DrawLine_VSO_GeneralResizeMPEGToVGA_Dimensions();
+      _drawLine = OLD_DRAWLINE_FUNCTION(RMR_DrawLine_VSO_GeneralResizeMPEGToVGADup5, bpp, vgaOver);
+    }
+    else {
+      _drawLine = OLD_DRAWLINE_FUNCTION(RMR_DrawLine_VGADup5VerticalMPEGSameSize, bpp, vgaOver);
+    }
+  }
+  else if ((vgaWidth == _mpegPictureWidth) && (vgaHeight == _mpegPictureHeight)) {
+    _drawLine = OLD_DRAWLINE_FUNCTION(RMR_DrawLine_VGAMPEGSameSize, bpp, vgaOver);
+  }
+  else if ((vgaWidth == (_mpegPictureWidth*2)) && (vgaHeight == ((_mpegPictureHeight*2)))) {
+    _drawLine = OLD_DRAWLINE_FUNCTION(RMR_DrawLine_VSO_MPEGDoubleVGASize, bpp, vgaOver);
+  }
+  else if ((vgaWidth == _mpegPictureWidth) && ((_mpegPictureHeight / (_mpegPictureHeight - vgaHeight)) == 6)) {
+    _drawLine = OLD_DRAWLINE_FUNCTION(RMR_DrawLine_VSO_VGAMPEGSameWidthSkip6Vertical, bpp, vgaOver);
+  }
+  else if ((vgaWidth == (_mpegPictureWidth*2)) && (((_mpegPictureHeight*2) / ((_mpegPictureHeight*2) - vgaHeight)) == 6)) {
+    _drawLine = OLD_DRAWLINE_FUNCTION(RMR_DrawLine_VSO_VGAMPEGDoubleSameWidthSkip6Vertical, bpp, vgaOver);
+  }
+  else {
+    Initialize_RMR_DrawLine_VSO_GeneralResizeMPEGToVGA_Dimensions();
+    _drawLine = OLD_DRAWLINE_FUNCTION(RMR_DrawLine_VSO_GeneralResizeMPEGToVGA, bpp, vgaOver);
+  }
+}
+
+//the old ReelMagic_RENDER_StartUpdate() with the player filling the whole picture buffer
+static void StartUpdate(const FakePlayer *mpeg) {
+  if (mpeg) {
+    VGAOverPalettePixel::_alphaChannelIndex = mpeg->config.VgaAlphaIndex;
+    const Bitu width  = mpeg->attrs.PictureSize.Width;
+    const Bitu height = mpeg->attrs.PictureSize.Height;
+    const Bitu rows   = std::min<Bitu>(_mpegPictureBuffer.size() / width, (_renderHeight + 1) * 2);
+    for (Bitu row = 0; row < rows; ++row)
+      memcpy(&_mpegPictureBuffer[row * width], &mpeg->picture[((row < height) ? row : (height - 1)) * width], width * sizeof(Bit32u));
+  }
+  _currentRenderLineNumber = 0;
+  _RMR_DrawLine_VSO_GeneralResizeMPEGToVGADup5LineCounter = 0;
+  _mpegPictureBufferPtr = &_mpegPictureBuffer[0];
+  _capturedLines = 0;
+}
+} //namespace OldMixer
+
+
+
+//
+// the test itself...
+//
+struct TestCase {
+  Bitu vgaWidth, vgaHeight, bpp;
+  Bit16u mpegWidth, mpegHeight;
+  bool vgaUnder, dup5;
+  int  player; //0 = visible, 1 = hidden, 2 = none
+  const char *colorKey;
+};
+
+static FakePlayer _player;
+static std::vector<Bit8u> _vgaPicture;
+static Bit8u _palette[256][3];
+
+static void SetPal(const Bit8u entry, const Bit8u red, const Bit8u green, const Bit8u blue) {
+  _palette[entry][0] = red; _palette[entry][1] = green; _palette[entry][2] = blue;
+  ReelMagic_RENDER_SetPal(entry, red, green, blue);
+  OldMixer::VGA32bppPixel& p = OldMixer::VGAPalettePixel::_vgaPalette[entry];
+  p.red = red; p.green = green; p.blue = blue; p.alpha = 0;
+}
+
+//random VGA pixel with about one in three being transparent
+static void RandomVGAPixel(const TestCase& t, Bit8u *p) {
+  const bool transparent = (Random() % 3) == 0;
+  switch (t.bpp) {
+  case 8:
+    p[0] = transparent ? _player.config.VgaAlphaIndex : (Bit8u)Random();
+    break;
+  case 15:
+  case 16: {
+    Bit16u v = (Bit16u)Random();
+    if (transparent) v = (t.bpp == 15) ? (VGAOver15bppPixel::_colorKey | (Random() & 0x8000)) : VGAOver16bppPixel::_colorKey;
+    p[0] = (Bit8u)v; p[1] = (Bit8u)(v >> 8);
+    break;
+  }
+  default: {
+    Bit32u v = Random() ^ (Random() << 24);
+    if (transparent) v = VGAOver32bppPixel::_colorKey | (v & 0xFF000000);
+    p[0] = (Bit8u)v; p[1] = (Bit8u)(v >> 8); p[2] = (Bit8u)(v >> 16); p[3] = (Bit8u)(v >> 24);
+    break;
+  }
+  }
+}
+
+static void AppendFrame(std::vector<RenderOutputPixel>& frames, const std::vector<RenderOutputPixel>& frame, const Bitu lines) {
+  for (Bitu line = 0; line < lines; ++line)
+    frames.insert(frames.end(), frame.begin() + line * SCALER_MAXWIDTH, frame.begin() + line * SCALER_MAXWIDTH + _capturedWidth);
+}
+
+//draws the frames of a test case... the first one as a full frame update and the rest
+//with unchanged lines allowed; returns the RENDER output of all frames
+static std::vector<RenderOutputPixel> DrawFrames(const TestCase& t, const bool oldMixer, Bitu& lines) {
+  static const unsigned FRAME_COUNT = 7;
+  const Bitu bytesPerPixel = (t.bpp + 7) / 8;
+  std::vector<RenderOutputPixel> frames;
+  _random = 1;
+
+  _vgaDup5Hack = t.dup5;
+  _colorKey = t.colorKey;
+  ReelMagic_InitVideoMixer(&_section);
+
+  _player.Setup(t.mpegWidth, t.mpegHeight);
+  _player.config.VideoOutputVisible = (t.player != 1);
+  _player.config.UnderVga = !t.vgaUnder; //"under VGA" is the MPEG picture under it
+  _player.config.VgaAlphaIndex = (Bit8u)(Random() & 0x0F);
+  FakePlayer * const player = (t.player == 2) ? NULL : &_player;
+
+  for (unsigned i = 0; i < 256; ++i) SetPal(i, Random(), Random(), Random());
+  _vgaPicture.resize(t.vgaWidth * t.vgaHeight * bytesPerPixel);
+  for (Bitu i = 0; i < t.vgaWidth * t.vgaHeight; ++i) RandomVGAPixel(t, &_vgaPicture[i * bytesPerPixel]);
+  if (t.bpp == 8) _vgaPicture[7] = _vgaPicture[39] = 0x00;
+
+  ReelMagic_SetVideoMixerEnabled(true);
+  ReelMagic_SetVideoMixerMPEGProvider(player);
+  ReelMagic_RENDER_SetSize(t.vgaWidth, t.vgaHeight, t.bpp, 70.0f, 1.0, false, false);
+  if (oldMixer) OldMixer::Setup(t.vgaWidth, t.vgaHeight, t.bpp, t.dup5, player);
+
+  for (unsigned frame = 0; frame < FRAME_COUNT; ++frame) {
+    switch (frame) {
+    case 2: //a few VGA pixels change
+      for (unsigned i = 0; i < 8; ++i) RandomVGAPixel(t, &_vgaPicture[(Random() % (t.vgaWidth * t.vgaHeight)) * bytesPerPixel]);
+      break;
+    case 3: //new MPEG picture
+      _player.newPicture = true;
+      break;
+    case 4: //a palette change
+      SetPal(Random() & 0xFF, Random(), Random(), Random());
+      break;
+    case 5: //the alpha channel index changes
+      _player.config.VgaAlphaIndex ^= 1;
+      break;
+    case 6: //two pixels change the same bit 32 bytes apart... a per-line hash can miss this
+      if (t.bpp == 8) _vgaPicture[7] = _vgaPicture[39] = 0x80;
+      break;
+    }
+
+    render.fullFrame = (frame == 0);
+    if (oldMixer) {
+      if (player) player->OnVerticalRefresh(70.0f);
+      OldMixer::StartUpdate(player);
+      for (Bitu y = 0; y < t.vgaHeight; ++y) OldMixer::_drawLine(&_vgaPicture[y * t.vgaWidth * bytesPerPixel]);
+      lines = OldMixer::_capturedLines;
+      AppendFrame(frames, OldMixer::_capturedFrame, lines);
+    }
+    else {
+      ReelMagic_RENDER_StartUpdate();
+      for (Bitu y = 0; y < t.vgaHeight; ++y) ReelMagic_RENDER_DrawLine(&_vgaPicture[y * t.vgaWidth * bytesPerPixel]);
+      lines = _capturedLines;
+      AppendFrame(frames, _capturedFrame, lines);
+    }
+  }
+
+  ReelMagic_SetVideoMixerMPEGProvider(NULL);
+  ReelMagic_ResetVideoMixer();
+  return frames;
+}
+
+static bool CompareFrames(const TestCase& t, const char *what, const std::vector<RenderOutputPixel>& expected, const Bitu expectedLines, const std::vector<RenderOutputPixel>& actual, const Bitu actualLines) {
+  const char *failure = NULL;
+  Bitu failedLine = 0, failedColumn = 0;
+  bool pixelFailure = false;
+  if (_capturedNull) {
+    failure = "unchanged line passed during a full frame update";
+  }
+  else if ((expectedLines != actualLines) || (expected.size() != actual.size())) {
+    failure = "line count differs";
+  }
+  else if (memcmp(&expected[0], &actual[0], expected.size() * sizeof(RenderOutputPixel))) {
+    for (Bitu line = 0; (failure == NULL) && (line < (expected.size() / _capturedWidth)); ++line) {
+      for (Bitu col = 0; col < _capturedWidth; ++col) {
+        if (!memcmp(&expected[line * _capturedWidth + col], &actual[line * _capturedWidth + col], sizeof(RenderOutputPixel))) continue;
+        failure = "pixel differs";
+        pixelFailure = true;
+        failedLine = line;
+        failedColumn = col;
+        break;
+      }
+    }
+  }
+  if (failure == NULL) return true;
+
+  fprintf(stderr, "FAIL: vga=%ux%ux%u mpeg=%ux%u %s dup5=%d player=%s colorkey=%s simd=%d vs %s: %s",
+    (unsigned)t.vgaWidth, (unsigned)t.vgaHeight, (unsigned)t.bpp, (unsigned)t.mpegWidth, (unsigned)t.mpegHeight,
+    t.vgaUnder ? "vga-under" : "vga-over", (int)t.dup5, (t.player == 0) ? "visible" : ((t.player == 1) ? "hidden" : "none"),
+    t.colorKey, (int)_simdLevel, what, failure);
+  if (pixelFailure)
+    fprintf(stderr, " (frame %u line %u column %u)", (unsigned)(failedLine / expectedLines), (unsigned)(failedLine % expectedLines), (unsigned)failedColumn);
+  fprintf(stderr, "\n");
+  return false;
+}
+
+static std::vector<ReelMagic_SIMDLevel> SupportedSIMDLevels() {
+  std::vector<ReelMagic_SIMDLevel> levels;
+  levels.push_back(REELMAGIC_SIMD_SCALAR);
+#ifdef RMR_SIMD_X86
+#if defined(__GNUC__)
+  if (__builtin_cpu_supports("sse2")) levels.push_back(REELMAGIC_SIMD_SSE2);
+  if (__builtin_cpu_supports("avx2")) levels.push_back(REELMAGIC_SIMD_AVX2);
+#else
+  levels.push_back(REELMAGIC_SIMD_SSE2);
+#endif
+#endif
+  return levels;
+}
+
+int main(int argc, char *argv[]) {
+  static const Bitu sizes[][4] = { //VGA width, height; MPEG width, height
+    {320, 240, 320, 240}, {640, 480, 320, 240}, {320, 200, 320, 240}, {640, 400, 320, 240},
+    {640, 480, 352, 240}, {320, 200, 352, 288}, {800, 600, 320, 240}, {360, 240, 352, 240},
+    {350, 190, 350, 190}, {320, 200, 320, 200}, {320, 240, 320, 288}, {320, 240, 320, 200},
+  };
+  static const Bitu bpps[] = {8, 15, 16, 32};
+  static const char * const colorKeys[] = {"000000", "FF00FF"};
+  const std::vector<ReelMagic_SIMDLevel> levels = SupportedSIMDLevels();
+  _capturedFrame.resize(MAX_LINES * SCALER_MAXWIDTH);
+
+  unsigned cases = 0;
+  for (unsigned s = 0; s < (sizeof(sizes) / sizeof(sizes[0])); ++s)
+  for (unsigned b = 0; b < (sizeof(bpps) / sizeof(bpps[0])); ++b)
+  for (unsigned k = 0; k < (sizeof(colorKeys) / sizeof(colorKeys[0])); ++k)
+  for (int under = 0; under < 2; ++under)
+  for (int dup5 = 0; dup5 < 2; ++dup5)
+  for (int player = 0; player < 3; ++player) {
+    const TestCase t = {sizes[s][0], sizes[s][1], bpps[b], (Bit16u)sizes[s][2], (Bit16u)sizes[s][3], under != 0, dup5 != 0, player, colorKeys[k]};
+    if ((t.bpp == 8) && (k != 0)) continue; //the colour key is not used for 8bpp
+
+    //the old renderers are the reference where they can be... the scalar mixers otherwise
+    const bool haveOldMixer = ((t.bpp == 8) || (t.bpp == 32)) && (k == 0);
+    Bitu expectedLines = 0, lines = 0;
+    std::vector<RenderOutputPixel> expected;
+    if (haveOldMixer) {
+      _simdLevel = REELMAGIC_SIMD_SCALAR;
+      expected = DrawFrames(t, true, expectedLines);
+    }
+    for (size_t l = 0; l < levels.size(); ++l) {
+      _simdLevel = levels[l];
+      _capturedNull = false;
+      const std::vector<RenderOutputPixel> actual = DrawFrames(t, false, lines);
+      if (expected.empty()) {
+        expected = actual;
+        expectedLines = lines;
+      }
+      if (!CompareFrames(t, haveOldMixer ? "old renderers" : "scalar", expected, expectedLines, actual, lines)) return 1;
+    }
+    ++cases;
+  }
+
+  printf("%u cases match at %u SIMD level(s)\n", cases, (unsigned)levels.size());
+  return 0;
+}